@@ -280,11 +280,24 @@ SL_WEAK void app_process_action(void)
  * opportunity we will get to act on an event.
  *
  *****************************************************************************/
+static void app_handle_event(sl_bt_msg_t *evt);
+
 void sl_bt_on_event(sl_bt_msg_t *evt)
 {
-  // Get pointer to BLE data structure
-   ble_data_struct_t *bleData = getBleDataPtr();
+  // External signals raised before the stack delivered them arrive OR'ed together,
+  // the scheduler hands them to the state machines one event bit at a time.
+  schedulerDispatchEvent(evt, app_handle_event);
+
+} // sl_bt_on_event()
 
+/**************************************************************************//**
+ * Feeds one event (with at most one external signal bit set) to the
+ * BLE event handler and the state machines.
+ *
+ * @param[in] evt Event coming from the Bluetooth stack.
+ *****************************************************************************/
+static void app_handle_event(sl_bt_msg_t *evt)
+{
   // Just a trick to hide a compiler warning about unused input parameter evt.
   (void) evt;
 
@@ -298,18 +311,11 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
 #if DEVICE_IS_BLE_SERVER
   //FOR SERVER
   // sequence through states driven by events
+  // Every machine sees every event: each one starts on its own gesture and then
+  // runs to completion on its own timer, even if a new gesture arrives meanwhile.
   gesture_state_machine(evt);
- if((bleData->gesture_value == 0x01) || (bleData->gesture_value == 0x02)){
-     bleData->pulse_on = true;
-      oximeter_state_machine(evt);
-  }
-
-  if(bleData->gesture_value==0x03)
-  {
-          // LOG_INFO("Down\n\r");
-
-           temp_state_machine(evt);
-  }
+  oximeter_state_machine(evt);
+  temp_state_machine(evt);
 
 #else
   //FOR CLIENT
@@ -318,4 +324,4 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
 #endif
 
 
-} // sl_bt_on_event()
+} // app_handle_event()
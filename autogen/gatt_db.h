@@ -23,7 +23,8 @@ extern const sli_bt_gattdb_t gattdb;
 #define gattdb_button_state                   33
 #define gattdb_gesture_state                  37
 #define gattdb_oximeter_state                 41
-#define gattdb_ota_control                    45
+#define gattdb_humidity                       45
+#define gattdb_ota_control                    49
 
 
 #endif // __GATT_DB_H
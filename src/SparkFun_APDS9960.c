@@ -20,105 +20,305 @@
 #define INCLUDE_LOG_DEBUG 1
 #include "src/log.h"
 
+#include <string.h>
+
 #include "app.h"
 #include "src/SparkFun_APDS9960.h"
 #include "src/i2c.h"
 #include "src/timers.h"
+#include "src/scheduler.h"
+#include "src/gesture_decoder.h"
+#include "src/gesture_trace.h"
 
-int gesture_ud_delta;
-int gesture_lr_delta;
-int gesture_ud_count;
-int gesture_lr_count;
-int gesture_near_count;
-int gesture_far_count;
-int gesture_state;
 int gesture_motion;
+static gesture_decoder_t gesture_decoder;   // Centroid path of the gesture being read
+static bool gesture_read_ending = false;  // GVALID dropped and FIFO drained, decode on the next readGestureStep()
+static uint8_t gesture_fifo_data[128];    // FIFO bytes, written by LDMA
+static uint8_t gesture_fifo_len;          // Number of FIFO bytes being read
+static volatile I2C_TransferReturn_TypeDef gesture_fifo_status; // Result of the FIFO read
+static uint8_t gesture_level_status[2];   // GFLVL and GSTATUS, written by LDMA
+static volatile I2C_TransferReturn_TypeDef gesture_level_status_result; // Result of the GFLVL/GSTATUS read
+static bool gesture_read_fifo = false;    // Evt_GestureFifo ends the FIFO read, not the GFLVL/GSTATUS one
+static bool gesture_read_started = false; // GVALID seen by the first GFLVL/GSTATUS read of the gesture
+static uint32_t gesture_wake_timeout_us = FIFO_PAUSE_TIME; // Fallback read when no batch interrupt comes
+
+/*
+ * Shadow copy of the configuration registers 0x80-0xAF and 0xE4-0xE7.
+ * It is filled with one burst read in SparkFun_APDS9960_init() and kept up to
+ * date by every write (write-through), so setters do not have to read a
+ * register back before changing a few bits of it.
+ */
+#define SHADOW_LOW_FIRST    APDS9960_ENABLE                             // 0x80
+#define SHADOW_LOW_LEN      (APDS9960_GSTATUS - APDS9960_ENABLE + 1)    // 0x80-0xAF
+#define SHADOW_HIGH_FIRST   APDS9960_IFORCE                             // 0xE4
+#define SHADOW_HIGH_LEN     (APDS9960_AICLEAR - APDS9960_IFORCE + 1)    // 0xE4-0xE7
+
+static uint8_t shadow_regs[SHADOW_LOW_LEN + SHADOW_HIGH_LEN];
+static bool shadow_valid = false;             // Set once the burst read at init succeeded
+static apds9960_cache_stats_type cache_stats;
+
+/*
+ * Configuration jobs. The setters never wait for the bus: reads come from the
+ * shadow copy and writes are collected in config_writes. enableGestureSensorAsync()
+ * and disableGestureSensorAsync() queue them on the I2C engine, every batch raises
+ * Evt_GestureConfig and gestureConfigStep() queues the next one.
+ */
+#define CONFIG_MAX_WRITES   (32)
+
+typedef enum {
+  CONFIG_IDLE,          // no batch on the bus, the setters may collect writes
+  CONFIG_SHADOW_READ,   // burst read of 0x80-0xAF on the bus
+  CONFIG_WRITE,         // batches of config_writes on the bus
+} config_phase_t;
+
+static i2c_reg_value_t config_writes[CONFIG_MAX_WRITES];
+static uint8_t config_count;                  // Writes collected
+static uint8_t config_queued;                 // Writes handed to the I2C engine
+static config_phase_t config_phase = CONFIG_IDLE;
+static bool config_enable;                    // The job turns the gesture engine on, else off
+static bool config_interrupts;                // GIEN asked for by enableGestureSensorAsync()
+static volatile I2C_TransferReturn_TypeDef config_status; // Result of the shadow read or batch
+
+/* Gesture engine defaults written by SparkFun_APDS9960_init(), ordered by register */
+static const i2c_reg_value_t gesture_defaults_table[] = {
+  { APDS9960_GPENTH,    DEFAULT_GPENTH },
+  { APDS9960_GEXTH,     DEFAULT_GEXTH },
+  { APDS9960_GCONF1,    DEFAULT_GCONF1 },
+  { APDS9960_GCONF2,    (DEFAULT_GGAIN << 5) | (DEFAULT_GLDRIVE << 3) | DEFAULT_GWTIME },
+  { APDS9960_GOFFSET_U, DEFAULT_GOFFSET },
+  { APDS9960_GOFFSET_D, DEFAULT_GOFFSET },
+  { APDS9960_GPULSE,    DEFAULT_GPULSE },
+  { APDS9960_GOFFSET_L, DEFAULT_GOFFSET },
+  { APDS9960_GOFFSET_R, DEFAULT_GOFFSET },
+  { APDS9960_GCONF3,    DEFAULT_GCONF3 },
+};
+#define GESTURE_DEFAULTS_TABLE_LEN (sizeof(gesture_defaults_table) / sizeof(gesture_defaults_table[0]))
+
+/* Proximity settings written by enableGestureSensor() */
+static const i2c_reg_value_t gesture_enable_table[] = {
+  { APDS9960_WTIME,     0xFF },
+  { APDS9960_PPULSE,    DEFAULT_GESTURE_PPULSE },
+};
+#define GESTURE_ENABLE_TABLE_LEN (sizeof(gesture_enable_table) / sizeof(gesture_enable_table[0]))
 
 bool interrupts = true;
 
 gesture_data_type gestureData;
 
-gesture_data_type * getGestureDataPtr() {
+/**
+ * @brief Empties the dataset ring, called when a gesture starts.
+ */
+void gestureRingReset(gesture_data_type *ring)
+{
+  ring->head = 0;
+  ring->count = 0;
+  ring->total_gestures = 0;
+  ring->decoded = 0;
+  ring->overwritten = 0;
+}
 
-  return (&gestureData);
+/**
+ * @brief Appends one dataset, overwrites the oldest one when the ring is full.
+ */
+void gestureRingPush(gesture_data_type *ring, uint8_t u, uint8_t d, uint8_t l, uint8_t r)
+{
+  ring->u_data[ring->head] = u;
+  ring->d_data[ring->head] = d;
+  ring->l_data[ring->head] = l;
+  ring->r_data[ring->head] = r;
+  ring->head = (ring->head + 1) & GESTURE_RING_MASK;
+
+  if( ring->count < GESTURE_RING_LEN ) {
+      ring->count++;
+  } else {
+      ring->overwritten++;
+  }
+  ring->total_gestures++;
 }
 
 /**
- * @brief Configures I2C communications and initializes registers to defaults
- *
- * @return True if initialized successfully. False otherwise.
+ * @brief Returns the slot of a dataset given by its sequence number in the gesture.
+ *        The dataset must still be held: total_gestures - count <= seq < total_gestures.
  */
-bool SparkFun_APDS9960_init()
+uint8_t gestureRingSlot(const gesture_data_type *ring, uint32_t seq)
 {
-  uint8_t id=0;
+  return (uint8_t)((ring->head - (ring->total_gestures - seq)) & GESTURE_RING_MASK);
+}
 
-  /* Initialize I2C */
-  //Wire.begin();
+gesture_data_type * getGestureDataPtr() {
 
-  /* Read ID register and check against known values for APDS-9960 */
-  //if( !wireReadDataByte(APDS9960_ID, id) ) {
-  if(writeAdd_readData(APDS9960_ID, &id) != 1) {
-      return false;
-  }
+  return (&gestureData);
+}
 
-  if( !(id == APDS9960_ID_1 || id == APDS9960_ID_2) ) {
-      return false;
+/**
+ * @brief Returns the index of a register in shadow_regs, -1 if it is not shadowed.
+ */
+static int shadowIndex(uint8_t reg)
+{
+  if( (reg >= SHADOW_LOW_FIRST) && (reg < SHADOW_LOW_FIRST + SHADOW_LOW_LEN) ) {
+      return reg - SHADOW_LOW_FIRST;
   }
-  else {
-      //LOG_INFO("First write_read successful\n\r");
+  if( (reg >= SHADOW_HIGH_FIRST) && (reg < SHADOW_HIGH_FIRST + SHADOW_HIGH_LEN) ) {
+      return SHADOW_LOW_LEN + (reg - SHADOW_HIGH_FIRST);
   }
 
-  /* Set ENABLE register to 0 (disable all features) */
-  if( !setMode(ALL, OFF) ) {
-      return false;
-  }
+  return -1;
+}
 
-  /* Set default values for gesture sense registers */
-  if( !setGestureEnterThresh(DEFAULT_GPENTH) ) {
-      return false;
-  }
-  if( !setGestureExitThresh(DEFAULT_GEXTH) ) {
-      return false;
+/**
+ * @brief True for registers the device changes on its own, these are always read
+ *        from the bus. GCONF4 is one of them because the device clears GMODE when
+ *        it leaves the gesture state machine and GFIFO_CLR clears itself.
+ *        Writes to the 0xE4-0xE7 clear registers are actions, never skipped.
+ */
+static bool shadowIsVolatile(uint8_t reg)
+{
+  return ( (reg >= APDS9960_STATUS) && (reg <= APDS9960_PDATA) ) ||
+         (reg == APDS9960_GCONF4) ||
+         (reg == APDS9960_GFLVL) ||
+         (reg == APDS9960_GSTATUS) ||
+         (reg >= SHADOW_HIGH_FIRST);
+}
+
+/**
+ * @brief Reads a register from the shadow copy, nothing waits for the bus.
+ *        GCONF4 is taken from the shadow copy too: the device only clears GMODE and
+ *        GFIFO_CLR on its own, and every setter writing it back sets GMODE explicitly.
+ *        The status and data registers are read with read_block_data_async().
+ *
+ * @param[in] reg the register to read
+ * @param[out] val the value read
+ * @return True if successful. False if the shadow copy does not hold the register.
+ */
+bool wireReadDataByte(uint8_t reg, uint8_t *val)
+{
+  int idx = shadowIndex(reg);
+
+  if( shadow_valid && (idx >= 0) && (!shadowIsVolatile(reg) || (reg == APDS9960_GCONF4)) ) {
+      *val = shadow_regs[idx];
+      cache_stats.read_hits++;
+      return true;
   }
 
-  if(writeAdd_writeData(APDS9960_GCONF1, DEFAULT_GCONF1) != 1) {
-        return false;
-    }
+  cache_stats.read_misses++;
+  return false;
+}
 
+/**
+ * @brief Collects a register write for the next configuration job and updates the
+ *        shadow copy. Nothing is collected if the register already holds the value.
+ *        A write to the register collected last replaces it, so the read-modify-write
+ *        setters of one register go out as one write.
+ *
+ * @param[in] reg the register to write
+ * @param[in] val the value to write
+ * @return True if successful. False if the job is full or already on the bus.
+ */
+bool wireWriteDataByte(uint8_t reg, uint8_t val)
+{
+  int idx = shadowIndex(reg);
 
-  if( !setGestureGain(DEFAULT_GGAIN) ) {
-      return false;
+  if( shadow_valid && (idx >= 0) && !shadowIsVolatile(reg) &&
+      (shadow_regs[idx] == val) ) {
+      cache_stats.write_skips++;
+      return true;
   }
-  if( !setGestureLEDDrive(DEFAULT_GLDRIVE) ) {
+
+  if( config_phase != CONFIG_IDLE ) {
       return false;
   }
-  if( !setGestureWaitTime(DEFAULT_GWTIME) ) {
+  if( (config_count > 0) && (config_writes[config_count - 1].reg == reg) ) {
+      config_writes[config_count - 1].value = val;
+  } else if( config_count < CONFIG_MAX_WRITES ) {
+      config_writes[config_count].reg = reg;
+      config_writes[config_count].value = val;
+      config_count++;
+  } else {
       return false;
   }
 
-  if(writeAdd_writeData(APDS9960_GOFFSET_U, DEFAULT_GOFFSET) != 1) {
-      return false;
+  cache_stats.writes++;
+  if( idx >= 0 ) {
+      shadow_regs[idx] = val;
   }
 
-  if(writeAdd_writeData(APDS9960_GOFFSET_D, DEFAULT_GOFFSET) != 1) {
-      return false;
+  return true;
+}
+
+/**
+ * @brief Returns the shadow register cache counters.
+ */
+const apds9960_cache_stats_type * getCacheStats()
+{
+  return (&cache_stats);
+}
+
+/**
+ * @brief Logs the shadow register cache counters.
+ */
+void logCacheStats()
+{
+  LOG_INFO("APDS9960 reads hit=%lu miss=%lu, writes skipped=%lu done=%lu\n\r",
+           (unsigned long)cache_stats.read_hits,
+           (unsigned long)cache_stats.read_misses,
+           (unsigned long)cache_stats.write_skips,
+           (unsigned long)cache_stats.writes);
+}
+
+/**
+ * @brief Collects the writes of a const register table for the next configuration job.
+ *        Entries whose register already holds the value are left out, the rest keep
+ *        their order so consecutive registers still go out as one burst.
+ *
+ * @param[in] table the (register, value) pairs
+ * @param[in] count number of entries
+ * @return True if successful. False otherwise.
+ */
+bool writeRegTable(const i2c_reg_value_t *table, size_t count)
+{
+  size_t i;
+
+  for( i = 0; i < count; i++ ) {
+      if( !wireWriteDataByte(table[i].reg, table[i].value) ) {
+          return false;
+      }
   }
 
-  if(writeAdd_writeData(APDS9960_GOFFSET_L, DEFAULT_GOFFSET) != 1) {
+  return true;
+}
+
+/**
+ * @brief Checks the device ID and collects the writes that initialize the registers
+ *        to defaults. Runs once the shadow copy has been read by enableGestureSensorAsync().
+ *
+ * @return True if initialized successfully. False otherwise.
+ */
+bool SparkFun_APDS9960_init()
+{
+  uint8_t id=0;
+
+  /* Initialize I2C */
+  //Wire.begin();
+
+  /* Check ID register against known values for APDS-9960 */
+  if( !wireReadDataByte(APDS9960_ID, &id) ) {
       return false;
   }
 
-  if(writeAdd_writeData(APDS9960_GOFFSET_R, DEFAULT_GOFFSET) != 1) {
+  if( !(id == APDS9960_ID_1 || id == APDS9960_ID_2) ) {
       return false;
   }
+  else {
+      //LOG_INFO("First write_read successful\n\r");
+  }
 
-  //if( !wireWriteDataByte(APDS9960_GPULSE, DEFAULT_GPULSE) ) {
-  if(writeAdd_writeData(APDS9960_GPULSE, DEFAULT_GPULSE) != 1) {
+  /* Set ENABLE register to 0 (disable all features) */
+  if( !setMode(ALL, OFF) ) {
       return false;
   }
 
-  //if( !wireWriteDataByte(APDS9960_GCONF3, DEFAULT_GCONF3) ) {
-  if(writeAdd_writeData(APDS9960_GCONF3, DEFAULT_GCONF3) != 1) {
+  /* Set default values for gesture sense registers, 0xA0-0xA7 and 0xA9-0xAA go out as two bursts */
+  if( !writeRegTable(gesture_defaults_table, GESTURE_DEFAULTS_TABLE_LEN) ) {
       return false;
   }
 
@@ -167,8 +367,7 @@ uint8_t getMode()
   uint8_t enable_value=0;
 
   /* Read current ENABLE register */
-  //if( !wireReadDataByte(APDS9960_ENABLE, enable_value) ) {
-  if(writeAdd_readData(APDS9960_ENABLE, &enable_value) != 1) {
+  if( !wireReadDataByte(APDS9960_ENABLE, &enable_value) ) {
       return 255;
   }
 
@@ -213,8 +412,7 @@ bool setMode(uint8_t mode, uint8_t enable)
   }
 
   /* Write value back to ENABLE register */
-  //if( !wireWriteDataByte(APDS9960_ENABLE, reg_val) ) {
-  if(writeAdd_writeData(APDS9960_ENABLE, reg_val) != 1) {
+  if( !wireWriteDataByte(APDS9960_ENABLE, reg_val) ) {
       return false;
   }
 
@@ -222,7 +420,8 @@ bool setMode(uint8_t mode, uint8_t enable)
 }
 
 /**
- * @brief Starts the gesture recognition engine on the APDS-9960
+ * @brief Collects the writes that start the gesture recognition engine on the APDS-9960,
+ *        enableGestureSensorAsync() queues them.
  *
  * @param[in] interrupts true to enable hardware external interrupt on gesture
  * @return True if engine enabled correctly. False on error.
@@ -237,17 +436,14 @@ bool enableGestureSensor(bool interrupts)
        Enable PON, WEN, PEN, GEN in ENABLE
    */
   resetGestureParameters();
-  //if( !wireWriteDataByte(APDS9960_WTIME, 0xFF) ) {
-  if(writeAdd_writeData(APDS9960_WTIME, 0xFF)!= 1) {
+  if( !writeRegTable(gesture_enable_table, GESTURE_ENABLE_TABLE_LEN) ) {
       return false;
   }
 
-  //if( !wireWriteDataByte(APDS9960_PPULSE, DEFAULT_GESTURE_PPULSE) ) {
-  if(writeAdd_writeData(APDS9960_PPULSE, DEFAULT_GESTURE_PPULSE) != 1) {
+  if( !setLEDBoost(LED_BOOST_300) ) {
       return false;
   }
-
-  if( !setLEDBoost(LED_BOOST_300) ) {
+  if( !setGestureCaptureMode(GESTURE_CAPTURE_MODE) ) {
       return false;
   }
   if( interrupts ) {
@@ -279,7 +475,8 @@ bool enableGestureSensor(bool interrupts)
 }
 
 /**
- * @brief Ends the gesture recognition engine on the APDS-9960
+ * @brief Collects the writes that end the gesture recognition engine on the APDS-9960,
+ *        disableGestureSensorAsync() queues them.
  *
  * @return True if engine disabled correctly. False on error.
  */
@@ -300,109 +497,355 @@ bool disableGestureSensor()
 }
 
 /**
- * @brief Determines if there is a gesture available for reading
+ * @brief Ends a configuration job. A failed job may have written part of its
+ *        registers, the shadow copy is not trusted any more.
  *
- * @return True if gesture available. False otherwise.
+ * @return ERROR
  */
-bool isGestureAvailable()
+static int gestureConfigAbort()
 {
-  uint8_t val=0;
+  config_phase = CONFIG_IDLE;
+  config_count = 0;
+  config_queued = 0;
+  shadow_valid = false;
+
+  return ERROR;
+}
 
-  /* Read value from GSTATUS register */
-  //if( !wireReadDataByte(APDS9960_GSTATUS, val) ) {
-  if(writeAdd_readData(APDS9960_GSTATUS, &val) != 1) {
+/**
+ * @brief Queues the next batch of the collected writes. With nothing collected the
+ *        job ends at once and raises Evt_GestureConfig itself.
+ *
+ * @return True if a batch was queued. False otherwise.
+ */
+static bool gestureConfigQueue()
+{
+  size_t queued;
+
+  if( config_count == 0 ) {
+      /* Every register already holds its value, the caller still gets its event */
+      config_status = i2cTransferDone;
+      config_phase = CONFIG_WRITE;
+      schedulerSetEvent(Evt_GestureConfig);
+      return true;
+  }
+
+  queued = i2cWriteRegTableAsync(&i2c_profile_apds9960,
+                                 &config_writes[config_queued],
+                                 config_count - config_queued,
+                                 Evt_GestureConfig,
+                                 &config_status);
+  if( queued == 0 ) {
       return false;
   }
+  config_queued += queued;
+  config_phase = CONFIG_WRITE;
 
-  /* Shift and mask out GVALID bit */
-  val &= APDS9960_GVALID;
+  return true;
+}
 
-  /* Return true/false based on GVALID bit */
-  if( val == 1) {
-      return true;
-  } else {
+/**
+ * @brief Starts turning the gesture engine on: the shadow copy is read in one burst,
+ *        then gestureConfigStep() initializes the registers and starts the engine.
+ *        Nothing waits for the bus, every step ends with Evt_GestureConfig.
+ *
+ * @param[in] interrupts true to enable hardware external interrupt on gesture
+ * @return True if the job was started. False if one is running or the read could not be queued.
+ */
+bool enableGestureSensorAsync(bool interrupts)
+{
+  if( config_phase != CONFIG_IDLE ) {
       return false;
   }
+
+  config_enable = true;
+  config_interrupts = interrupts;
+  config_count = 0;
+  config_queued = 0;
+
+  /* Fill the shadow copy of 0x80-0xAF in one burst, it includes the ID register */
+  shadow_valid = false;
+  cache_stats.read_misses++;
+  if( !read_block_data_async(SHADOW_LOW_FIRST, shadow_regs, SHADOW_LOW_LEN,
+                             Evt_GestureConfig, &config_status) ) {
+      return false;
+  }
+  config_phase = CONFIG_SHADOW_READ;
+
+  return true;
 }
 
 /**
- * @brief Processes a gesture event and returns best guessed gesture
+ * @brief Starts turning the gesture engine off. The writes are worked out from the
+ *        shadow copy and queued at once, Evt_GestureConfig follows every batch.
  *
- * @return Number corresponding to gesture. -1 on error.
+ * @return True if the job was started. False otherwise.
  */
-int readGesture()
+bool disableGestureSensorAsync()
 {
-  uint8_t fifo_level = 0;
-  uint8_t bytes_read = 0;
-  uint8_t fifo_data[128];
-  uint8_t gstatus=0;
-  int motion;
-  int i;
-  gesture_data_type *gesture_data = getGestureDataPtr();
+  if( config_phase != CONFIG_IDLE ) {
+      return false;
+  }
+
+  config_enable = false;
+  config_count = 0;
+  config_queued = 0;
 
-  /* Make sure that power and gesture is on and data is valid */
-  if( !isGestureAvailable() || !(getMode() & 0b01000001) ) {
-      return DIR_NONE;
+  if( !disableGestureSensor() ) {
+      gestureConfigAbort();
+      return false;
+  }
+  if( !gestureConfigQueue() ) {
+      gestureConfigAbort();
+      return false;
   }
 
-  /* Keep looping as long as gesture data is valid */
-  while(1) {
+  return true;
+}
 
-      /* Wait some time to collect next batch of FIFO data */
-      //delay(FIFO_PAUSE_TIME);
-      timerWaitUs_polled(FIFO_PAUSE_TIME);
+/**
+ * @brief Advances the running configuration job, called on Evt_GestureConfig.
+ *
+ * @return GESTURE_CONFIG_PENDING while batches are still to come,
+ *         GESTURE_CONFIG_ON or GESTURE_CONFIG_OFF when the job is done,
+ *         ERROR if a transfer failed or the device did not answer as an APDS-9960.
+ */
+int gestureConfigStep()
+{
+  switch( config_phase ) {
 
-      /* Get the contents of the STATUS register. Is data still valid? */
-      //if( !wireReadDataByte(APDS9960_GSTATUS, gstatus) ) {
-      if(writeAdd_readData(APDS9960_GSTATUS, &gstatus) != 1) {
-          return false;
+    case CONFIG_SHADOW_READ:
+      if( config_status != i2cTransferDone ) {
+          return gestureConfigAbort();
       }
+      /* 0xE4-0xE7 are write-only clear registers, there is nothing to read back */
+      memset(&shadow_regs[SHADOW_LOW_LEN], 0, SHADOW_HIGH_LEN);
+      shadow_valid = true;
+
+      /* Collect the init and enable writes, then queue the first batch */
+      config_phase = CONFIG_IDLE;
+      if( !SparkFun_APDS9960_init() || !enableGestureSensor(config_interrupts) ) {
+          return gestureConfigAbort();
+      }
+      if( !gestureConfigQueue() ) {
+          return gestureConfigAbort();
+      }
+      return GESTURE_CONFIG_PENDING;
 
-      /* If we have valid data, read in FIFO */
-      if( (gstatus & APDS9960_GVALID) == APDS9960_GVALID ) {
-
-          /* Read the current FIFO level */
-          //if( !wireReadDataByte(APDS9960_GFLVL, fifo_level) ) {
-          if(writeAdd_readData(APDS9960_GFLVL, &fifo_level) != 1) {
-              return false;
+    case CONFIG_WRITE:
+      if( config_status != i2cTransferDone ) {
+          return gestureConfigAbort();
+      }
+      if( config_queued < config_count ) {
+          if( !gestureConfigQueue() ) {
+              return gestureConfigAbort();
           }
+          return GESTURE_CONFIG_PENDING;
+      }
+      config_phase = CONFIG_IDLE;
+      config_count = 0;
+      config_queued = 0;
+      return config_enable ? GESTURE_CONFIG_ON : GESTURE_CONFIG_OFF;
+
+    default:
+      return GESTURE_CONFIG_PENDING;
+  }
+}
+
+/**
+ * @brief Queues the read of GFLVL and GSTATUS, Evt_GestureFifo is raised when it is done.
+ *        They are adjacent, one burst gets the FIFO level and whether data is still valid.
+ *
+ * @return True if the read was queued. False otherwise.
+ */
+static bool readGestureStatusAsync()
+{
+  gesture_read_fifo = false;
+
+  return read_block_data_async(APDS9960_GFLVL,
+                               gesture_level_status,
+                               sizeof(gesture_level_status),
+                               Evt_GestureFifo,
+                               &gesture_level_status_result);
+}
+
+/**
+ * @brief Checks that power and gesture mode are on and queues the read of GFLVL/GSTATUS.
+ *        The caller waits for Evt_GestureFifo and calls readGestureFifoDone(), which
+ *        tells whether a gesture is available.
+ *
+ * @return True if the read was queued. False otherwise.
+ */
+bool readGestureStart()
+{
+  /* Make sure that power and gesture is on, ENABLE comes from the shadow copy */
+  if( !(getMode() & 0b01000001) ) {
+      return false;
+  }
+
+  gesture_read_ending = false;
+  gesture_read_started = false;
+
+  return readGestureStatusAsync();
+}
+
+/**
+ * @brief Ends a gesture whose status or FIFO read failed, so the next one starts clean.
+ *
+ * @return ERROR
+ */
+static int readGestureAbort()
+{
+  if( gesture_read_started ) {
+      gesture_trace_end(ERROR);
+  }
+  gesture_read_ending = false;
+  gesture_read_started = false;
+  resetGestureParameters();
+
+  return ERROR;
+}
+
+/**
+ * @brief One pass of the SparkFun readGesture() loop for a gesture started with
+ *        readGestureStart(). The FIFO_PAUSE_TIME wait between passes is left to the
+ *        caller so no time is spent polling, the caller also calls it on an APDS
+ *        interrupt. GFLVL/GSTATUS are read in the background, Evt_GestureFifo is
+ *        raised when they are in and readGestureFifoDone() carries on from there.
+ *
+ * @return GESTURE_READ_FIFO if the caller has to wait for Evt_GestureFifo,
+ *         otherwise the number corresponding to the gesture. ERROR if a read failed,
+ *         the gesture is then dropped.
+ */
+int readGestureStep()
+{
+  int motion;
 
+  /* Data stopped being valid one pause ago, determine best guessed gesture and clean up */
+  if( gesture_read_ending ) {
+      gesture_read_ending = false;
+      gesture_read_started = false;
+      decodeGesture();
+      motion = gesture_motion;
+      gesture_trace_end(motion);
 #if DEBUG
-          Serial.print("FIFO Level: ");
-          Serial.println(fifo_level);
+      Serial.print("END: ");
+      Serial.println(gesture_motion_);
 #endif
+      resetGestureParameters();
+      return motion;
+  }
+
+  if( !readGestureStatusAsync() ) {
+      return readGestureAbort();
+  }
+
+  return GESTURE_READ_FIFO;
+}
+
+/**
+ * @brief Acts on the GFLVL/GSTATUS read queued by readGestureStart() or readGestureStep().
+ *        A non-empty FIFO is read by LDMA in the background.
+ *
+ * @return GESTURE_READ_PENDING if the caller has to wait for the next batch and call
+ *         readGestureStep(), GESTURE_READ_FIFO if the caller has to wait for Evt_GestureFifo,
+ *         GESTURE_READ_NONE if there was no gesture to start. ERROR if a read failed.
+ */
+static int readGestureStatusDone()
+{
+  uint8_t fifo_level;
+  uint8_t gstatus;
+
+  if( gesture_level_status_result != i2cTransferDone ) {
+      return readGestureAbort();
+  }
+  fifo_level = gesture_level_status[0];
+  gstatus = gesture_level_status[1];
+
+  /* The first read only checks that data is valid, the FIFO fills during the first pause */
+  if( !gesture_read_started ) {
+      if( (gstatus & APDS9960_GVALID) != APDS9960_GVALID ) {
+          return GESTURE_READ_NONE;
+      }
+      gesture_read_started = true;
+      gesture_trace_start();
+      return GESTURE_READ_PENDING;
+  }
 
-          /* If there's stuff in the FIFO, read it into our data block */
-          if( fifo_level > 0) {
-              bytes_read = read_block_data(  APDS9960_GFIFO_U,
-                                               (uint8_t*)fifo_data,
-                                               (fifo_level * 4) );
-              if( bytes_read == -1 ) {
-                  return ERROR;
-              }
 #if DEBUG
-              Serial.print("FIFO Dump: ");
-              for ( i = 0; i < bytes_read; i++ ) {
-                  Serial.print(fifo_data[i]);
-                  Serial.print(" ");
-              }
-              Serial.println();
+  Serial.print("FIFO Level: ");
+  Serial.println(fifo_level);
 #endif
 
-              /* If at least 1 set of data, sort the data into U/D/L/R */
-              if( bytes_read >= 4 ) {
-                  for( i = 0; i < bytes_read; i += 4 ) {
-                      gesture_data->u_data[gesture_data->index] = \
-                          fifo_data[i + 0];
-                      gesture_data->d_data[gesture_data->index] = \
-                          fifo_data[i + 1];
-                      gesture_data->l_data[gesture_data->index] = \
-                          fifo_data[i + 2];
-                      gesture_data->r_data[gesture_data->index] = \
-                          fifo_data[i + 3];
-                      gesture_data->index++;
-                      gesture_data->total_gestures++;
-                  }
+  /* If there's stuff in the FIFO, let LDMA read it into our data block. This is done
+     whether or not GVALID is still set: with a batch threshold GVALID drops as soon as
+     the level is below GFIFOTH, the last datasets of the gesture are still in the FIFO */
+  if( fifo_level > 0) {
+      if( fifo_level > (sizeof(gesture_fifo_data) / 4) ) {
+          fifo_level = sizeof(gesture_fifo_data) / 4;
+      }
+      gesture_fifo_len = fifo_level * 4;
+      gesture_read_fifo = true;
+      if( !read_block_data_async(APDS9960_GFIFO_U,
+                                 gesture_fifo_data,
+                                 gesture_fifo_len,
+                                 Evt_GestureFifo,
+                                 &gesture_fifo_status) ) {
+          return readGestureAbort();
+      }
+      return GESTURE_READ_FIFO;
+  }
+
+  /* Data is no longer valid and the FIFO is empty, decode after one more pause */
+  if( (gstatus & APDS9960_GVALID) != APDS9960_GVALID ) {
+      gesture_read_ending = true;
+  }
+
+  return GESTURE_READ_PENDING;
+}
+
+/**
+ * @brief Called on Evt_GestureFifo. Acts on a GFLVL/GSTATUS read, or sorts the FIFO bytes
+ *        into U/D/L/R and processes them.
+ *
+ * @return GESTURE_READ_PENDING if the caller has to wait for the next batch and call
+ *         readGestureStep() again, GESTURE_READ_FIFO if the caller has to wait for
+ *         Evt_GestureFifo again, GESTURE_READ_NONE if there was no gesture to start.
+ *         ERROR if a read failed.
+ */
+int readGestureFifoDone()
+{
+  uint8_t bytes_read = gesture_fifo_len;
+  int i;
+  gesture_data_type *gesture_data = getGestureDataPtr();
+
+  if( !gesture_read_fifo ) {
+      return readGestureStatusDone();
+  }
+
+  if( gesture_fifo_status != i2cTransferDone ) {
+      return readGestureAbort();
+  }
+  gesture_trace_data(gesture_fifo_data, bytes_read);
+#if DEBUG
+  Serial.print("FIFO Dump: ");
+  for ( i = 0; i < bytes_read; i++ ) {
+      Serial.print(gesture_fifo_data[i]);
+      Serial.print(" ");
+  }
+  Serial.println();
+#endif
+
+  /* If at least 1 set of data, sort the data into U/D/L/R. The ring keeps the whole
+     gesture across FIFO reads, a long swipe overwrites its oldest datasets */
+  if( bytes_read >= 4 ) {
+      for( i = 0; i + 3 < bytes_read; i += 4 ) {
+          gestureRingPush(gesture_data,
+                          gesture_fifo_data[i + 0],
+                          gesture_fifo_data[i + 1],
+                          gesture_fifo_data[i + 2],
+                          gesture_fifo_data[i + 3]);
+      }
 
 #if DEBUG
 Serial.print("Up Data: ");
@@ -413,35 +856,11 @@ for ( i = 0; i < gesture_data_.total_gestures; i++ ) {
 Serial.println();
 #endif
 
-/* Filter and process gesture data. Decode near/far state */
-if( processGestureData() ) {
-    if( decodeGesture() ) {
-        //***TODO: U-Turn Gestures
-#if DEBUG
-        //Serial.println(gesture_motion_);
-#endif
-    }
-}
-
-/* Reset data */
-gesture_data->index = 0;
-gesture_data->total_gestures = 0;
-              }
-          }
-      } else {
-
-          /* Determine best guessed gesture and clean up */
-          timerWaitUs_polled(FIFO_PAUSE_TIME);
-          decodeGesture();
-          motion = gesture_motion;
-#if DEBUG
-          Serial.print("END: ");
-          Serial.println(gesture_motion_);
-#endif
-          resetGestureParameters();
-          return motion;
-      }
+/* Feed the new gesture data to the decoder, it is classified when the gesture ends */
+processGestureData();
   }
+
+  return GESTURE_READ_PENDING;
 }
 
 /**
@@ -483,279 +902,57 @@ void resetGestureParameters()
 {
   gesture_data_type *gesture_data = getGestureDataPtr();
 
-  gesture_data->index = 0;
-  gesture_data->total_gestures = 0;
+  gestureRingReset(gesture_data);
+  gesture_decoder_reset(&gesture_decoder);
 
-  gesture_ud_delta = 0;
-  gesture_lr_delta = 0;
-
-  gesture_ud_count = 0;
-  gesture_lr_count = 0;
-
-  gesture_near_count = 0;
-  gesture_far_count = 0;
-
-  gesture_state = 0;
   gesture_motion = DIR_NONE;
 }
 
 /**
- * @brief Processes the raw gesture data to determine swipe direction
+ * @brief Feeds the datasets pushed since the last call to the gesture decoder
  *
- * @return True if near or far state seen. False otherwise.
+ * @return True if the decoder has seen enough valid datasets for a gesture. False otherwise.
  */
 bool processGestureData()
 {
-  uint8_t u_first = 0;
-  uint8_t d_first = 0;
-  uint8_t l_first = 0;
-  uint8_t r_first = 0;
-  uint8_t u_last = 0;
-  uint8_t d_last = 0;
-  uint8_t l_last = 0;
-  uint8_t r_last = 0;
-  int ud_ratio_first;
-  int lr_ratio_first;
-  int ud_ratio_last;
-  int lr_ratio_last;
-  int ud_delta;
-  int lr_delta;
-  int i;
+  uint32_t seq;
+  uint8_t slot;
   gesture_data_type *gesture_data = getGestureDataPtr();
 
-  /* If we have less than 4 total gestures, that's not enough */
-  if( gesture_data->total_gestures <= 4 ) {
-      return false;
+  /* Only look at datasets not seen yet, the ones overwritten unseen are lost */
+  seq = gesture_data->total_gestures - gesture_data->count;
+  if( seq < gesture_data->decoded ) {
+      seq = gesture_data->decoded;
   }
 
-  /* Check to make sure our data isn't out of bounds */
-  if( (gesture_data->total_gestures <= 32) && \
-      (gesture_data->total_gestures > 0) ) {
-
-      /* Find the first value in U/D/L/R above the threshold */
-      for( i = 0; i < gesture_data->total_gestures; i++ ) {
-          if( (gesture_data->u_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->d_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->l_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->r_data[i] > GESTURE_THRESHOLD_OUT) ) {
-
-              u_first = gesture_data->u_data[i];
-              d_first = gesture_data->d_data[i];
-              l_first = gesture_data->l_data[i];
-              r_first = gesture_data->r_data[i];
-              break;
-          }
-      }
-
-      /* If one of the _first values is 0, then there is no good data */
-      if( (u_first == 0) || (d_first == 0) || \
-          (l_first == 0) || (r_first == 0) ) {
-
-          return false;
-      }
-      /* Find the last value in U/D/L/R above the threshold */
-      for( i = gesture_data->total_gestures - 1; i >= 0; i-- ) {
-#if DEBUG
-          Serial.print(F("Finding last: "));
-          Serial.print(F("U:"));
-          Serial.print(gesture_data_.u_data[i]);
-          Serial.print(F(" D:"));
-          Serial.print(gesture_data_.d_data[i]);
-          Serial.print(F(" L:"));
-          Serial.print(gesture_data_.l_data[i]);
-          Serial.print(F(" R:"));
-          Serial.println(gesture_data_.r_data[i]);
-#endif
-          if( (gesture_data->u_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->d_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->l_data[i] > GESTURE_THRESHOLD_OUT) &&
-              (gesture_data->r_data[i] > GESTURE_THRESHOLD_OUT) ) {
-
-              u_last = gesture_data->u_data[i];
-              d_last = gesture_data->d_data[i];
-              l_last = gesture_data->l_data[i];
-              r_last = gesture_data->r_data[i];
-              break;
-          }
-      }
-  }
-
-  /* Calculate the first vs. last ratio of up/down and left/right */
-  ud_ratio_first = ((u_first - d_first) * 100) / (u_first + d_first);
-  lr_ratio_first = ((l_first - r_first) * 100) / (l_first + r_first);
-  ud_ratio_last = ((u_last - d_last) * 100) / (u_last + d_last);
-  lr_ratio_last = ((l_last - r_last) * 100) / (l_last + r_last);
-
-#if DEBUG
-  Serial.print(F("Last Values: "));
-  Serial.print(F("U:"));
-  Serial.print(u_last);
-  Serial.print(F(" D:"));
-  Serial.print(d_last);
-  Serial.print(F(" L:"));
-  Serial.print(l_last);
-  Serial.print(F(" R:"));
-  Serial.println(r_last);
-
-  Serial.print(F("Ratios: "));
-  Serial.print(F("UD Fi: "));
-  Serial.print(ud_ratio_first);
-  Serial.print(F(" UD La: "));
-  Serial.print(ud_ratio_last);
-  Serial.print(F(" LR Fi: "));
-  Serial.print(lr_ratio_first);
-  Serial.print(F(" LR La: "));
-  Serial.println(lr_ratio_last);
-#endif
-
-  /* Determine the difference between the first and last ratios */
-  ud_delta = ud_ratio_last - ud_ratio_first;
-  lr_delta = lr_ratio_last - lr_ratio_first;
-
-#if DEBUG
-  Serial.print("Deltas: ");
-  Serial.print("UD: ");
-  Serial.print(ud_delta);
-  Serial.print(" LR: ");
-  Serial.println(lr_delta);
-#endif
-
-  /* Accumulate the UD and LR delta values */
-  gesture_ud_delta += ud_delta;
-  gesture_lr_delta += lr_delta;
-
-#if DEBUG
-  Serial.print("Accumulations: ");
-  Serial.print("UD: ");
-  Serial.print(gesture_ud_delta_);
-  Serial.print(" LR: ");
-  Serial.println(gesture_lr_delta_);
-#endif
-
-  /* Determine U/D gesture */
-  if( gesture_ud_delta >= GESTURE_SENSITIVITY_1 ) {
-      gesture_ud_count = 1;
-  } else if( gesture_ud_delta <= -GESTURE_SENSITIVITY_1 ) {
-      gesture_ud_count = -1;
-  } else {
-      gesture_ud_count = 0;
-  }
-
-  /* Determine L/R gesture */
-  if( gesture_lr_delta >= GESTURE_SENSITIVITY_1 ) {
-      gesture_lr_count = 1;
-  } else if( gesture_lr_delta <= -GESTURE_SENSITIVITY_1 ) {
-      gesture_lr_count = -1;
-  } else {
-      gesture_lr_count = 0;
-  }
-
-  /* Determine Near/Far gesture */
-  if( (gesture_ud_count == 0) && (gesture_lr_count == 0) ) {
-      if( (abs(ud_delta) < GESTURE_SENSITIVITY_2) && \
-          (abs(lr_delta) < GESTURE_SENSITIVITY_2) ) {
-
-          if( (ud_delta == 0) && (lr_delta == 0) ) {
-              gesture_near_count++;
-          } else if( (ud_delta != 0) || (lr_delta != 0) ) {
-              gesture_far_count++;
-          }
-
-          if( (gesture_near_count >= 10) && (gesture_far_count >= 2) ) {
-              if( (ud_delta == 0) && (lr_delta == 0) ) {
-                  gesture_state = NEAR_STATE;
-              } else if( (ud_delta != 0) && (lr_delta != 0) ) {
-                  gesture_state = FAR_STATE;
-              }
-              return true;
-          }
-      }
-  } else {
-      if( (abs(ud_delta) < GESTURE_SENSITIVITY_2) && \
-          (abs(lr_delta) < GESTURE_SENSITIVITY_2) ) {
-
-          if( (ud_delta == 0) && (lr_delta == 0) ) {
-              gesture_near_count++;
-          }
-
-          if( gesture_near_count >= 10 ) {
-              gesture_ud_count = 0;
-              gesture_lr_count = 0;
-              gesture_ud_delta = 0;
-              gesture_lr_delta = 0;
-          }
-      }
+  for( ; seq < gesture_data->total_gestures; seq++ ) {
+      slot = gestureRingSlot(gesture_data, seq);
+      gesture_decoder_step(&gesture_decoder,
+                           gesture_data->u_data[slot],
+                           gesture_data->d_data[slot],
+                           gesture_data->l_data[slot],
+                           gesture_data->r_data[slot]);
   }
+  gesture_data->decoded = gesture_data->total_gestures;
 
-#if DEBUG
-  Serial.print("UD_CT: ");
-  Serial.print(gesture_ud_count_);
-  Serial.print(" LR_CT: ");
-  Serial.print(gesture_lr_count_);
-  Serial.print(" NEAR_CT: ");
-  Serial.print(gesture_near_count_);
-  Serial.print(" FAR_CT: ");
-  Serial.println(gesture_far_count_);
-  Serial.println("----------");
-#endif
-
-  return false;
+  return gesture_decoder_ready(&gesture_decoder);
 }
 
 /**
- * @brief Determines swipe direction or near/far state
+ * @brief Determines swipe, diagonal, U-turn or near/far from the decoder
  *
- * @return True if near/far event. False otherwise.
+ * @return True if a gesture was recognised. False otherwise.
  */
 bool decodeGesture()
 {
-  /* Return if near or far event is detected */
-  if( gesture_state == NEAR_STATE ) {
-      gesture_motion = DIR_NEAR;
-      return true;
-  } else if ( gesture_state == FAR_STATE ) {
-      gesture_motion = DIR_FAR;
-      return true;
-  }
+  gesture_motion = gesture_decoder_result(&gesture_decoder);
 
-  /* Determine swipe direction */
-  if( (gesture_ud_count == -1) && (gesture_lr_count == 0) ) {
-      gesture_motion = DIR_UP;
-  } else if( (gesture_ud_count == 1) && (gesture_lr_count == 0) ) {
-      gesture_motion = DIR_DOWN;
-  } else if( (gesture_ud_count == 0) && (gesture_lr_count == 1) ) {
-      gesture_motion = DIR_RIGHT;
-  } else if( (gesture_ud_count == 0) && (gesture_lr_count == -1) ) {
-      gesture_motion = DIR_LEFT;
-  } else if( (gesture_ud_count == -1) && (gesture_lr_count == 1) ) {
-      if( abs(gesture_ud_delta) > abs(gesture_lr_delta) ) {
-          gesture_motion = DIR_UP;
-      } else {
-          gesture_motion = DIR_RIGHT;
-      }
-  } else if( (gesture_ud_count == 1) && (gesture_lr_count == -1) ) {
-      if( abs(gesture_ud_delta) > abs(gesture_lr_delta) ) {
-          gesture_motion = DIR_DOWN;
-      } else {
-          gesture_motion = DIR_LEFT;
-      }
-  } else if( (gesture_ud_count == -1) && (gesture_lr_count == -1) ) {
-      if( abs(gesture_ud_delta) > abs(gesture_lr_delta) ) {
-          gesture_motion = DIR_UP;
-      } else {
-          gesture_motion = DIR_LEFT;
-      }
-  } else if( (gesture_ud_count == 1) && (gesture_lr_count == 1) ) {
-      if( abs(gesture_ud_delta) > abs(gesture_lr_delta) ) {
-          gesture_motion = DIR_DOWN;
-      } else {
-          gesture_motion = DIR_RIGHT;
-      }
-  } else {
-      return false;
-  }
+#if DEBUG
+  Serial.print("Motion: ");
+  Serial.println(gesture_motion_);
+#endif
 
-  return true;
+  return (gesture_motion != DIR_NONE);
 }
 
 /**
@@ -766,7 +963,7 @@ bool decodeGesture()
  */
 bool setGestureEnterThresh(uint8_t threshold)
 {
-  if(writeAdd_writeData(APDS9960_GPENTH, threshold) != 1) {
+  if( !wireWriteDataByte(APDS9960_GPENTH, threshold) ) {
       return false;
   }
 
@@ -781,7 +978,7 @@ bool setGestureEnterThresh(uint8_t threshold)
  */
 bool setGestureExitThresh(uint8_t threshold)
 {
-  if(writeAdd_writeData(APDS9960_GEXTH, threshold) != 1) {
+  if( !wireWriteDataByte(APDS9960_GEXTH, threshold) ) {
       return false;
   }
 
@@ -805,7 +1002,7 @@ bool setGestureGain(uint8_t gain)
   uint8_t val=0;
 
   /* Read value from GCONF2 register */
-  if(writeAdd_readData(APDS9960_GCONF2, &val) != 1) {
+  if( !wireReadDataByte(APDS9960_GCONF2, &val) ) {
       return false;
   }
 
@@ -816,7 +1013,7 @@ bool setGestureGain(uint8_t gain)
   val |= gain;
 
   /* Write register value back into GCONF2 register */
-  if(writeAdd_writeData(APDS9960_GCONF2, val) != 1) {
+  if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
       return false;
   }
 
@@ -840,7 +1037,7 @@ bool setGestureLEDDrive(uint8_t drive)
   uint8_t val=0;
 
   /* Read value from GCONF2 register */
-  if(writeAdd_readData(APDS9960_GCONF2, &val) != 1) {
+  if( !wireReadDataByte(APDS9960_GCONF2, &val) ) {
       return false;
   }
 
@@ -851,7 +1048,7 @@ bool setGestureLEDDrive(uint8_t drive)
   val |= drive;
 
   /* Write register value back into GCONF2 register */
-  if(writeAdd_writeData(APDS9960_GCONF2, val) != 1) {
+  if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
       return false;
   }
 
@@ -863,7 +1060,7 @@ bool setLEDBoost(uint8_t boost)
     uint8_t val=0;
 
     /* Read value from CONFIG2 register */
-    if(writeAdd_readData(APDS9960_CONFIG2, &val) != 1) {
+    if( !wireReadDataByte(APDS9960_CONFIG2, &val) ) {
         return false;
     }
 
@@ -874,7 +1071,7 @@ bool setLEDBoost(uint8_t boost)
     val |= boost;
 
     /* Write register value back into CONFIG2 register */
-    if(writeAdd_writeData(APDS9960_CONFIG2, val) != 1) {
+    if( !wireWriteDataByte(APDS9960_CONFIG2, val) ) {
         return false;
     }
 
@@ -902,7 +1099,7 @@ bool setGestureWaitTime(uint8_t time)
   uint8_t val=0;
 
   /* Read value from GCONF2 register */
-  if(writeAdd_readData(APDS9960_GCONF2, &val) != 1) {
+  if( !wireReadDataByte(APDS9960_GCONF2, &val) ) {
       return false;
   }
 
@@ -912,13 +1109,148 @@ bool setGestureWaitTime(uint8_t time)
   val |= time;
 
   /* Write register value back into GCONF2 register */
-  if(writeAdd_writeData(APDS9960_GCONF2, val) != 1) {
+  if( !wireWriteDataByte(APDS9960_GCONF2, val) ) {
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Sets the number of datasets in the FIFO that raise a gesture interrupt
+ *
+ * Value    Datasets
+ *   0          1
+ *   1          4
+ *   2          8
+ *   3         16
+ *
+ * @param[in] threshold GFIFOTH_1, GFIFOTH_4, GFIFOTH_8 or GFIFOTH_16
+ * @return True if operation successful. False otherwise.
+ */
+bool setGestureFifoThreshold(uint8_t threshold)
+{
+  uint8_t val=0;
+
+  /* Read value from GCONF1 register */
+  if( !wireReadDataByte(APDS9960_GCONF1, &val) ) {
+      return false;
+  }
+
+  /* Set bits in register to given value */
+  threshold &= 0b00000011;
+  threshold = threshold << 6;
+  val &= 0b00111111;
+  val |= threshold;
+
+  /* Write register value back into GCONF1 register */
+  if( !wireWriteDataByte(APDS9960_GCONF1, val) ) {
       return false;
   }
 
   return true;
 }
 
+/**
+ * @brief Returns the number of datasets a GFIFOTH value stands for
+ *
+ * @param[in] threshold GFIFOTH_1 ... GFIFOTH_16
+ * @return Datasets in the FIFO when the interrupt is raised.
+ */
+uint8_t gestureFifoDatasets(uint8_t threshold)
+{
+  switch( threshold & 0b00000011 ) {
+    case GFIFOTH_1:
+      return 1;
+    case GFIFOTH_4:
+      return 4;
+    case GFIFOTH_8:
+      return 8;
+    default:
+      return 16;
+  }
+}
+
+/**
+ * @brief Estimates the time the gesture engine takes for one dataset
+ *
+ * @param[in] time GWTIME value
+ * @return Wait time plus GESTURE_DATASET_PULSE_US, in microseconds.
+ */
+uint32_t gestureDatasetTimeUs(uint8_t time)
+{
+  static const uint16_t gwtime_us[8] = { 0, 2800, 5600, 8400, 14000, 22400, 30800, 39200 };
+
+  return (uint32_t)gwtime_us[time & 0b00000111] + GESTURE_DATASET_PULSE_US;
+}
+
+/**
+ * @brief Picks the largest FIFO threshold whose batch fills within GESTURE_BATCH_MAX_US.
+ *        Four datasets is the smallest batch, one dataset per wakeup is what batching avoids.
+ *
+ * @param[in] time GWTIME value
+ * @return GFIFOTH_4, GFIFOTH_8 or GFIFOTH_16
+ */
+uint8_t gestureFifoThresholdFor(uint8_t time)
+{
+  uint32_t dataset_us = gestureDatasetTimeUs(time);
+  uint8_t threshold = GFIFOTH_16;
+
+  while( (threshold > GFIFOTH_4) &&
+         ((gestureFifoDatasets(threshold) * dataset_us) > GESTURE_BATCH_MAX_US) ) {
+      threshold--;
+  }
+
+  return threshold;
+}
+
+/**
+ * @brief Sets the FIFO threshold for the capture mode and the fallback read timeout.
+ *        Batched mode derives the threshold from the gesture wait time in GCONF2,
+ *        polled mode keeps the SparkFun default of four datasets.
+ *
+ * @param[in] mode GESTURE_CAPTURE_POLLED or GESTURE_CAPTURE_BATCHED
+ * @return True if operation successful. False otherwise.
+ */
+bool setGestureCaptureMode(uint8_t mode)
+{
+  uint8_t gconf2=0;
+  uint8_t threshold = GFIFOTH_4;
+  uint32_t batch_us;
+
+  if( !wireReadDataByte(APDS9960_GCONF2, &gconf2) ) {
+      return false;
+  }
+
+  if( mode == GESTURE_CAPTURE_BATCHED ) {
+      threshold = gestureFifoThresholdFor(gconf2 & 0b00000111);
+  }
+  if( !setGestureFifoThreshold(threshold) ) {
+      return false;
+  }
+
+  /* GVALID drops while the FIFO is below the threshold, the fallback read must not come
+     before a batch had time to fill or a gesture in progress is decoded too early */
+  batch_us = gestureFifoDatasets(threshold) * gestureDatasetTimeUs(gconf2 & 0b00000111);
+  gesture_wake_timeout_us = (mode == GESTURE_CAPTURE_BATCHED) ? (2 * batch_us) : FIFO_PAUSE_TIME;
+  if( gesture_wake_timeout_us < FIFO_PAUSE_TIME ) {
+      gesture_wake_timeout_us = FIFO_PAUSE_TIME;
+  }
+
+  LOG_INFO("gesture FIFO threshold %d datasets, fallback read after %lu us\n\r",
+           gestureFifoDatasets(threshold), (unsigned long)gesture_wake_timeout_us);
+
+  return true;
+}
+
+/**
+ * @brief Returns how long to wait for a batch interrupt before reading the FIFO anyway.
+ */
+uint32_t getGestureWakeTimeoutUs()
+{
+  return gesture_wake_timeout_us;
+}
+
 /**
  * @brief Turns gesture-related interrupts on or off
  *
@@ -930,7 +1262,7 @@ bool setGestureIntEnable(uint8_t enable)
   uint8_t val=0;
 
   /* Read value from GCONF4 register */
-  if(writeAdd_readData(APDS9960_GCONF4, &val) != 1) {
+  if( !wireReadDataByte(APDS9960_GCONF4, &val) ) {
       return false;
   }
 
@@ -941,7 +1273,7 @@ bool setGestureIntEnable(uint8_t enable)
   val |= enable;
 
   /* Write register value back into GCONF4 register */
-  if(writeAdd_writeData(APDS9960_GCONF4, val) != 1) {
+  if( !wireWriteDataByte(APDS9960_GCONF4, val) ) {
       return false;
   }
 
@@ -959,7 +1291,7 @@ bool setGestureMode(uint8_t mode)
   uint8_t val=0;
 
   /* Read value from GCONF4 register */
-  if(writeAdd_readData(APDS9960_GCONF4, &val) != 1) {
+  if( !wireReadDataByte(APDS9960_GCONF4, &val) ) {
       return false;
   }
 
@@ -969,7 +1301,7 @@ bool setGestureMode(uint8_t mode)
   val |= mode;
 
   /* Write register value back into GCONF4 register */
-  if(writeAdd_writeData(APDS9960_GCONF4, val) != 1) {
+  if( !wireWriteDataByte(APDS9960_GCONF4, val) ) {
       return false;
   }
 
@@ -27,6 +27,7 @@
 #include <app.h>
 #include "stdint.h"
 #include "stdbool.h"
+#include "src/i2c.h"
 
 
 /* Debug */
@@ -48,7 +49,30 @@
 #define APDS9960_ID_2           0x9C
 
 /* Misc parameters */
-#define FIFO_PAUSE_TIME         30000      // Wait period (ms) between FIFO reads
+#define FIFO_PAUSE_TIME         30000      // Wait period (us) between FIFO reads
+
+/* Gesture capture: polled reads every FIFO_PAUSE_TIME, or one wakeup per FIFO threshold batch */
+#define GESTURE_CAPTURE_POLLED  0
+#define GESTURE_CAPTURE_BATCHED 1
+#define GESTURE_CAPTURE_MODE    GESTURE_CAPTURE_BATCHED
+
+/* Longest time a batch may take to fill, keeps the latency at the old polling period */
+#define GESTURE_BATCH_MAX_US    FIFO_PAUSE_TIME
+/* Estimated time of one dataset on top of GWTIME: DEFAULT_GPULSE's 10 x 32 us pulses
+   on both photodiode pairs plus conversion, rounded up */
+#define GESTURE_DATASET_PULSE_US 700
+
+/* Returned by readGestureStep() while the gesture is still being read */
+#define GESTURE_READ_PENDING    (-1)
+/* Returned by readGestureStep() while LDMA reads GFLVL/GSTATUS or the FIFO, wait for Evt_GestureFifo */
+#define GESTURE_READ_FIFO       (-2)
+/* Returned by readGestureFifoDone() when the interrupt was not for a gesture, nothing to report */
+#define GESTURE_READ_NONE       (-3)
+/* Returned by gestureConfigStep() while the next batch of register writes is on the bus */
+#define GESTURE_CONFIG_PENDING  (-1)
+/* Returned by gestureConfigStep() when the gesture engine has been turned off or on */
+#define GESTURE_CONFIG_OFF      (0)
+#define GESTURE_CONFIG_ON       (1)
 
 /* APDS-9960 register addresses */
 #define APDS9960_ENABLE         0x80
@@ -155,6 +179,12 @@
 #define LED_BOOST_200           2
 #define LED_BOOST_300           3
 
+/* FIFO threshold values, GCONF1 GFIFOTH: interrupt after this many datasets */
+#define GFIFOTH_1               0
+#define GFIFOTH_4               1
+#define GFIFOTH_8               2
+#define GFIFOTH_16              3
+
 /* Gesture wait time values */
 #define GWTIME_0MS              0
 #define GWTIME_2_8MS            1
@@ -203,6 +233,14 @@ enum {
   DIR_DOWN,
   DIR_NEAR,
   DIR_FAR,
+  DIR_UP_LEFT,          // Diagonals
+  DIR_UP_RIGHT,
+  DIR_DOWN_LEFT,
+  DIR_DOWN_RIGHT,
+  DIR_UTURN_UP_DOWN,    // U-turns, named by the way out then the way back
+  DIR_UTURN_DOWN_UP,
+  DIR_UTURN_LEFT_RIGHT,
+  DIR_UTURN_RIGHT_LEFT,
   DIR_ALL
 };
 
@@ -214,18 +252,34 @@ enum {
   ALL_STATE
 };
 
-/* Container for gesture data */
+/* Datasets kept of one gesture, a power of two. Twice the 32 dataset FIFO */
+#define GESTURE_RING_LEN        64
+#define GESTURE_RING_MASK       (GESTURE_RING_LEN - 1)
+
+/* Container for gesture data: ring of the datasets of the gesture being read, one
+   array per photodiode. When full, the oldest dataset is overwritten. */
 typedef struct gesture_data_type {
-    uint8_t u_data[32];
-    uint8_t d_data[32];
-    uint8_t l_data[32];
-    uint8_t r_data[32];
-    uint8_t index;
-    uint8_t total_gestures;
+    uint8_t u_data[GESTURE_RING_LEN];
+    uint8_t d_data[GESTURE_RING_LEN];
+    uint8_t l_data[GESTURE_RING_LEN];
+    uint8_t r_data[GESTURE_RING_LEN];
+    uint8_t head;               /* Slot the next dataset goes into */
+    uint8_t count;              /* Datasets held, at most GESTURE_RING_LEN */
+    uint32_t total_gestures;    /* Datasets pushed since the gesture started */
+    uint32_t decoded;           /* Datasets already seen by processGestureData() */
+    uint32_t overwritten;       /* Datasets dropped because the ring was full */
     uint8_t in_threshold;
     uint8_t out_threshold;
 } gesture_data_type;
 
+/* Shadow register cache counters */
+typedef struct apds9960_cache_stats_type {
+    uint32_t read_hits;     /* Register reads answered from the shadow copy */
+    uint32_t read_misses;   /* Register reads that went to the bus */
+    uint32_t write_skips;   /* Writes dropped because the register already held the value */
+    uint32_t writes;        /* Writes that went to the bus */
+} apds9960_cache_stats_type;
+
 /* APDS9960 Class */
 //struct SparkFun_APDS9960 {
 
@@ -240,6 +294,9 @@ typedef struct gesture_data_type {
     //bool enableGestureSensor(bool interrupts = true);
     bool enableGestureSensor(bool interrupts);
     bool disableGestureSensor();
+    bool enableGestureSensorAsync(bool interrupts);
+    bool disableGestureSensorAsync();
+    int gestureConfigStep();
 
     bool setGestureLEDDrive(uint8_t drive);
 
@@ -248,8 +305,9 @@ typedef struct gesture_data_type {
     bool setGestureIntEnable(uint8_t enable);
 
     /* Gesture methods */
-    bool isGestureAvailable();
-    int readGesture();
+    bool readGestureStart();
+    int readGestureStep();
+    int readGestureFifoDone();
 
     /* Gesture processing */
     void resetGestureParameters();
@@ -263,12 +321,30 @@ typedef struct gesture_data_type {
     /* Gesture LED, gain, and time control */
     bool setGestureWaitTime(uint8_t time);
 
+    /* FIFO threshold and capture mode */
+    bool setGestureFifoThreshold(uint8_t threshold);
+    uint8_t gestureFifoDatasets(uint8_t threshold);
+    uint32_t gestureDatasetTimeUs(uint8_t time);
+    uint8_t gestureFifoThresholdFor(uint8_t time);
+    bool setGestureCaptureMode(uint8_t mode);
+    uint32_t getGestureWakeTimeoutUs();
+
     /* Gesture mode */
     bool setGestureMode(uint8_t mode);
 
     bool setLEDBoost(uint8_t boost);
 
     gesture_data_type * getGestureDataPtr();
+    void gestureRingReset(gesture_data_type *ring);
+    void gestureRingPush(gesture_data_type *ring, uint8_t u, uint8_t d, uint8_t l, uint8_t r);
+    uint8_t gestureRingSlot(const gesture_data_type *ring, uint32_t seq);
+
+    /* Shadow register cache */
+    bool wireReadDataByte(uint8_t reg, uint8_t *val);
+    bool wireWriteDataByte(uint8_t reg, uint8_t val);
+    bool writeRegTable(const i2c_reg_value_t *table, size_t count);
+    const apds9960_cache_stats_type * getCacheStats();
+    void logCacheStats();
     /* Members */
     //gesture_data_type gesture_data;
    /* int gesture_ud_delta;
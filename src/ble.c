@@ -54,6 +54,11 @@ static uint8_t gesture_queue_head;  /* next write index */
 static uint8_t gesture_queue_tail;  /* next read index */
 static uint8_t gesture_queue_count; /* number of items in queue */
 
+/* Humidity is measured together with temperature, it waits here while the HTM indication is in flight */
+static bool humidity_queued = false;
+static uint8_t humidity_buffer[2];  /* org.bluetooth.characteristic.humidity, uint16 LSB = 0.01 % */
+static void ble_IndicateHumidity(void);
+
 static bool gesture_queue_is_empty(void)
 {
   return (gesture_queue_count == 0);
@@ -88,10 +93,14 @@ static bool gesture_queue_pop(uint8_t *value)
   return true;
 }
 
-/** Send next queued gesture if none in flight and queue not empty. */
+/** Send a waiting humidity indication, else the next queued gesture, if none in flight. */
 static void ble_TrySendNextGesture(void)
 {
   ble_data_struct_t *bleData = getBleDataPtr();
+  if (!bleData->indication_inFlight && humidity_queued) {
+    ble_IndicateHumidity();
+    return;
+  }
   if (!bleData->indication_inFlight && !gesture_queue_is_empty()) {
     uint8_t state;
     if (gesture_queue_pop(&state)) {
@@ -106,7 +115,8 @@ typedef enum {
   PENDING_TEMP,
   PENDING_GESTURE,
   PENDING_OXIMETER,
-  PENDING_BUTTON
+  PENDING_BUTTON,
+  PENDING_HUMIDITY
 } pending_indication_type_t;
 
 #define PENDING_PAYLOAD_MAX  5
@@ -157,6 +167,9 @@ static void ble_RetryPendingIndication(void)
     case PENDING_BUTTON:
       attr = gattdb_button_state;
       break;
+    case PENDING_HUMIDITY:
+      attr = gattdb_humidity;
+      break;
     default:
       bleData->indication_inFlight = false;
       ble_TrySendNextGesture();
@@ -335,8 +348,6 @@ void handle_ble_event(sl_bt_msg_t *evt) {
 
       bleData->pulse_indication    =false;
       bleData->pulse_on            =false;
-      bleData->oximeter_busy       =false;
-      bleData->temp_busy          =false;
       break;
 
       // Handle connection opened event
@@ -410,11 +421,19 @@ void handle_ble_event(sl_bt_msg_t *evt) {
       bleData->gesture_indication  =false;
       bleData->pulse_indication    =false;
       bleData->pulse_on            =false;
-      bleData->oximeter_busy       =false;
-      bleData->temp_busy           =false;
 #if DEVICE_IS_BLE_SERVER
       ble_ClearPendingIndication();
+      humidity_queued = false;
+      oximeterStopStreaming();
 #endif
+      // how many external signals were coalesced during this connection
+      schedulerLogStats();
+      i2cLogStats();
+#if DEVICE_IS_BLE_SERVER
+      tempLogPowerStats();
+      gestureLogStats();
+#endif
+      logCacheStats();
       sc = sl_bt_sm_delete_bondings();
       if(sc != SL_STATUS_OK)
         {
@@ -523,6 +542,12 @@ void handle_ble_event(sl_bt_msg_t *evt) {
       // Handle external signal event
     case sl_bt_evt_system_external_signal_id:
 
+      // I2C failures are only counted in interrupt context, log them from here
+      if(evt->data.evt_system_external_signal.extsignals == Evt_I2CError)
+        {
+          i2cLogErrors();
+        }
+
       if(evt->data.evt_system_external_signal.extsignals ==Evt_Button_Pressed)
         {
 
@@ -533,28 +558,13 @@ void handle_ble_event(sl_bt_msg_t *evt) {
           {
             LOG_INFO("Gesture Sensor Enabled\n\r");
             displayPrintf(DISPLAY_ROW_10, "Enable gesture sensor");
-            flag=SparkFun_APDS9960_init();
-            if(flag != true)
-              {
-                  LOG_ERROR("Error initializing APDS\n\r");
-              }
-            else
-              {
-                 LOG_INFO("APDS initialized\n\r");
-              }
-            flag = enableGestureSensor(true);
+            //init and enable run on the I2C engine, the gesture state machine
+            //turns gesture_on on when Evt_GestureConfig reports them done
+            flag = enableGestureSensorAsync(true);
             if(flag != true)
               {
                  LOG_ERROR("Error enabling gesture\n\r");
               }
-            else
-              {
-               //LOG_INFO("gesture enabled\n\r");
-                 displayPrintf(DISPLAY_ROW_10, "Gesture Sensor ON!");
-                 bleData->gesture_on = true;
-                 bleData->gesture_value = 0x00;
-
-             }
 
           }
 
@@ -632,6 +642,8 @@ void handle_ble_event(sl_bt_msg_t *evt) {
 
                    //check if indication flag is disabled
                    if(evt->data.evt_gatt_server_characteristic_status.client_config_flags == gatt_disable) {
+                       //the client no longer wants results, end continuous streaming
+                       oximeterStopStreaming();
                        //bleData->oximeter_indication = false;
                        //gpioLed1SetOff();
                        //LOG_INFO("oximeter indication off\n\r");
@@ -834,6 +846,16 @@ void handle_ble_event(sl_bt_msg_t *evt) {
                bleData->gesture_value = 0x00;
                displayPrintf(DISPLAY_ROW_9, "NONE Gesture");
              }
+           else if(evt->data.evt_gatt_characteristic_value.value.data[0] <= 0x0E)
+             {
+               // Diagonals and U-turns, not tied to a vital so gesture_value is kept
+               static const char *const extra_gestures[] = {
+                   "UP-LEFT", "UP-RIGHT", "DOWN-LEFT", "DOWN-RIGHT",
+                   "UP-DOWN", "DOWN-UP", "LEFT-RIGHT", "RIGHT-LEFT"
+               };
+               displayPrintf(DISPLAY_ROW_9, "%s Gesture",
+                             extra_gestures[evt->data.evt_gatt_characteristic_value.value.data[0] - 0x07]);
+             }
 
            if(evt->data.evt_gatt_characteristic_value.value.data[0] == 0x04)
              {
@@ -856,6 +878,13 @@ void handle_ble_event(sl_bt_msg_t *evt) {
               else if(bleData->gesture_value == 0x02){
                   displayPrintf(DISPLAY_ROW_TEMPVALUE, "Heart rate: %d", evt->data.evt_gatt_characteristic_value.value.data[0]);
               }
+
+              //streaming results carry [SpO2, heart rate]
+              else if(bleData->gesture_value == 0x05){
+                  displayPrintf(DISPLAY_ROW_TEMPVALUE, "HR %d SpO2 %d",
+                                evt->data.evt_gatt_characteristic_value.value.data[1],
+                                evt->data.evt_gatt_characteristic_value.value.data[0]);
+              }
       }
       break;
 
@@ -884,12 +913,13 @@ void ble_SendTemperature()
   // Check if device is connected
   if(bleData->connected == true && (bleData->bonded == true))
     {
-      // Convert temperature to Celsius
-      int32_t temperature_in_c = ConvertTempToCelcius();
+      // Temperature in milli-degrees Celsius
+      int32_t temperature_mc = ConvertTempToMilliCelsius();
+      int32_t temperature_abs = (temperature_mc < 0) ? -temperature_mc : temperature_mc;
       // Set temperature flags
       UINT8_TO_BITSTREAM(p, flags);
-      // Convert temperature to fixed point
-      htm_temperature_flt = INT32_TO_FLOAT(temperature_in_c*1000, -3);
+      // Millidegrees go straight into the mantissa with a 10^-3 exponent
+      htm_temperature_flt = INT32_TO_FLOAT(temperature_mc, -3);
       // Set temperature data in buffer
       UINT32_TO_BITSTREAM(p, htm_temperature_flt);
       // Write temperature data to GATT server attribute
@@ -925,8 +955,10 @@ void ble_SendTemperature()
                   bleData->indication_inFlight = true;
                   ble_SavePendingIndication(PENDING_TEMP, &htm_temperature_buffer[0], 5);
                   // Log indication sent
-                  LOG_INFO("Sent HTM indication, temp=%d\n\r", temperature_in_c);
-                  displayPrintf(DISPLAY_ROW_TEMPVALUE, "Temp=%d", temperature_in_c);
+                  LOG_INFO("Sent HTM indication, temp=%s%ld.%03ld C\n\r", (temperature_mc < 0) ? "-" : "",
+                           (long)(temperature_abs / 1000), (long)(temperature_abs % 1000));
+                  displayPrintf(DISPLAY_ROW_TEMPVALUE, "Temp=%s%ld.%02ld", (temperature_mc < 0) ? "-" : "",
+                                (long)(temperature_abs / 1000), (long)((temperature_abs % 1000) / 10));
                 }
             }
 
@@ -934,6 +966,61 @@ void ble_SendTemperature()
 }
 
 
+/**
+ * @brief Sends the queued humidity value as an indication.
+ */
+static void ble_IndicateHumidity(void)
+{
+  ble_data_struct_t *bleData = getBleDataPtr();
+
+  humidity_queued = false;
+  sl_status_t sc = sl_bt_gatt_server_send_indication(bleData->connection_handle,
+                                                     gattdb_humidity,
+                                                     sizeof(humidity_buffer),
+                                                     &humidity_buffer[0]);
+  if(sc != SL_STATUS_OK)
+    {
+      LOG_ERROR("sl_bt_gatt_server_send_indication() returned != 0 status=0x%04x\n\r", (unsigned int)sc);
+    }
+  else
+    {
+      bleData->indication_inFlight = true;
+      ble_SavePendingIndication(PENDING_HUMIDITY, &humidity_buffer[0], sizeof(humidity_buffer));
+      LOG_INFO("Sent humidity indication\n\r");
+    }
+}
+
+void ble_SendHumidity()
+{
+  // Get pointer to BLE data structure
+  ble_data_struct_t *bleData = getBleDataPtr();
+  int32_t humidity_mrh;
+  uint16_t humidity;
+
+  if(bleData->connected == true && (bleData->bonded == true))
+    {
+      humidity_mrh = ConvertHumidityToMilliRH();
+      humidity = (uint16_t)(humidity_mrh / 10);   // 0.01 % units
+      humidity_buffer[0] = (uint8_t)(humidity & 0xFF);
+      humidity_buffer[1] = (uint8_t)(humidity >> 8);
+
+      sl_status_t sc = sl_bt_gatt_server_write_attribute_value(gattdb_humidity,
+                                                               0,
+                                                               sizeof(humidity_buffer),
+                                                               &humidity_buffer[0]);
+      if(sc != SL_STATUS_OK)
+        {
+          LOG_ERROR("sl_bt_gatt_server_write_attribute_value() returned != 0 status=0x%04x\n\r", (unsigned int)sc);
+        }
+
+      displayPrintf(DISPLAY_ROW_8, "RH=%ld.%ld%%", (long)(humidity_mrh / 1000), (long)((humidity_mrh % 1000) / 100));
+
+      // the temperature indication usually is still in flight, send once it is confirmed
+      humidity_queued = true;
+      ble_TrySendNextGesture();
+    }
+}
+
 void ble_SendPulseState(uint8_t * pulse_data)
 {
   // Get pointer to BLE data structure
@@ -1036,7 +1123,8 @@ void ble_SendGesture(uint8_t state)
                   //indication is sent i.e. indication is in flight; save for retry on timeout
                   bleData->indication_inFlight = true;
                   ble_SavePendingIndication(PENDING_GESTURE, &gesture_buffer_value[0], 2);
-                  LOG_INFO("Gesture indication sent, state=%d\n\r", state);
+                  LOG_INFO("Gesture indication sent, state=%d, latency=%lu us\n\r", state,
+                           (unsigned long)(timerGetMicroseconds() - bleData->gesture_time_us));
                 }
            }
       }
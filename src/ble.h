@@ -77,7 +77,6 @@ typedef struct {
   bool    indication;
   bool    indication_inFlight;
   uint8_t advertisingSetHandle;
-  uint32_t rollover_cnt;
 //  bool gatt_procedure;
 
   uint32_t service_handle;
@@ -102,17 +101,13 @@ typedef struct {
   uint32_t gesture_service_handle;
   uint16_t gesture_char_handle;
   uint8_t gesture_value;
+  uint64_t gesture_time_us;   /**< timerGetMicroseconds() when the last gesture interrupt was raised */
 
   bool pulse_indication;
   bool pulse_on;
   uint32_t pulse_service_handle;
   uint16_t pulse_char_handle;
 
-  /** True while oximeter state machine is running (not in state_pulse_done). Lets gesture dispatch keep feeding oximeter until done. */
-  bool oximeter_busy;
-  /** True while temp state machine is running (not in StateA_Sleep). Lets gesture dispatch keep feeding temp until done. */
-  bool temp_busy;
-
 } ble_data_struct_t;
 
 /**
@@ -135,6 +130,12 @@ void handle_ble_event(sl_bt_msg_t *evt);
  */
 void ble_SendTemperature();
 
+/**
+ * @brief Sends the humidity of the last RH+T measurement over BLE, after the
+ *        temperature indication when that one is still in flight.
+ */
+void ble_SendHumidity();
+
 /**
  * @brief Sends button status over BLE.
  *
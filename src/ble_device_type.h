@@ -31,8 +31,11 @@
  * Students:
  * Set to 1 to configure this build as a BLE server.
  * Set to 0 to configure as a BLE client
+ * The host tests in test/ pass -DDEVICE_IS_BLE_SERVER=1 to build the server side.
  */
+#ifndef DEVICE_IS_BLE_SERVER
 #define DEVICE_IS_BLE_SERVER 0
+#endif
 
 
 // Students:
@@ -0,0 +1,151 @@
+/*
+ * gesture_decoder.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only incremental decoder for APDS9960 gesture datasets.
+ */
+
+#include "src/gesture_decoder.h"
+#include "src/SparkFun_APDS9960.h"
+
+/* Fewer valid datasets than this are not a gesture, as in the SparkFun decoder */
+#define GESTURE_MIN_DATASETS (5)
+
+static int16_t gesture_abs(int16_t v)
+{
+  return (v < 0) ? -v : v;
+}
+
+void gesture_decoder_reset(gesture_decoder_t *dec)
+{
+  dec->valid = 0;
+  dec->still = 0;
+}
+
+void gesture_decoder_step(gesture_decoder_t *dec, uint8_t u, uint8_t d, uint8_t l, uint8_t r)
+{
+  int16_t x, y;
+
+  if( (u <= GESTURE_THRESHOLD_OUT) || (d <= GESTURE_THRESHOLD_OUT) ||
+      (l <= GESTURE_THRESHOLD_OUT) || (r <= GESTURE_THRESHOLD_OUT) ) {
+      return;
+  }
+
+  // same orientation as the SparkFun ratios: (l - r) grows for RIGHT, (u - d) for DOWN
+  x = (int16_t)((((int16_t)l - r) * GESTURE_CENTROID_SCALE) / (l + r));
+  y = (int16_t)((((int16_t)u - d) * GESTURE_CENTROID_SCALE) / (u + d));
+
+  if( dec->valid == 0 ) {
+      dec->x0 = dec->x_min = dec->x_max = x;
+      dec->y0 = dec->y_min = dec->y_max = y;
+      dec->n_x_min = dec->n_x_max = dec->n_y_min = dec->n_y_max = 0;
+      dec->sum0 = (uint16_t)u + d + l + r;
+  }
+
+  if( x < dec->x_min ) { dec->x_min = x; dec->n_x_min = dec->valid; }
+  if( x > dec->x_max ) { dec->x_max = x; dec->n_x_max = dec->valid; }
+  if( y < dec->y_min ) { dec->y_min = y; dec->n_y_min = dec->valid; }
+  if( y > dec->y_max ) { dec->y_max = y; dec->n_y_max = dec->valid; }
+
+  if( (gesture_abs(x - dec->x0) < GESTURE_SENSITIVITY_2) &&
+      (gesture_abs(y - dec->y0) < GESTURE_SENSITIVITY_2) ) {
+      dec->still++;
+  }
+
+  dec->x = x;
+  dec->y = y;
+  dec->sum = (uint16_t)u + d + l + r;
+  dec->valid++;
+}
+
+bool gesture_decoder_ready(const gesture_decoder_t *dec)
+{
+  return (dec->valid >= GESTURE_MIN_DATASETS);
+}
+
+/**
+ * @brief Checks one axis for a U-turn: far out, then back close to the start.
+ * @return 1 if the excursion went positive first, -1 if negative, 0 for no U-turn.
+ */
+static int gesture_uturn(int16_t start, int16_t end, int16_t min, uint16_t n_min,
+                         int16_t max, uint16_t n_max)
+{
+  bool out_pos = ((max - start) >= GESTURE_SENSITIVITY_1);
+  bool out_neg = ((start - min) >= GESTURE_SENSITIVITY_1);
+
+  if( gesture_abs(end - start) >= GESTURE_SENSITIVITY_2 ) {
+      return 0;
+  }
+  if( out_pos && out_neg ) {
+      return (n_max < n_min) ? 1 : -1;
+  }
+  if( out_pos ) {
+      return 1;
+  }
+  if( out_neg ) {
+      return -1;
+  }
+
+  return 0;
+}
+
+int gesture_decoder_result(const gesture_decoder_t *dec)
+{
+  int16_t dx, dy, adx, ady;
+  int16_t reach_x, reach_y;
+  int turn;
+
+  if( !gesture_decoder_ready(dec) ) {
+      return DIR_NONE;
+  }
+
+  dx = dec->x - dec->x0;
+  dy = dec->y - dec->y0;
+  adx = gesture_abs(dx);
+  ady = gesture_abs(dy);
+
+  /* Moved out and came back: U-turn on the axis with the wider excursion */
+  reach_x = dec->x_max - dec->x_min;
+  reach_y = dec->y_max - dec->y_min;
+  if( (adx < GESTURE_SENSITIVITY_1) && (ady < GESTURE_SENSITIVITY_1) ) {
+      if( reach_x >= reach_y ) {
+          turn = gesture_uturn(dec->x0, dec->x, dec->x_min, dec->n_x_min,
+                               dec->x_max, dec->n_x_max);
+          if( turn != 0 ) {
+              return (turn > 0) ? DIR_UTURN_RIGHT_LEFT : DIR_UTURN_LEFT_RIGHT;
+          }
+      } else {
+          turn = gesture_uturn(dec->y0, dec->y, dec->y_min, dec->n_y_min,
+                               dec->y_max, dec->n_y_max);
+          if( turn != 0 ) {
+              return (turn > 0) ? DIR_UTURN_DOWN_UP : DIR_UTURN_UP_DOWN;
+          }
+      }
+
+      /* Held in place: getting brighter is a hand coming near, darker is going away */
+      if( dec->still >= GESTURE_HOLD_DATASETS ) {
+          if( (uint32_t)dec->sum * 8 >= (uint32_t)dec->sum0 * (8 + GESTURE_PROXIMITY_EIGHTHS) ) {
+              return DIR_NEAR;
+          }
+          if( (uint32_t)dec->sum * 8 <= (uint32_t)dec->sum0 * (8 - GESTURE_PROXIMITY_EIGHTHS) ) {
+              return DIR_FAR;
+          }
+      }
+      return DIR_NONE;
+  }
+
+  /* Both axes moved by a similar amount: diagonal */
+  if( (adx >= GESTURE_SENSITIVITY_1) && (ady >= GESTURE_SENSITIVITY_1) &&
+      (2 * adx >= ady) && (2 * ady >= adx) ) {
+      if( dy < 0 ) {
+          return (dx > 0) ? DIR_UP_RIGHT : DIR_UP_LEFT;
+      }
+      return (dx > 0) ? DIR_DOWN_RIGHT : DIR_DOWN_LEFT;
+  }
+
+  /* Otherwise the axis that moved most */
+  if( ady > adx ) {
+      return (dy > 0) ? DIR_DOWN : DIR_UP;
+  }
+  return (dx > 0) ? DIR_RIGHT : DIR_LEFT;
+}
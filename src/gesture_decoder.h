@@ -0,0 +1,67 @@
+/*
+ * gesture_decoder.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only incremental decoder for APDS9960 gesture datasets. Each
+ *              dataset moves a tracked centroid, the path of the centroid is classified
+ *              into swipes, diagonals, U-turns and near/far when the gesture ends.
+ */
+
+#ifndef SRC_GESTURE_DECODER_H_
+#define SRC_GESTURE_DECODER_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Centroid scale, matches the percent ratios GESTURE_SENSITIVITY_1/2 are given in */
+#define GESTURE_CENTROID_SCALE (100)
+
+/** Datasets the centroid has to stay put for a near/far decision */
+#define GESTURE_HOLD_DATASETS (16)
+
+/** Brightness change, in 1/8 of the starting brightness, that makes a hold near or far */
+#define GESTURE_PROXIMITY_EIGHTHS (2)
+
+/**
+ * @brief State of one gesture. Positions are centroids scaled by GESTURE_CENTROID_SCALE,
+ *        x grows towards RIGHT and y towards DOWN as in the SparkFun ratios.
+ */
+typedef struct {
+  uint16_t valid;     ///< Datasets above the threshold on all photodiodes
+  uint16_t still;     ///< Valid datasets close to the starting point
+  int16_t x0, y0;     ///< Starting centroid
+  int16_t x, y;       ///< Latest centroid
+  int16_t x_min, x_max, y_min, y_max;
+  uint16_t n_x_min, n_x_max, n_y_min, n_y_max; ///< Dataset number of each extreme
+  uint16_t sum0;      ///< Brightness of the first valid dataset
+  uint16_t sum;       ///< Brightness of the latest valid dataset
+} gesture_decoder_t;
+
+/**
+ * @brief Clears the decoder for a new gesture.
+ */
+void gesture_decoder_reset(gesture_decoder_t *dec);
+
+/**
+ * @brief Feeds one FIFO dataset. Datasets with any photodiode at or below the
+ *        threshold are ignored. Two integer divisions per dataset.
+ * @param dec Decoder state.
+ * @param u Up photodiode.
+ * @param d Down photodiode.
+ * @param l Left photodiode.
+ * @param r Right photodiode.
+ */
+void gesture_decoder_step(gesture_decoder_t *dec, uint8_t u, uint8_t d, uint8_t l, uint8_t r);
+
+/**
+ * @brief Returns true once enough valid datasets came in to classify the gesture.
+ */
+bool gesture_decoder_ready(const gesture_decoder_t *dec);
+
+/**
+ * @brief Classifies the centroid path fed so far.
+ * @return A DIR_ value, DIR_NONE if the path matches no gesture.
+ */
+int gesture_decoder_result(const gesture_decoder_t *dec);
+
+#endif /* SRC_GESTURE_DECODER_H_ */
@@ -0,0 +1,107 @@
+/*
+ * gesture_trace.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Binary gesture trace frames over VCOM.
+ */
+
+#include "src/gesture_trace.h"
+#include "src/SparkFun_APDS9960.h"
+#include "src/timers.h"
+
+#include "sl_iostream.h"
+#include "sl_iostream_init_usart_instances.h"
+
+/* Header, timestamp, a full 32 dataset FIFO read and the sum */
+#define GESTURE_TRACE_FRAME_MAX (4 + 4 + 128 + 1)
+
+static uint8_t trace_frame[GESTURE_TRACE_FRAME_MAX];
+
+/**
+ * @brief Starts a frame, the payload begins with the current time in microseconds.
+ *        The timestamp wraps after about 71 minutes.
+ * @return Index of the next payload byte.
+ */
+static uint8_t trace_begin(uint8_t type)
+{
+  uint32_t t_us = (uint32_t)timerGetMicroseconds();
+
+  trace_frame[0] = GESTURE_TRACE_SYNC0;
+  trace_frame[1] = GESTURE_TRACE_SYNC1;
+  trace_frame[2] = type;
+  trace_frame[4] = (uint8_t)(t_us);
+  trace_frame[5] = (uint8_t)(t_us >> 8);
+  trace_frame[6] = (uint8_t)(t_us >> 16);
+  trace_frame[7] = (uint8_t)(t_us >> 24);
+
+  return 8;
+}
+
+/**
+ * @brief Fills in the length and sum and writes the frame. The VCOM write blocks
+ *        for about 87 us per byte at 115200 baud, so this is for capture only.
+ * @param end Index one past the last payload byte.
+ */
+static void trace_send(uint8_t end)
+{
+  uint8_t sum = 0;
+  uint8_t i;
+
+  trace_frame[3] = end - 4;
+  for( i = 2; i < end; i++ ) {
+      sum += trace_frame[i];
+  }
+  trace_frame[end] = sum;
+
+  sl_iostream_write(sl_iostream_vcom_handle, trace_frame, end + 1);
+}
+
+void gesture_trace_start(void)
+{
+  uint8_t n;
+
+  if( !GESTURE_TRACE_ENABLE ) {
+      return;
+  }
+
+  n = trace_begin(GESTURE_TRACE_START);
+  trace_frame[n++] = GESTURE_THRESHOLD_OUT;
+  trace_frame[n++] = GESTURE_SENSITIVITY_1;
+  trace_frame[n++] = GESTURE_SENSITIVITY_2;
+  trace_frame[n++] = GESTURE_CAPTURE_MODE;
+  trace_send(n);
+}
+
+void gesture_trace_data(const uint8_t *fifo, uint8_t len)
+{
+  uint8_t n;
+  uint8_t i;
+
+  if( !GESTURE_TRACE_ENABLE ) {
+      return;
+  }
+
+  len &= ~3;
+  if( len > GESTURE_TRACE_FRAME_MAX - 9 ) {
+      len = GESTURE_TRACE_FRAME_MAX - 9;
+  }
+
+  n = trace_begin(GESTURE_TRACE_DATA);
+  for( i = 0; i < len; i++ ) {
+      trace_frame[n++] = fifo[i];
+  }
+  trace_send(n);
+}
+
+void gesture_trace_end(int motion)
+{
+  uint8_t n;
+
+  if( !GESTURE_TRACE_ENABLE ) {
+      return;
+  }
+
+  n = trace_begin(GESTURE_TRACE_END);
+  trace_frame[n++] = (uint8_t)motion;
+  trace_send(n);
+}
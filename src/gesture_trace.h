@@ -0,0 +1,53 @@
+/*
+ * gesture_trace.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Capture mode for tuning the gesture decoder. Every raw U/D/L/R dataset
+ *              read from the APDS9960 FIFO is written to VCOM as a compact binary frame
+ *              with a timestamp, so gestures can be recorded and replayed off target.
+ */
+
+#ifndef SRC_GESTURE_TRACE_H_
+#define SRC_GESTURE_TRACE_H_
+
+#include "stdint.h"
+
+/** 1 to write gesture trace frames to VCOM, 0 to compile the capture out */
+#define GESTURE_TRACE_ENABLE (0)
+
+/**
+ * Frame layout, multi-byte fields little endian:
+ *   sync0 sync1 type len payload[len] sum
+ * sum is the 8-bit sum of type, len and payload. The frames share VCOM with the
+ * text log, a reader scans for the sync bytes and drops frames with a bad sum.
+ */
+#define GESTURE_TRACE_SYNC0 (0xA5)
+#define GESTURE_TRACE_SYNC1 (0x5A)
+
+/** Frame types */
+enum {
+  GESTURE_TRACE_START = 1, ///< t_us(4) threshold_out sensitivity_1 sensitivity_2 capture_mode
+  GESTURE_TRACE_DATA  = 2, ///< t_us(4) then U D L R for each dataset of one FIFO read
+  GESTURE_TRACE_END   = 3  ///< t_us(4) decoded DIR_ value
+};
+
+/**
+ * @brief Writes a START frame with the decoder parameters. Called when a gesture read starts.
+ */
+void gesture_trace_start(void);
+
+/**
+ * @brief Writes a DATA frame with the raw FIFO bytes of one read, timestamped when
+ *        the read completed. The datasets of a read are one dataset period apart.
+ * @param fifo FIFO bytes, U D L R per dataset.
+ * @param len Number of bytes, a multiple of 4, at most 128.
+ */
+void gesture_trace_data(const uint8_t *fifo, uint8_t len);
+
+/**
+ * @brief Writes an END frame with the gesture the decoder returned.
+ * @param motion DIR_ value.
+ */
+void gesture_trace_end(int motion);
+
+#endif /* SRC_GESTURE_TRACE_H_ */
@@ -36,6 +36,8 @@
 #define LED1_pin   (5)
 #define TEMP_SENSOR_PORT gpioPortD  //port 3
 #define TEMP_SENSOR_PIN (15)
+// SENSOR_ENABLE is tied to DISP_ENABLE on the main board, the LCD needs it on all the time
+#define TEMP_SENSOR_SHARES_DISPLAY_ENABLE (1)
 #define LCD_port    gpioPortD   //port 3
 #define LCD_pin     (13)
 #define BUTTON_PORT  (5)
@@ -9,6 +9,7 @@
  *   I have commented LOG_ERROR statements to avoid generating unwanted warnings
  */
 #include "stdint.h"
+#include <string.h>
 #include "src/i2c.h"
 #define INCLUDE_LOG_DEBUG 1
 #include "src/log.h"
@@ -26,6 +27,12 @@
 #include "em_letimer.h"
 #include "em_gpio.h"
 #include "em_i2c.h"
+#include "em_core.h"
+#include "em_cmu.h"
+#include "sl_power_manager.h"
+#include "src/scheduler.h"
+#include "src/pulse_aggregate.h"
+#include "src/si7021.h"
 
 
 #define SI7021_ADD 0x40   // Device address of the sensor as per datasheet
@@ -34,10 +41,19 @@
 
 uint8_t data_write; ///< Variable to hold data to be written via I2C
 uint8_t data_read[2]; ///< Array to store data read via I2C (2 bytes)
+uint8_t humidity_read[2]; ///< Last Si7021 humidity code, MSB first
+static uint8_t temp_from_rh_cmd = SI7021_CMD_TEMP_FROM_RH; ///< Command byte of the temperature read-back
+static volatile I2C_TransferReturn_TypeDef si7021_read_status = i2cTransferDone; ///< Result of the last humidity read
+static uint8_t si7021_user_reg_read = SI7021_CMD_READ_USER_REG; ///< Command byte of the user register read
+static uint8_t si7021_user_reg;             ///< User register 1 as read back
+static uint8_t si7021_user_reg_write[2];    ///< Write user register command and new value
+static uint8_t si7021_user_reg_res;         ///< RES1/RES0 bits being written
+static volatile I2C_TransferReturn_TypeDef si7021_res_status = i2cTransferDone; ///< Result of the last resolution change
 
 uint8_t pulse_data[8];
-uint16_t heart_rate[10]; // LSB = 0.1bpm
-uint16_t o2[10]; // 0-100% LSB = 1%
+uint16_t heart_rate[PULSE_AGG_MAX_SAMPLES]; // accepted samples, bpm
+uint16_t o2[PULSE_AGG_MAX_SAMPLES]; // accepted samples, 0-100%
+uint64_t sample_time_us[PULSE_AGG_MAX_SAMPLES]; // timerGetMicroseconds() when each sample was taken
 uint8_t  confidence; // 0-100% LSB = 1%
 
 //Status values
@@ -48,14 +64,54 @@ uint8_t  confidence; // 0-100% LSB = 1%
 uint8_t  status=0;
 uint8_t send_max30101_data[2];
 int i=0;
-uint8_t max_heart_rate=0;
-uint8_t max_o2=0;
+uint8_t result_heart_rate=0; // median heart rate of the last measurement
+uint8_t result_o2=0;         // median SpO2 of the last measurement
+static pulse_agg_t pulse_agg; ///< Samples of the running measurement
 
 
-I2C_TransferSeq_TypeDef transfer_sequence;
+static volatile uint32_t pulse_pending = 0; ///< Sensor hub transfers queued but not finished
+static uint8_t pulse_fifo_data[1 + MAX32664_FIFO_MAX_SAMPLES * MAX32664_SAMPLE_LEN]; ///< Status byte + FIFO records
+static uint8_t pulse_fifo_count = 0;       ///< Samples in the FIFO read on the bus
+static uint32_t pulse_fifo_reads = 0;      ///< FIFO reads in the current measurement
+static pulse_sample_t pulse_ring[PULSE_RING_LEN]; ///< Parsed samples waiting to be processed
+static uint8_t pulse_ring_head = 0;        ///< Oldest sample in pulse_ring
+static uint8_t pulse_ring_count = 0;       ///< Samples in pulse_ring
+static uint32_t pulse_ring_dropped = 0;    ///< Samples overwritten before they were processed
 
+/*
+ * Device profiles. All three sensors run at standard mode for now, each
+ * device can get its own speed here and the bus is only retuned when a
+ * transfer for a device with different settings starts.
+ */
+const i2c_device_profile_t i2c_profile_si7021 = {
+    .addr = SI7021_ADD, .bus_freq = I2C_FREQ_STANDARD_MAX, .clhr = i2cClockHLRStandard, .timeout_us = 10000 };
+const i2c_device_profile_t i2c_profile_apds9960 = {
+    .addr = APDS9960_DEVICE_ADD, .bus_freq = I2C_FREQ_STANDARD_MAX, .clhr = i2cClockHLRStandard, .timeout_us = 25000 };
+const i2c_device_profile_t i2c_profile_max32664 = {
+    .addr = MAX32664_DEVICE_ADD, .bus_freq = I2C_FREQ_STANDARD_MAX, .clhr = i2cClockHLRStandard, .timeout_us = 10000 };
+
+static bool i2c_initialized = false;                ///< I2C0 set up by Init_i2c()
+static uint32_t i2c_bus_freq;                       ///< Bus frequency currently programmed
+static I2C_ClockHLR_TypeDef i2c_bus_clhr;           ///< Clock low/high ratio currently programmed
+static i2c_stats_t i2c_stats;                       ///< Bus manager counters
+static uint32_t i2c_errors_logged;                  ///< i2c_stats.errors already logged by i2cLogErrors()
+
+static void i2cTimeout(void *arg);
+
+static soft_timer_t i2c_timeout_timer = SOFT_TIMER_INIT(0, i2cTimeout, NULL); ///< Guards the transfer on the bus
+
+/**
+ * @brief Sets up I2C0 once, later calls only count.
+ */
 void Init_i2c()
 {
+  i2c_stats.init_calls++;
+
+  if (i2c_initialized)
+    {
+      return;
+    }
+
   /**
    * @brief Structure to hold I2C initialization configuration
    */
@@ -74,193 +130,1013 @@ void Init_i2c()
   };
   // Initialize I2C
   I2CSPM_Init(&I2C_Config);
+
+  // LDMA for burst reads
+  CMU_ClockEnable(cmuClock_LDMA, true);
+  NVIC_ClearPendingIRQ(LDMA_IRQn);
+  NVIC_EnableIRQ(LDMA_IRQn);
+
+  i2c_bus_freq    = I2C_FREQ_STANDARD_MAX;
+  i2c_bus_clhr    = i2cClockHLRStandard;
+  i2c_initialized = true;
+  i2c_stats.inits++;
 }
 
 /**
- * @brief Initializes the I2C peripheral and performs a read operation.
- *        This function reads data from a sensor connected via I2C.
+ * @brief Programs the bus speed of a device if it differs from the current one.
  */
-void i2c_Read()
+static void i2cApplyProfile(const i2c_device_profile_t *device)
 {
-  I2C_TransferReturn_TypeDef transferStatus;
-  // Initialize I2C
-      Init_i2c();
+  if ((device->bus_freq == i2c_bus_freq) && (device->clhr == i2c_bus_clhr))
+    {
+      return;
+    }
+
+  I2C_BusFreqSet(I2C0, 0, device->bus_freq, device->clhr);
 
-      // Setup read sequence
-      transfer_sequence.addr = SI7021_ADD << 1; // Set I2C address (shifted left by 1 to include read/write bit)
-      transfer_sequence.flags = I2C_FLAG_READ;  // Set read flag
-      transfer_sequence.buf[0].data = &data_read[0]; // Set data buffer for read
-      transfer_sequence.buf[0].len = sizeof(data_read); // Set length of data to read
+  i2c_bus_freq = device->bus_freq;
+  i2c_bus_clhr = device->clhr;
+  i2c_stats.reconfigs++;
+}
 
-      // Enable I2C interrupt
-      NVIC_EnableIRQ(I2C0_IRQn);
+/**
+ * @brief Returns the bus manager counters.
+ */
+const i2c_stats_t * i2cGetStats(void)
+{
+  return (&i2c_stats);
+}
 
-      // Initialize I2C transfer
-      transferStatus = I2C_TransferInit(I2C0, &transfer_sequence);
+/**
+ * @brief Logs the bus manager counters.
+ */
+void i2cLogStats(void)
+{
+  LOG_INFO("I2C init calls=%lu inits=%lu reconfigs=%lu timeouts=%lu errors=%lu\n\r",
+           (unsigned long)i2c_stats.init_calls,
+           (unsigned long)i2c_stats.inits,
+           (unsigned long)i2c_stats.reconfigs,
+           (unsigned long)i2c_stats.timeouts,
+           (unsigned long)i2c_stats.errors);
+}
 
-      // Check transfer status
-      if (transferStatus < 0) {
-          LOG_ERROR("I2C_TransferInit %d read: failed\n\r", (uint32_t)transferStatus);
-      }
+/**
+ * @brief Logs the transfers that failed since the last call, called on Evt_I2CError.
+ */
+void i2cLogErrors(void)
+{
+  uint32_t errors;
+  uint16_t addr;
+  I2C_TransferReturn_TypeDef status;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  errors            = i2c_stats.errors - i2c_errors_logged;
+  i2c_errors_logged = i2c_stats.errors;
+  addr              = i2c_stats.last_error_addr;
+  status            = i2c_stats.last_error_status;
+  CORE_EXIT_CRITICAL();
+
+  if (errors != 0)
+    {
+      LOG_ERROR("I2C %lu transfer(s) failed, last to 0x%02x status %d\n\r",
+                (unsigned long)errors, (unsigned int)addr, (int)status);
+    }
 }
+
+/*
+ * Asynchronous I2C engine.
+ *
+ * Transfers are copied into a fixed-size FIFO of descriptors. The one at the
+ * head is on the bus, driven by I2C_Transfer() from I2C0_IRQHandler(). When it
+ * finishes its callback runs, its event bit is raised and the next one starts.
+ * EM1 is required while the queue is not empty so the I2C clock keeps running.
+ */
+
+static i2c_transfer_t i2c_queue[I2C_QUEUE_DEPTH]; ///< Pending transfers, head is on the bus
+static uint8_t i2c_queue_head;                    ///< Index of the active transfer
+static uint8_t i2c_queue_count;                   ///< Number of queued transfers
+static I2C_TransferSeq_TypeDef i2c_active_seq;    ///< emlib sequence of the active transfer
+
+static void i2cStartNext(void);
+static void i2cDmaStop(void);
+static I2C_TransferReturn_TypeDef i2cDmaStart(const i2c_transfer_t *xfer);
+static I2C_TransferReturn_TypeDef i2cDmaHandleIRQ(const i2c_transfer_t *xfer);
+
 /**
- * @brief Initializes the I2C peripheral and performs a write operation.
- *        This function writes data to a sensor connected via I2C.
+ * @brief Finishes the active transfer and starts the next one. Called with interrupts disabled.
  */
-void i2c_Write()
+static void i2cComplete(I2C_TransferReturn_TypeDef status)
 {
-  I2C_TransferReturn_TypeDef transferStatus;
+  i2c_transfer_t done = i2c_queue[i2c_queue_head];
 
-     // Initialize I2C
-     Init_i2c();
+  timerStop(&i2c_timeout_timer);
 
-     data_write = 0xF3; // Initialize data to be written
+  if (done.dma)
+    {
+      i2cDmaStop();
+    }
 
-     // Setup write sequence
-     transfer_sequence.addr = SI7021_ADD << 1; // Set I2C address (shifted left by 1 to include read/write bit)
-     transfer_sequence.flags = I2C_FLAG_WRITE; // Set write flag
-     transfer_sequence.buf[0].data = &data_write; // Set data buffer for write
-     transfer_sequence.buf[0].len = sizeof(data_write); // Set length of data to write
+  i2c_queue_head = (i2c_queue_head + 1) % I2C_QUEUE_DEPTH;
+  i2c_queue_count--;
 
-     // Enable I2C interrupt
-     NVIC_EnableIRQ(I2C0_IRQn);
+  // no logging in interrupt context, i2cLogErrors() reports it from the main loop
+  if (status != i2cTransferDone)
+    {
+      i2c_stats.errors++;
+      i2c_stats.last_error_addr   = done.device->addr;
+      i2c_stats.last_error_status = status;
+      schedulerSetEvent(Evt_I2CError);
+    }
+
+  if (done.callback != NULL)
+    {
+      done.callback(status, done.arg);
+    }
 
-     // Initialize I2C transfer
-     transferStatus = I2C_TransferInit(I2C0, &transfer_sequence);
+  if (done.event != 0)
+    {
+      schedulerSetEvent(done.event);
+    }
 
-     // Check transfer status
-     if (transferStatus < 0) {
-         LOG_ERROR("I2C_TransferInit status %d write: failed\n\r", (uint32_t)transferStatus);
-     }
+  i2cStartNext();
 }
 
-uint32_t writeAdd_readData(uint8_t reg,uint8_t *data)
+/**
+ * @brief Puts the transfer at the head of the queue on the bus. Called with interrupts disabled.
+ */
+static void i2cStartNext(void)
 {
-  uint8_t command_data[1];
-  I2C_TransferReturn_TypeDef transferStatus;
-  Init_i2c();
+  i2c_transfer_t *xfer;
+  I2C_TransferReturn_TypeDef status;
+
+  if (i2c_queue_count == 0)
+    {
+      NVIC_DisableIRQ(I2C0_IRQn);
+      sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+      return;
+    }
+
+  xfer = &i2c_queue[i2c_queue_head];
+
+  i2cApplyProfile(xfer->device);
+
+  i2c_active_seq.addr        = (uint16_t)(xfer->device->addr << 1);
+  i2c_active_seq.flags       = xfer->flags;
+  i2c_active_seq.buf[0].data = xfer->buf0;
+  i2c_active_seq.buf[0].len  = xfer->len0;
+  i2c_active_seq.buf[1].data = xfer->buf1;
+  i2c_active_seq.buf[1].len  = xfer->len1;
+
+  NVIC_ClearPendingIRQ(I2C0_IRQn);
+  NVIC_EnableIRQ(I2C0_IRQn);
+
+  if (xfer->dma)
+    {
+      status = i2cDmaStart(xfer);
+    }
+  else
+    {
+      status = I2C_TransferInit(I2C0, &i2c_active_seq);
+    }
 
-  command_data[0]=reg;
+  if (status != i2cTransferInProgress)
+    {
+      i2cComplete(status);
+    }
+  else
+    {
+      timerStart(&i2c_timeout_timer, xfer->device->timeout_us, false);
+    }
+}
 
-  transfer_sequence.addr=APDS9960_DEVICE_ADD<<1;
-  transfer_sequence.flags = I2C_FLAG_WRITE_READ;
-  transfer_sequence.buf[0].data = command_data;
-  transfer_sequence.buf[0].len = 1;
-  transfer_sequence.buf[1].data = data;
-  transfer_sequence.buf[1].len = 1;
+/**
+ * @brief The transfer on the bus took longer than its device's timeout, abort it.
+ */
+static void i2cTimeout(void *arg)
+{
+  (void)arg;
 
-  //initialize I2C transfer
-  transferStatus = I2CSPM_Transfer(I2C0, &transfer_sequence);
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
 
-  //check transfer function return status
-  if(transferStatus != i2cTransferDone)
+  if (i2c_queue_count != 0)
     {
-     LOG_ERROR("I2CSPM_Transfer status %d writeAdd_readData: failed\n\r", (uint32_t)transferStatus);
-     return (uint32_t)transferStatus;
+      i2c_stats.timeouts++;
+      I2C0->CMD = I2C_CMD_ABORT;
+      i2cComplete(i2cTransferSwFault);
     }
 
- return (uint32_t)1;
+  CORE_EXIT_CRITICAL();
 }
 
-uint32_t writeAdd_writeData(uint8_t reg,uint8_t data)
+/**
+ * @brief Queues a transfer.
+ */
+bool i2cSubmit(const i2c_transfer_t *xfer)
 {
-  uint8_t command_data[2];
-  uint8_t  no_add_data[1];
-  I2C_TransferReturn_TypeDef transferStatus;
-  Init_i2c();
+  bool queued = false;
 
-  command_data[0]=reg;
-  command_data[1]=data;
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
 
-  transfer_sequence.addr=APDS9960_DEVICE_ADD<<1;
-  transfer_sequence.flags = I2C_FLAG_WRITE;
-  transfer_sequence.buf[0].data = command_data;
-  transfer_sequence.buf[0].len = 2;
-  transfer_sequence.buf[1].data = no_add_data;
-  transfer_sequence.buf[1].len = 0;
+  if (i2c_queue_count < I2C_QUEUE_DEPTH)
+    {
+      i2c_queue[(i2c_queue_head + i2c_queue_count) % I2C_QUEUE_DEPTH] = *xfer;
+      i2c_queue_count++;
+      queued = true;
 
-  //initialize I2C transfer
-   transferStatus = I2CSPM_Transfer(I2C0, &transfer_sequence);
+      // bus was idle, start this one
+      if (i2c_queue_count == 1)
+        {
+          sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+          i2cStartNext();
+        }
+    }
+
+  CORE_EXIT_CRITICAL();
 
-  //check transfer function return status
-  if(transferStatus != i2cTransferDone)
+  if (!queued)
     {
-     LOG_ERROR("I2CSPM_Transfer status %d writeAdd_writeData: failed\n\r", (uint32_t)transferStatus);
-     return (uint32_t)transferStatus;
+      LOG_ERROR("I2C queue full, transfer to 0x%02x dropped\n\r", (unsigned int)xfer->device->addr);
     }
 
- return (uint32_t)1;
+  return queued;
 }
 
-int read_block_data(uint8_t reg,uint8_t *data,uint8_t len)
+/**
+ * @brief Stores the result of a transfer in the I2C_TransferReturn_TypeDef pointed to by arg.
+ */
+static void i2cStoreStatus(I2C_TransferReturn_TypeDef status, void *arg)
 {
-  I2C_TransferReturn_TypeDef transferStatus;
-  uint8_t command_data[1];
-  Init_i2c();
-  transfer_sequence.addr=APDS9960_DEVICE_ADD<<1;
-  transfer_sequence.flags = I2C_FLAG_WRITE_READ;
-  command_data[0]=reg;
-  transfer_sequence.buf[0].data = command_data;
-  transfer_sequence.buf[0].len = 1;
-  transfer_sequence.buf[1].data = data;
-  transfer_sequence.buf[1].len = len;
+  *(volatile I2C_TransferReturn_TypeDef *)arg = status;
+}
 
-  //initialize I2C transfer
-   transferStatus = I2CSPM_Transfer(I2C0, &transfer_sequence);
+static uint8_t i2c_table_buf[I2C_REG_TABLE_BUF_LEN];   ///< Bursts of the table batch on the bus
+static volatile uint8_t i2c_table_pending;             ///< Bursts of the batch not finished yet
+static I2C_TransferReturn_TypeDef i2c_table_result;    ///< First error of the batch
+static uint32_t i2c_table_event;                       ///< Raised when the batch is done
+static volatile I2C_TransferReturn_TypeDef *i2c_table_status; ///< Result of the batch for the caller
 
-    //check transfer function return status
-    if(transferStatus != i2cTransferDone)
-      {
-       LOG_ERROR("I2CSPM_Transfer status %d read_block_data: failed\n\r", (uint32_t)transferStatus);
-       return (int)transferStatus;
-      }
+/**
+ * @brief One burst of a register table batch finished. The last one reports the batch.
+ *        Called from interrupt context.
+ */
+static void i2cRegTableBurstDone(I2C_TransferReturn_TypeDef status, void *arg)
+{
+  (void)arg;
 
-   return (int)len;
+  if ((status != i2cTransferDone) && (i2c_table_result == i2cTransferDone))
+    {
+      i2c_table_result = status;
+    }
 
+  if (--i2c_table_pending == 0)
+    {
+      *i2c_table_status = i2c_table_result;
+      schedulerSetEvent(i2c_table_event);
+    }
 }
 
-void I2C_read_polled_pulse()
+/**
+ * @brief Queues a register table as a batch of auto-increment bursts.
+ *
+ * Every burst is packed into i2c_table_buf as [reg, value, value, ...]. The batch
+ * takes what fits into the buffer and I2C_REG_TABLE_MAX_BURSTS bursts, and is only
+ * queued when the queue has room for all of them, so the bursts go out back to back
+ * from the I2C interrupt and nothing is left half queued.
+ */
+size_t i2cWriteRegTableAsync(const i2c_device_profile_t *device,
+                             const i2c_reg_value_t *table, size_t count,
+                             uint32_t event, volatile I2C_TransferReturn_TypeDef *status)
 {
-  I2C_TransferReturn_TypeDef transferStatus;
-  Init_i2c();
-  transfer_sequence.addr=MAX32664_DEVICE_ADD<<1;
-  transfer_sequence.flags = I2C_FLAG_READ;
-  transfer_sequence.buf[0].data =pulse_data ;
-  transfer_sequence.buf[0].len = sizeof(pulse_data);
+  uint16_t start[I2C_REG_TABLE_MAX_BURSTS];
+  uint16_t len[I2C_REG_TABLE_MAX_BURSTS];
+  uint16_t pos = 0;
+  uint8_t bursts = 0;
+  size_t i = 0;
+  size_t run;
+  bool queued = false;
+
+  // the batch owns i2c_table_buf until its last burst is done
+  if ((i2c_table_pending != 0) || (count == 0))
+    {
+      return 0;
+    }
 
-  //initialize I2C transfer
-   transferStatus = I2CSPM_Transfer(I2C0, &transfer_sequence);
+  while ((i < count) && (bursts < I2C_REG_TABLE_MAX_BURSTS))
+    {
+      // consecutive registers go into one burst
+      run = 1;
+      while ((i + run < count) &&
+             (table[i + run].reg == (uint8_t)(table[i].reg + run)) &&
+             (run + 1 < I2C_REG_TABLE_BUF_LEN))
+        {
+          run++;
+        }
+
+      if (pos + run + 1 > I2C_REG_TABLE_BUF_LEN)
+        {
+          break;
+        }
+
+      start[bursts] = pos;
+      len[bursts]   = (uint16_t)(run + 1);
+      i2c_table_buf[pos++] = table[i].reg;
+      for (size_t k = 0; k < run; k++)
+        {
+          i2c_table_buf[pos++] = table[i + k].value;
+        }
+      bursts++;
+      i += run;
+    }
 
-     //check transfer function return status
-  if(transferStatus < 0 )
-       {
-       LOG_ERROR("I2CSPM_Transfer status %d I2C_read_polled_pulse: failed\n\r", (uint32_t)transferStatus);
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
 
-       }
+  // the bursts cannot finish before the last one is queued, interrupts are masked
+  if (I2C_QUEUE_DEPTH - i2c_queue_count >= bursts)
+    {
+      i2c_table_pending = bursts;
+      i2c_table_result  = i2cTransferDone;
+      i2c_table_event   = event;
+      i2c_table_status  = status;
+      *status           = i2cTransferInProgress;
+
+      for (uint8_t b = 0; b < bursts; b++)
+        {
+          i2c_transfer_t xfer = {
+              .device   = device,
+              .flags    = I2C_FLAG_WRITE,
+              .buf0     = &i2c_table_buf[start[b]],
+              .len0     = len[b],
+              .callback = i2cRegTableBurstDone,
+          };
+
+          i2cSubmit(&xfer);
+        }
+      queued = true;
+    }
+
+  CORE_EXIT_CRITICAL();
+
+  if (!queued)
+    {
+      LOG_ERROR("I2C queue full, register table to 0x%02x not queued\n\r", (unsigned int)device->addr);
+      return 0;
+    }
+
+  return i;
+}
+
+/**
+ * @brief Returns true while transfers are queued or on the bus.
+ */
+bool i2cIsBusy(void)
+{
+  return (i2c_queue_count != 0);
+}
+
+/**
+ * @brief Advances the active transfer, called from I2C0_IRQHandler().
+ */
+void i2cHandleIRQ(void)
+{
+  I2C_TransferReturn_TypeDef status;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+
+  if ((i2c_queue_count != 0) && i2c_queue[i2c_queue_head].dma)
+    {
+      status = i2cDmaHandleIRQ(&i2c_queue[i2c_queue_head]);
+    }
+  else
+    {
+      status = I2C_Transfer(I2C0);
+    }
+
+  if ((status != i2cTransferInProgress) && (i2c_queue_count != 0))
+    {
+      i2cComplete(status);
+    }
+
+  CORE_EXIT_CRITICAL();
+}
+
+/*
+ * LDMA receive path.
+ *
+ * emlib's I2C_Transfer() moves every byte in the I2C interrupt. For transfers
+ * marked dma the address and register phases are still run from the I2C
+ * interrupt, then I2C0 acknowledges received bytes by itself (AUTOACK) and
+ * LDMA copies all but the last byte from RXDATA to the buffer. The last byte
+ * is read in the I2C interrupt so it can be NACKed before the STOP.
+ * Buffers are used as in I2C_TransferSeq_TypeDef: a READ receives into buf0,
+ * a WRITE_READ sends the register byte from buf0 and receives into buf1.
+ * Every transfer, also one NACKed by the device, ends with a STOP and only
+ * completes once MSTOP shows the bus is free again.
+ * The LDMA registers are programmed directly, there is no em_ldma in this project.
+ */
+
+/** Phases of a DMA transfer */
+typedef enum {
+  I2C_DMA_IDLE,        /**< No DMA transfer on the bus */
+  I2C_DMA_ADDR_W,      /**< Address + W sent, waiting for ACK */
+  I2C_DMA_REG,         /**< Register byte sent, waiting for ACK */
+  I2C_DMA_ADDR_R,      /**< Repeated start + address + R sent, waiting for ACK */
+  I2C_DMA_DATA,        /**< LDMA copying all but the last byte */
+  I2C_DMA_LAST,        /**< Waiting for the last byte */
+  I2C_DMA_STOP,        /**< NACK + STOP sent, waiting for MSTOP */
+} i2c_dma_phase_t;
+
+static i2c_dma_phase_t i2c_dma_phase = I2C_DMA_IDLE;  ///< Phase of the DMA transfer on the bus
+static I2C_TransferReturn_TypeDef i2c_dma_result;     ///< Result reported once MSTOP is seen
+
+#define I2C_DMA_IRQS (I2C_IEN_ACK | I2C_IEN_NACK | I2C_IEN_ARBLOST | I2C_IEN_BUSERR | I2C_IEN_MSTOP)
+
+/**
+ * @brief Lets the LDMA channel copy count bytes from I2C0 RXDATA to dst.
+ */
+static void i2cDmaStartChannel(uint8_t *dst, uint16_t count)
+{
+  LDMA_CH_TypeDef *ch = &LDMA->CH[I2C_LDMA_CHANNEL];
+
+  ch->REQSEL = LDMA_CH_REQSEL_SOURCESEL_I2C0 | LDMA_CH_REQSEL_SIGSEL_I2C0RXDATAV;
+  ch->CFG    = 0;
+  ch->LOOP   = 0;
+  ch->CTRL   = (((uint32_t)(count - 1) << _LDMA_CH_CTRL_XFERCNT_SHIFT) & _LDMA_CH_CTRL_XFERCNT_MASK)
+               | LDMA_CH_CTRL_BLOCKSIZE_UNIT1
+               | LDMA_CH_CTRL_REQMODE_BLOCK
+               | LDMA_CH_CTRL_DONEIFSEN
+               | LDMA_CH_CTRL_SRCINC_NONE
+               | LDMA_CH_CTRL_SIZE_BYTE
+               | LDMA_CH_CTRL_DSTINC_ONE;
+  ch->SRC    = (uint32_t)&I2C0->RXDATA;
+  ch->DST    = (uint32_t)dst;
+  ch->LINK   = 0;
+
+  LDMA->IFC     = (1UL << I2C_LDMA_CHANNEL);
+  LDMA->IEN    |= (1UL << I2C_LDMA_CHANNEL);
+  LDMA->CHDONE &= ~(1UL << I2C_LDMA_CHANNEL);
+  LDMA->CHEN   |= (1UL << I2C_LDMA_CHANNEL);
 }
 
-void I2C_write_polled_pulse(uint8_t* cmd,int arr_length)
+/**
+ * @brief Stops the LDMA channel and puts I2C0 back in the state emlib expects.
+ */
+static void i2cDmaStop(void)
 {
-  I2C_TransferReturn_TypeDef transferStatus;
-  Init_i2c();
-  transfer_sequence.addr=MAX32664_DEVICE_ADD<<1;
-  transfer_sequence.flags = I2C_FLAG_WRITE;
-  transfer_sequence.buf[0].data = cmd;
-  transfer_sequence.buf[0].len = arr_length;
+  LDMA->CHEN &= ~(1UL << I2C_LDMA_CHANNEL);
+  LDMA->IEN  &= ~(1UL << I2C_LDMA_CHANNEL);
+  LDMA->IFC   = (1UL << I2C_LDMA_CHANNEL);
 
+  I2C0->CTRL &= ~I2C_CTRL_AUTOACK;
+  I2C_IntDisable(I2C0, I2C_DMA_IRQS | I2C_IEN_RXDATAV);
+  I2C_IntClear(I2C0, _I2C_IF_MASK);
 
-  //initialize I2C transfer
-   transferStatus = I2CSPM_Transfer(I2C0, &transfer_sequence);
+  i2c_dma_phase = I2C_DMA_IDLE;
+}
 
-     //check transfer function return status
-  if(transferStatus < 0)
-       {
-        LOG_ERROR("I2CSPM_Transfer status %d I2C_write_polled_pulse: failed\n\r", (uint32_t)transferStatus);
+/**
+ * @brief Returns the receive buffer of a DMA transfer and its length, buf0 of a READ, buf1 of a WRITE_READ.
+ */
+static uint8_t *i2cDmaRxBuf(const i2c_transfer_t *xfer, uint16_t *len)
+{
+  if (xfer->flags == I2C_FLAG_READ)
+    {
+      *len = xfer->len0;
+      return xfer->buf0;
+    }
 
-       }
+  *len = xfer->len1;
+  return xfer->buf1;
+}
 
+/**
+ * @brief Sends STOP, the transfer completes with result once MSTOP is seen.
+ */
+static void i2cDmaSendStop(I2C_TransferReturn_TypeDef result)
+{
+  I2C0->CMD      = I2C_CMD_STOP;
+  i2c_dma_result = result;
+  i2c_dma_phase  = I2C_DMA_STOP;
 }
 
+/**
+ * @brief Starts the address phase of a DMA transfer.
+ */
+static I2C_TransferReturn_TypeDef i2cDmaStart(const i2c_transfer_t *xfer)
+{
+  uint16_t rx_len;
+
+  // the bus must be idle, as I2C_TransferInit() requires
+  if (I2C0->STATE & I2C_STATE_BUSY)
+    {
+      I2C0->CMD = I2C_CMD_ABORT;
+    }
+
+  if (((xfer->flags != I2C_FLAG_WRITE_READ) && (xfer->flags != I2C_FLAG_READ)) ||
+      ((xfer->flags == I2C_FLAG_WRITE_READ) && (xfer->len0 != 1)) ||
+      (i2cDmaRxBuf(xfer, &rx_len) == NULL) || (rx_len == 0))
+    {
+      return i2cTransferUsageFault;
+    }
+
+  I2C0->CMD = I2C_CMD_CLEARPC | I2C_CMD_CLEARTX;
+  if (I2C0->IF & I2C_IF_RXDATAV)
+    {
+      (void)I2C0->RXDATA;
+    }
+  I2C_IntClear(I2C0, _I2C_IF_MASK);
+  I2C_IntEnable(I2C0, I2C_DMA_IRQS);
+
+  if (xfer->flags == I2C_FLAG_WRITE_READ)
+    {
+      I2C0->TXDATA  = (uint32_t)(xfer->device->addr << 1);
+      i2c_dma_phase = I2C_DMA_ADDR_W;
+    }
+  else
+    {
+      I2C0->TXDATA  = (uint32_t)((xfer->device->addr << 1) | 1);
+      i2c_dma_phase = I2C_DMA_ADDR_R;
+    }
+  I2C0->CMD = I2C_CMD_START;
+
+  return i2cTransferInProgress;
+}
+
+/**
+ * @brief Advances a DMA transfer from the I2C interrupt. Returns i2cTransferInProgress until it is over.
+ */
+static I2C_TransferReturn_TypeDef i2cDmaHandleIRQ(const i2c_transfer_t *xfer)
+{
+  uint32_t flags = I2C_IntGetEnabled(I2C0);
+  uint16_t rx_len;
+  uint8_t *rx_buf = i2cDmaRxBuf(xfer, &rx_len);
+
+  I2C_IntClear(I2C0, flags);
+
+  if (flags & I2C_IF_ARBLOST)
+    {
+      return i2cTransferArbLost;
+    }
+  if (flags & I2C_IF_BUSERR)
+    {
+      return i2cTransferBusErr;
+    }
+  if ((flags & I2C_IF_NACK) && (i2c_dma_phase != I2C_DMA_STOP))
+    {
+      // address or register not acknowledged, release the bus before reporting it
+      I2C_IntDisable(I2C0, I2C_IEN_ACK | I2C_IEN_RXDATAV);
+      i2cDmaSendStop(i2cTransferNack);
+      return i2cTransferInProgress;
+    }
+
+  switch (i2c_dma_phase)
+    {
+      case I2C_DMA_ADDR_W:
+        if (flags & I2C_IF_ACK)
+          {
+            I2C0->TXDATA  = xfer->buf0[0];
+            i2c_dma_phase = I2C_DMA_REG;
+          }
+        break;
+
+      case I2C_DMA_REG:
+        if (flags & I2C_IF_ACK)
+          {
+            I2C0->CMD     = I2C_CMD_START;
+            I2C0->TXDATA  = (uint32_t)((xfer->device->addr << 1) | 1);
+            i2c_dma_phase = I2C_DMA_ADDR_R;
+          }
+        break;
+
+      case I2C_DMA_ADDR_R:
+        if (flags & I2C_IF_ACK)
+          {
+            I2C_IntDisable(I2C0, I2C_IEN_ACK);
+            if (rx_len > 1)
+              {
+                I2C0->CTRL |= I2C_CTRL_AUTOACK;
+                i2cDmaStartChannel(rx_buf, rx_len - 1);
+                i2c_dma_phase = I2C_DMA_DATA;
+              }
+            else
+              {
+                I2C_IntEnable(I2C0, I2C_IEN_RXDATAV);
+                i2c_dma_phase = I2C_DMA_LAST;
+              }
+          }
+        break;
+
+      case I2C_DMA_LAST:
+        if (flags & I2C_IF_RXDATAV)
+          {
+            rx_buf[rx_len - 1] = (uint8_t)I2C0->RXDATA;
+            I2C_IntDisable(I2C0, I2C_IEN_RXDATAV);
+            I2C0->CMD = I2C_CMD_NACK;
+            i2cDmaSendStop(i2cTransferDone);
+          }
+        break;
+
+      case I2C_DMA_STOP:
+        if (flags & I2C_IF_MSTOP)
+          {
+            return i2c_dma_result;
+          }
+        break;
+
+      default:
+        break;
+    }
+
+  return i2cTransferInProgress;
+}
+
+/**
+ * @brief LDMA copied all but the last byte, stop acknowledging and wait for the last one.
+ */
+void i2cHandleLdmaIRQ(void)
+{
+  uint32_t pending;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+
+  pending   = LDMA->IF & LDMA->IEN;
+  LDMA->IFC = pending;
+
+  if (pending & LDMA_IF_ERROR)
+    {
+      if ((i2c_dma_phase != I2C_DMA_IDLE) && (i2c_queue_count != 0))
+        {
+          I2C0->CMD = I2C_CMD_ABORT;
+          i2cComplete(i2cTransferSwFault);
+        }
+    }
+  else if ((pending & (1UL << I2C_LDMA_CHANNEL)) && (i2c_dma_phase == I2C_DMA_DATA))
+    {
+      // the last byte must be NACKed, it is read from the I2C interrupt
+      I2C0->CTRL &= ~I2C_CTRL_AUTOACK;
+      I2C_IntEnable(I2C0, I2C_IEN_RXDATAV);
+      i2c_dma_phase = I2C_DMA_LAST;
+    }
+
+  CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Queues a read of the Si7021 humidity result, raises I2C_COMPLETE when done.
+ *        This function reads data from a sensor connected via I2C.
+ */
+void i2c_Read()
+{
+  i2c_transfer_t xfer = {
+      .device = &i2c_profile_si7021,
+      .flags  = I2C_FLAG_READ,            // Set read flag
+      .buf0   = &humidity_read[0],        // Set data buffer for read
+      .len0   = sizeof(humidity_read),    // Set length of data to read
+      .event  = I2C_COMPLETE,
+      .callback = i2cStoreStatus,         // a NACK means the conversion is still running
+      .arg    = (void *)&si7021_read_status,
+  };
+
+  si7021_read_status = i2cTransferInProgress;
+  i2cSubmit(&xfer);
+}
+
+bool i2c_ReadNacked()
+{
+  return (si7021_read_status == i2cTransferNack);
+}
+
+/**
+ * @brief The user register was read, fills in the write queued behind the read.
+ *        Called from interrupt context before the write goes on the bus.
+ */
+static void si7021_user_reg_read_done(I2C_TransferReturn_TypeDef status, void *arg)
+{
+  uint8_t user_reg = si7021_user_reg;
+
+  (void)arg;
+
+  // the write cannot be taken back any more, it writes the reserved bits' power-up default
+  if(status != i2cTransferDone)
+    {
+      si7021_res_status = status;
+      user_reg = SI7021_USER_REG_DEFAULT;
+    }
+
+  si7021_user_reg_write[1] = (user_reg & ~SI7021_USER_REG_RES_MASK) | si7021_user_reg_res;
+}
+
+/**
+ * @brief The user register was written, a failed read stays the result.
+ */
+static void si7021_user_reg_write_done(I2C_TransferReturn_TypeDef status, void *arg)
+{
+  (void)arg;
+
+  if(si7021_res_status == i2cTransferInProgress)
+    {
+      si7021_res_status = status;
+    }
+}
+
+bool I2C_si7021_set_resolution(si7021_resolution_t res)
+{
+  i2c_transfer_t read = {
+      .device   = &i2c_profile_si7021,
+      .flags    = I2C_FLAG_WRITE_READ,
+      .buf0     = &si7021_user_reg_read,
+      .len0     = 1,
+      .buf1     = &si7021_user_reg,
+      .len1     = 1,
+      .callback = si7021_user_reg_read_done,
+  };
+  i2c_transfer_t write = {
+      .device   = &i2c_profile_si7021,
+      .flags    = I2C_FLAG_WRITE,
+      .buf0     = si7021_user_reg_write,
+      .len0     = sizeof(si7021_user_reg_write),
+      .callback = si7021_user_reg_write_done,
+  };
+
+  // the reserved bits of the user register must be written back unchanged, both
+  // transfers are queued now and the read's callback completes the write
+  si7021_user_reg_res      = (uint8_t)res;
+  si7021_user_reg_write[0] = SI7021_CMD_WRITE_USER_REG;
+  si7021_res_status        = i2cTransferInProgress;
+
+  if(!i2cSubmit(&read))
+    {
+      si7021_res_status = i2cTransferUsageFault;
+      return false;
+    }
+  if(!i2cSubmit(&write))
+    {
+      si7021_res_status = i2cTransferUsageFault;
+      return false;
+    }
+
+  return true;
+}
+
+I2C_TransferReturn_TypeDef I2C_si7021_resolution_status()
+{
+  return si7021_res_status;
+}
+
+/**
+ * @brief Queues a read of the temperature the Si7021 measured during the last humidity
+ *        conversion (command 0xE0), no second conversion is started. Raises I2C_COMPLETE.
+ */
+void i2c_ReadTempFromRH()
+{
+  i2c_transfer_t xfer = {
+      .device = &i2c_profile_si7021,
+      .flags  = I2C_FLAG_WRITE_READ,
+      .buf0   = &temp_from_rh_cmd,
+      .len0   = 1,
+      .buf1   = &data_read[0],
+      .len1   = sizeof(data_read),
+      .event  = I2C_COMPLETE,
+  };
+
+  i2cSubmit(&xfer);
+}
+
+/**
+ * @brief Queues the Si7021 measure humidity command, raises I2C_COMPLETE when done.
+ *        The sensor also measures temperature as part of the humidity conversion.
+ *        This function writes data to a sensor connected via I2C.
+ */
+void i2c_Write()
+{
+  i2c_transfer_t xfer = {
+      .device = &i2c_profile_si7021,
+      .flags  = I2C_FLAG_WRITE,           // Set write flag
+      .buf0   = &data_write,              // Set data buffer for write
+      .len0   = sizeof(data_write),       // Set length of data to write
+      .event  = I2C_COMPLETE,
+  };
+
+  data_write = SI7021_CMD_MEASURE_RH; // Initialize data to be written
+
+  i2cSubmit(&xfer);
+}
+
+/**
+ * @brief Queues a burst read of APDS9960 registers starting at reg, copied by LDMA.
+ */
+bool read_block_data_async(uint8_t reg,uint8_t *data,uint8_t len,uint32_t event,
+                           volatile I2C_TransferReturn_TypeDef *status)
+{
+  static uint8_t command_data[I2C_QUEUE_DEPTH];  // must outlive the call, one per queue slot
+  static uint8_t command_next;
+  uint8_t *command = &command_data[command_next];
+  i2c_transfer_t xfer = {
+      .device   = &i2c_profile_apds9960,
+      .flags    = I2C_FLAG_WRITE_READ,
+      .buf0     = command,
+      .len0     = 1,
+      .buf1     = data,
+      .len1     = len,
+      .dma      = true,
+      .event    = event,
+      .callback = i2cStoreStatus,
+      .arg      = (void *)status,
+  };
+
+  // several burst reads can be queued at once, each keeps its own register byte
+  command_next = (command_next + 1) % I2C_QUEUE_DEPTH;
+  *command = reg;
+  *status = i2cTransferInProgress;
+
+  return i2cSubmit(&xfer);
+}
+
+/**
+ * @brief Completion of a sensor hub transfer, checks the status byte of reads if asked to.
+ */
+static void pulse_transfer_done(I2C_TransferReturn_TypeDef status, void *arg)
+{
+  if((status == i2cTransferDone) && (arg != NULL))
+    {
+      check_read_return();
+    }
+
+  // the oximeter state machine starts its next wait once the bus is done with the sensor hub
+  pulse_pending--;
+  if(pulse_pending == 0)
+    {
+      schedulerSetEvent(Evt_OximeterI2C);
+    }
+}
+
+void I2C_read_pulse(uint8_t len, uint32_t event, bool check_return)
+{
+  if((len == 0) || (len > sizeof(pulse_data)))
+    {
+      len = sizeof(pulse_data);
+    }
+
+  i2c_transfer_t xfer = {
+      .device   = &i2c_profile_max32664,
+      .flags    = I2C_FLAG_READ,
+      .buf0     = pulse_data,
+      .len0     = len,
+      .event    = event,
+      .callback = pulse_transfer_done,
+      .arg      = check_return ? (void *)pulse_data : NULL,
+  };
+
+  pulse_pending++;
+  if(!i2cSubmit(&xfer))
+    {
+      pulse_pending--;
+    }
+}
+
+void I2C_write_pulse(const uint8_t* cmd,int arr_length)
+{
+  i2c_transfer_t xfer = {
+      .device   = &i2c_profile_max32664,
+      .flags    = I2C_FLAG_WRITE,
+      .buf0     = (uint8_t *)cmd,
+      .len0     = (uint16_t)arr_length,
+      .callback = pulse_transfer_done,
+  };
+
+  pulse_pending++;
+  if(!i2cSubmit(&xfer))
+    {
+      pulse_pending--;
+    }
+}
+
+/**
+ * @brief Returns the number of samples the hub reported in its FIFO.
+ *        Valid after the response to the numSamplesOutFifo command was read into pulse_data.
+ */
+uint8_t I2C_pulse_fifo_level()
+{
+  if(pulse_data[0] != 0x00)
+    {
+      return 0;
+    }
+
+  return pulse_data[1];
+}
+
+/**
+ * @brief Queues one burst read of count samples from the hub output FIFO.
+ *        The hub answers the read_fill_array command with a status byte followed
+ *        by count records of MAX32664_SAMPLE_LEN bytes.
+ */
+void I2C_read_pulse_samples(uint8_t count, uint32_t event)
+{
+  if(count > MAX32664_FIFO_MAX_SAMPLES)
+    {
+      count = MAX32664_FIFO_MAX_SAMPLES;
+    }
+  pulse_fifo_count = count;
+  pulse_fifo_reads++;
+
+  // up to 97 bytes, LDMA copies them instead of one I2C interrupt per byte
+  i2c_transfer_t xfer = {
+      .device   = &i2c_profile_max32664,
+      .flags    = I2C_FLAG_READ,
+      .buf0     = pulse_fifo_data,
+      .len0     = (uint16_t)(1 + count * MAX32664_SAMPLE_LEN),
+      .dma      = true,
+      .event    = event,
+      .callback = pulse_transfer_done,
+      .arg      = NULL,
+  };
+
+  pulse_pending++;
+  if(!i2cSubmit(&xfer))
+    {
+      pulse_pending--;
+      pulse_fifo_count = 0;
+    }
+}
+
+/**
+ * @brief Adds a sample to the ring, the oldest one is dropped when it is full.
+ */
+static void pulse_ring_push(const pulse_sample_t *sample)
+{
+  if(pulse_ring_count == PULSE_RING_LEN)
+    {
+      pulse_ring_head = (pulse_ring_head + 1) % PULSE_RING_LEN;
+      pulse_ring_count--;
+      pulse_ring_dropped++;
+    }
+
+  pulse_ring[(pulse_ring_head + pulse_ring_count) % PULSE_RING_LEN] = *sample;
+  pulse_ring_count++;
+}
+
+/**
+ * @brief Takes the oldest sample out of the ring.
+ * @return False if the ring is empty.
+ */
+bool pulse_ring_pop(pulse_sample_t *sample)
+{
+  if(pulse_ring_count == 0)
+    {
+      return false;
+    }
+
+  *sample = pulse_ring[pulse_ring_head];
+  pulse_ring_head = (pulse_ring_head + 1) % PULSE_RING_LEN;
+  pulse_ring_count--;
+
+  return true;
+}
+
+/**
+ * @brief Parses the records of the last I2C_read_pulse_samples() into the sample ring.
+ * @return Number of samples added.
+ */
+uint8_t pulse_samples_parse()
+{
+  pulse_sample_t sample;
+  const uint8_t *rec;
+  uint8_t n;
+
+  if(pulse_fifo_data[0] != 0x00)
+    {
+      LOG_ERROR("MAX32664 FIFO read status 0x%02x\n\r", (unsigned int)pulse_fifo_data[0]);
+      pulse_fifo_count = 0;
+      return 0;
+    }
+
+  sample.time_us = timerGetMicroseconds();
+  for(n = 0; n < pulse_fifo_count; n++)
+    {
+      rec = &pulse_fifo_data[1 + n * MAX32664_SAMPLE_LEN];
+      sample.heart_rate = ((uint16_t)rec[0] << 8) | rec[1];
+      sample.confidence = rec[2];
+      sample.o2         = ((uint16_t)rec[3] << 8) | rec[4];
+      sample.status     = rec[5];
+      pulse_ring_push(&sample);
+    }
+  pulse_fifo_count = 0;
+
+  return n;
+}
+
+/**
+ * @brief Returns the number of sensor hub transfers not finished yet.
+ */
+uint32_t I2C_pulse_pending()
+{
+  return pulse_pending;
+}
 
 void check_read_return()
 {
@@ -272,89 +1148,266 @@ void check_read_return()
   }
 }
 
+/**
+ * @brief Returns the status byte of the last sensor hub response.
+ */
+uint8_t I2C_pulse_status()
+{
+  return pulse_data[0];
+}
+
+/**
+ * @brief Returns true if the last sensor hub response reported success.
+ */
+bool I2C_pulse_status_ok()
+{
+  return (pulse_data[0] == 0x00);
+}
+
+
 #if DEVICE_IS_BLE_SERVER
 
-int pulse_data_extract()
+/**
+ * @brief Clears the sample collection of a measurement, called when a session starts.
+ */
+void pulse_data_reset()
+{
+  i = 0;
+  pulse_fifo_reads = 0;
+  pulse_ring_count = 0;
+  pulse_agg_reset(&pulse_agg);
+}
+
+/**
+ * @brief Processes one algorithm sample. Finger-detected samples with enough confidence
+ *        are aggregated until the readings agree or PULSE_AGG_MAX_SAMPLES are collected.
+ * @return 1 once the result was sent, 0 otherwise.
+ */
+static int pulse_sample_process(const pulse_sample_t *sample)
 {
   // Get pointer to BLE data structure
    ble_data_struct_t *bleData = getBleDataPtr();
-   status=pulse_data[6];
+   pulse_agg_status_t agg_status;
+   uint16_t hr_result;
+   uint16_t o2_result;
 
-   if(status==3)
-     {
-       displayPrintf(DISPLAY_ROW_ACTION, "Do not move the finger!");
-       displayPrintf(DISPLAY_ROW_TEMPVALUE, "Loading: %d", (10 - i));
-       heart_rate[i] = ((uint16_t)(pulse_data[1])) << 8;
-       heart_rate[i] |= pulse_data[2];
-       heart_rate[i] = heart_rate[i]/10;
+   status=sample->status;
 
-       confidence = pulse_data[3];
+   if(status!=3)
+     {
+    //   LOG_INFO("Please place the finger correctly!!\n\n\r");
 
-       o2[i] = ((uint16_t)(pulse_data[4])) << 8;
-       o2[i] |= pulse_data[5];
-       o2[i] = o2[i]/10;
+       displayPrintf(DISPLAY_ROW_ACTION,"Place finger!");
+       return 0;
+     }
 
-       LOG_INFO("heart_rate = %d\n\r", heart_rate[i]);
-       LOG_INFO("confidence = %d\n\r", confidence);
-       LOG_INFO("o2 level = %d\n\r", o2[i]);
-       LOG_INFO("status = %d\n\n\r", status);
+   confidence = sample->confidence;
 
-       i++;
-     }
-   else
+   agg_status = pulse_agg_add(&pulse_agg, sample->heart_rate/10, sample->o2/10, confidence);
+   if(agg_status == PULSE_AGG_REJECTED)
      {
-    //   LOG_INFO("Please place the finger correctly!!\n\n\r");
+       displayPrintf(DISPLAY_ROW_ACTION, "Hold still, low confidence");
+       return 0;
+     }
 
-       displayPrintf(DISPLAY_ROW_ACTION,"Place finger!");
-   }
+   displayPrintf(DISPLAY_ROW_ACTION, "Do not move the finger!");
+   displayPrintf(DISPLAY_ROW_TEMPVALUE, "Loading: %d", (PULSE_AGG_MAX_SAMPLES - 1 - i));
+   heart_rate[i] = sample->heart_rate/10;
+   o2[i] = sample->o2/10;
+   sample_time_us[i] = sample->time_us;
+
+   LOG_INFO("heart_rate = %d\n\r", heart_rate[i]);
+   LOG_INFO("confidence = %d\n\r", confidence);
+   LOG_INFO("o2 level = %d\n\r", o2[i]);
+   LOG_INFO("status = %d\n\n\r", status);
+
+   i++;
 
-  if(i==10)
+  if(agg_status == PULSE_AGG_MORE)
     {
-      max_heart_rate= heart_rate[0];
-      max_o2= o2[0];
+      return 0;
+    }
 
-      for(int a=0;a<i;a++)
-        {
-         if(max_heart_rate < heart_rate[a])
-           {
-             max_heart_rate = (uint8_t)heart_rate[a];
-         }
+  // median of the accepted samples, a single artefact cannot move it
+  pulse_agg_result(&pulse_agg, &hr_result, &o2_result);
+  result_heart_rate = (uint8_t)hr_result;
+  result_o2 = (uint8_t)o2_result;
+
+  LOG_INFO("***************************************FINAL VALUES**********************************************\n\r");
+  LOG_INFO("heart_rate = %d\n\r", result_heart_rate);
+  LOG_INFO("oxygen level = %d\n\r", result_o2);
+  LOG_INFO("%d samples (%s, %d low confidence) in %lu ms, %lu FIFO reads, %lu dropped\n\r",
+           i, (agg_status == PULSE_AGG_STABLE) ? "stable" : "full", pulse_agg.rejected,
+           (unsigned long)((sample_time_us[i - 1] - sample_time_us[0]) / 1000),
+           (unsigned long)pulse_fifo_reads,
+           (unsigned long)pulse_ring_dropped);
+
+  displayPrintf(DISPLAY_ROW_8, "");
+
+  if(bleData->gesture_value==0x01){
+      send_max30101_data[0] = result_o2;
+      send_max30101_data[1] = 0;
+      displayPrintf(DISPLAY_ROW_TEMPVALUE, "Oxygen level: %d",result_o2);
+  }
+  if(bleData->gesture_value==0x02){
+      send_max30101_data[0] = result_heart_rate;
+      send_max30101_data[1] = 0;
+      displayPrintf(DISPLAY_ROW_TEMPVALUE, "Heart rate: %d",result_heart_rate);
+  }
+
+  ble_SendPulseState(send_max30101_data);
+
+  pulse_data_reset();
+
+  return 1;
+}
+
+int pulse_data_extract()
+{
+  pulse_sample_t sample;
 
-         if(max_o2 < o2[a]){
-             max_o2 = (uint8_t)o2[a];
-         }
+  // move the records of the last FIFO read into the ring, then work through all of them
+  pulse_samples_parse();
 
+  while(pulse_ring_pop(&sample))
+    {
+      if(pulse_sample_process(&sample))
+        {
+          // enough samples, the rest of this batch is not needed
+          pulse_ring_count = 0;
+          return 1;
+        }
     }
-      LOG_INFO("***************************************FINAL VALUES**********************************************\n\r");
-      LOG_INFO("heart_rate = %d\n\r", max_heart_rate);
-      LOG_INFO("oxygen level = %d\n\r", max_o2);
 
-      displayPrintf(DISPLAY_ROW_8, "");
+  return 0;
+}
+
+/*
+ * Continuous streaming.
+ *
+ * Finger-detected samples go into a sliding window of the last PULSE_STREAM_WINDOW
+ * samples. Every PULSE_STREAM_REPORT_EVERY new samples the trimmed mean of the
+ * window is sent as [SpO2, heart rate] on the oximeter characteristic. Samples
+ * below PULSE_AGG_MIN_CONFIDENCE never enter the window.
+ */
+static uint16_t stream_hr[PULSE_STREAM_WINDOW];     ///< Heart rate window, bpm
+static uint16_t stream_o2[PULSE_STREAM_WINDOW];     ///< SpO2 window, %
+static uint8_t stream_next = 0;                     ///< Slot the next sample goes into
+static uint8_t stream_fill = 0;                     ///< Samples in the window
+static uint8_t stream_new = 0;                      ///< Samples since the last report
+static uint64_t stream_oldest_us = 0;               ///< time_us of the oldest unreported sample
+static pulse_stream_stats_t stream_stats;
 
-      if(bleData->gesture_value==0x01){
-          send_max30101_data[0] = max_o2;
-          send_max30101_data[1] = 0;
-          displayPrintf(DISPLAY_ROW_TEMPVALUE, "Oxygen level: %d",max_o2);
-      }
-      if(bleData->gesture_value==0x02){
-          send_max30101_data[0] = max_heart_rate;
-          send_max30101_data[1] = 0;
-          displayPrintf(DISPLAY_ROW_TEMPVALUE, "Heart rate: %d",max_heart_rate);
-      }
+/**
+ * @brief Empties the window and clears the counters, called when streaming starts.
+ */
+void pulse_stream_reset()
+{
+  stream_next = 0;
+  stream_fill = 0;
+  stream_new = 0;
+  pulse_ring_count = 0;
+  memset(&stream_stats, 0, sizeof(stream_stats));
+  stream_stats.start_us = timerGetMicroseconds();
+}
 
-      ble_SendPulseState(send_max30101_data);
+/**
+ * @brief Sends the window's trimmed mean as [SpO2, heart rate], the top and bottom
+ *        quarter of the window are dropped so a motion spike does not show up.
+ */
+static void pulse_stream_report()
+{
+  uint32_t latency_us;
 
+  send_max30101_data[0] = (uint8_t)pulse_agg_trimmed_mean(stream_o2, stream_fill, stream_fill / 4);
+  send_max30101_data[1] = (uint8_t)pulse_agg_trimmed_mean(stream_hr, stream_fill, stream_fill / 4);
+  displayPrintf(DISPLAY_ROW_TEMPVALUE, "HR %d SpO2 %d", send_max30101_data[1], send_max30101_data[0]);
+  ble_SendPulseState(send_max30101_data);
 
+  // the oldest sample of the report waited the longest for it
+  latency_us = (uint32_t)(timerGetMicroseconds() - stream_oldest_us);
+  if(latency_us > stream_stats.latency_max_us)
+    {
+      stream_stats.latency_max_us = latency_us;
+    }
+  stream_stats.latency_sum_us += latency_us;
+  stream_stats.reports++;
+  stream_stats.samples_reported += stream_new;
+  stream_new = 0;
 }
-  if(i==10)
+
+int pulse_stream_extract()
+{
+  pulse_sample_t sample;
+  int reports = 0;
+
+  stream_stats.samples_in += pulse_samples_parse();
+
+  while(pulse_ring_pop(&sample))
     {
-      i=0;
-    return 1;
-  }
-  else
+      if(sample.status != 3)
+        {
+          displayPrintf(DISPLAY_ROW_ACTION,"Place finger!");
+          continue;
+        }
+      if(sample.confidence < PULSE_AGG_MIN_CONFIDENCE)
+        {
+          displayPrintf(DISPLAY_ROW_ACTION, "Hold still, low confidence");
+          continue;
+        }
+      displayPrintf(DISPLAY_ROW_ACTION, "Streaming");
+
+      stream_hr[stream_next] = sample.heart_rate/10;
+      stream_o2[stream_next] = sample.o2/10;
+      stream_next = (stream_next + 1) % PULSE_STREAM_WINDOW;
+      if(stream_fill < PULSE_STREAM_WINDOW)
+        {
+          stream_fill++;
+        }
+      if(stream_new == 0)
+        {
+          stream_oldest_us = sample.time_us;
+        }
+      stream_new++;
+      stream_stats.samples_valid++;
+
+      if(stream_new == PULSE_STREAM_REPORT_EVERY)
+        {
+          pulse_stream_report();
+          reports++;
+        }
+    }
+
+  return reports;
+}
+
+const pulse_stream_stats_t * pulse_stream_get_stats()
+{
+  return &stream_stats;
+}
+
+void pulse_stream_log_stats()
+{
+  uint64_t elapsed_ms = (timerGetMicroseconds() - stream_stats.start_us) / 1000;
+
+  if(elapsed_ms == 0)
     {
-    return 0;
-  }
+      elapsed_ms = 1;
+    }
+
+  LOG_INFO("Stream %lu ms: samples in=%lu valid=%lu reported=%lu, %lu reports\n\r",
+           (unsigned long)elapsed_ms,
+           (unsigned long)stream_stats.samples_in,
+           (unsigned long)stream_stats.samples_valid,
+           (unsigned long)stream_stats.samples_reported,
+           (unsigned long)stream_stats.reports);
+  LOG_INFO("Stream rate in=%lu.%03lu/s out=%lu.%03lu/s, latency avg=%lu us max=%lu us\n\r",
+           (unsigned long)((uint64_t)stream_stats.samples_in * 1000 / elapsed_ms),
+           (unsigned long)(((uint64_t)stream_stats.samples_in * 1000000 / elapsed_ms) % 1000),
+           (unsigned long)((uint64_t)stream_stats.samples_reported * 1000 / elapsed_ms),
+           (unsigned long)(((uint64_t)stream_stats.samples_reported * 1000000 / elapsed_ms) % 1000),
+           (unsigned long)(stream_stats.reports ? (stream_stats.latency_sum_us / stream_stats.reports) : 0),
+           (unsigned long)stream_stats.latency_max_us);
 }
 
 #endif
@@ -364,16 +1417,23 @@ int pulse_data_extract()
  * @brief Converts raw temperature data to Celsius.
  * @return Temperature in Celsius.
  */
-int32_t ConvertTempToCelcius()
+int32_t ConvertTempToMilliCelsius()
 {
-    int16_t Celcius; // Variable to hold temperature in Celsius
-    int32_t Temp; // Variable to hold raw temperature data
+    uint16_t code; // Raw temperature code
+
+    code = ((uint16_t)data_read[0] << 8) | data_read[1]; // Combine MSB and LSB
+    code &= SI7021_CODE_MASK; // Drop the status bits
 
-    Temp = (data_read[0] << 8) + data_read[1]; // Combine MSB and LSB
+    return si7021_code_to_millicelsius(code);
+}
+
+int32_t ConvertHumidityToMilliRH()
+{
+    uint16_t code; // Raw humidity code
 
-    Celcius = (175.72 * Temp) / 65536; // Perform temperature conversion
-    Celcius -= 46.85; // Apply offset
+    code = ((uint16_t)humidity_read[0] << 8) | humidity_read[1]; // Combine MSB and LSB
+    code &= SI7021_CODE_MASK; // Drop the status bits
 
-    return Celcius; // Return temperature in Celsius
+    return si7021_code_to_millirh(code);
 }
 
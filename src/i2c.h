@@ -9,45 +9,340 @@
 #define SRC_I2C_H_
 
 #include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "em_i2c.h"
+#include "src/si7021.h"
+
+/** Number of transfers that can wait for the bus */
+#define I2C_QUEUE_DEPTH (8)
+
+/** LDMA channel used for burst reads, no other LDMA user in this project */
+#define I2C_LDMA_CHANNEL (0)
+
+/** Bytes available to pack the bursts of one register table batch */
+#define I2C_REG_TABLE_BUF_LEN (64)
+
+/** Most bursts of one register table batch, the rest of the queue stays free for the other sensors */
+#define I2C_REG_TABLE_MAX_BURSTS (I2C_QUEUE_DEPTH / 2)
+
+/**
+ * @brief Bus settings of one device, applied by the bus manager when a transfer
+ *        for the device starts and the bus is set up differently.
+ */
+typedef struct {
+  uint16_t addr;                /**< 7-bit device address */
+  uint32_t bus_freq;            /**< Max bus frequency, e.g. I2C_FREQ_STANDARD_MAX */
+  I2C_ClockHLR_TypeDef clhr;    /**< Clock low/high ratio matching bus_freq */
+  uint32_t timeout_us;          /**< A transfer taking longer is aborted */
+} i2c_device_profile_t;
+
+extern const i2c_device_profile_t i2c_profile_si7021;    /**< Temperature sensor */
+extern const i2c_device_profile_t i2c_profile_apds9960;  /**< Gesture sensor */
+extern const i2c_device_profile_t i2c_profile_max32664;  /**< Pulse oximeter sensor hub */
+
+/**
+ * @brief Bus manager counters.
+ */
+typedef struct {
+  uint32_t init_calls;   /**< Calls to Init_i2c() */
+  uint32_t inits;        /**< Times I2C0 was actually set up */
+  uint32_t reconfigs;    /**< Bus speed changes between device profiles */
+  uint32_t timeouts;     /**< Transfers aborted after the profile timeout */
+  uint32_t errors;       /**< Transfers that finished with an error, including timeouts */
+  uint16_t last_error_addr;                      /**< Device address of the last failed transfer */
+  I2C_TransferReturn_TypeDef last_error_status;  /**< Status of the last failed transfer */
+} i2c_stats_t;
+
+/**
+ * @brief One entry of a register initialization table, tables are meant to be const.
+ */
+typedef struct {
+  uint8_t reg;      /**< Register address */
+  uint8_t value;    /**< Value written to it */
+} i2c_reg_value_t;
+
+/** Bytes of one algorithm record in the hub output FIFO: HR(2) confidence(1) SpO2(2) status(1) */
+#define MAX32664_SAMPLE_LEN (6)
+
+/** Most samples read from the hub FIFO in one burst */
+#define MAX32664_FIFO_MAX_SAMPLES (16)
+
+/** Parsed samples kept until the oximeter state machine processes them */
+#define PULSE_RING_LEN (16)
+
+/**
+ * @brief One algorithm sample of the MAX32664 sensor hub.
+ */
+typedef struct {
+  uint16_t heart_rate;   /**< LSB = 0.1 bpm */
+  uint8_t confidence;    /**< 0-100 % */
+  uint16_t o2;           /**< LSB = 0.1 % */
+  uint8_t status;        /**< 0 success, 1 not ready, 2 object detected, 3 finger detected */
+  uint64_t time_us;      /**< timerGetMicroseconds() when the FIFO read was parsed */
+} pulse_sample_t;
+
+/** Finger-detected samples averaged for one streaming result */
+#define PULSE_STREAM_WINDOW (16)
+
+/** A streaming result is sent every this many new finger-detected samples */
+#define PULSE_STREAM_REPORT_EVERY (8)
+
+/**
+ * @brief Streaming throughput and latency counters.
+ */
+typedef struct {
+  uint64_t start_us;          /**< timerGetMicroseconds() when streaming started */
+  uint32_t samples_in;        /**< Samples read from the hub FIFO */
+  uint32_t samples_valid;     /**< Samples with a finger detected, entered the window */
+  uint32_t samples_reported;  /**< Valid samples covered by a sent result */
+  uint32_t reports;           /**< Results sent */
+  uint32_t latency_max_us;    /**< Longest time from reading a sample to sending its result */
+  uint64_t latency_sum_us;    /**< Sum over all results of the oldest sample's latency */
+} pulse_stream_stats_t;
+
+/**
+ * @brief Called from interrupt context when a queued transfer finishes.
+ * @param status i2cTransferDone or the emlib error code.
+ * @param arg Argument given in the descriptor.
+ */
+typedef void (*i2c_callback_t)(I2C_TransferReturn_TypeDef status, void *arg);
+
+/**
+ * @brief Descriptor of one queued I2C transfer.
+ *
+ * Buffers are used as in I2C_TransferSeq_TypeDef, also with dma: a READ receives
+ * into buf0, a WRITE_READ writes buf0 and receives into buf1. They must stay valid
+ * until the transfer finishes. The descriptor itself is copied into the queue.
+ */
+typedef struct {
+  const i2c_device_profile_t *device; /**< Target device */
+  uint16_t flags;            /**< I2C_FLAG_READ, I2C_FLAG_WRITE, I2C_FLAG_WRITE_READ, ... */
+  uint8_t *buf0;             /**< First buffer */
+  uint16_t len0;             /**< Length of the first buffer */
+  uint8_t *buf1;             /**< Second buffer, for WRITE_READ / WRITE_WRITE, unused by READ */
+  uint16_t len1;             /**< Length of the second buffer */
+  uint32_t event;            /**< Scheduler event bit(s) raised when finished, 0 for none */
+  bool dma;                  /**< Copy received bytes with LDMA. READ into buf0, or WRITE_READ with one register byte in buf0 */
+  i2c_callback_t callback;   /**< Called when finished, may be NULL */
+  void *arg;                 /**< Argument passed to callback */
+} i2c_transfer_t;
+
+/**
+ * @brief Queues an I2C transfer. Returns immediately, the transfer runs from I2C0_IRQHandler().
+ *        When it finishes, successful or not, the callback is called and the event raised.
+ * @param xfer Transfer descriptor, copied.
+ * @return False if the queue is full and the transfer was dropped.
+ */
+bool i2cSubmit(const i2c_transfer_t *xfer);
+
+/**
+ * @brief Queues the start of a table of (register, value) pairs for a device with
+ *        auto-incrementing register addresses. Entries with consecutive registers are
+ *        merged into one burst write. As many entries are taken as fit into one batch,
+ *        the caller queues the rest once the event for this batch has been raised.
+ * @param device Target device.
+ * @param table Register table, entries in the order they are written. Only read
+ *        during the call.
+ * @param count Number of entries.
+ * @param event Event bit(s) raised when the last burst of the batch is done.
+ * @param status Set to i2cTransferDone or the first error code when the batch is done.
+ * @return Number of entries queued, 0 if the queue or the previous batch is still busy.
+ */
+size_t i2cWriteRegTableAsync(const i2c_device_profile_t *device,
+                             const i2c_reg_value_t *table, size_t count,
+                             uint32_t event, volatile I2C_TransferReturn_TypeDef *status);
+
+/**
+ * @brief Returns true while transfers are queued or on the bus.
+ */
+bool i2cIsBusy(void);
+
+/**
+ * @brief Advances the transfer on the bus, called from I2C0_IRQHandler().
+ */
+void i2cHandleIRQ(void);
+
+/**
+ * @brief Handles the end of an LDMA burst, called from LDMA_IRQHandler().
+ */
+void i2cHandleLdmaIRQ(void);
 /**
  * @brief Reads temperature from the sensor via I2C and logs the value.
  */
 //void Read_temp();
 
 /**
- * @brief Initializes the I2C peripheral and sets up write and read sequences.
+ * @brief Initializes the I2C peripheral. Only the first call sets up I2C0, later calls are counted.
  */
 void Init_i2c();
 
 /**
- * @brief Performs an I2C read operation.
+ * @brief Returns the bus manager counters.
+ */
+const i2c_stats_t * i2cGetStats(void);
+
+/**
+ * @brief Logs the bus manager counters.
+ */
+void i2cLogStats(void);
+
+/**
+ * @brief Logs the transfers that failed since the last call. Failures are only recorded
+ *        in interrupt context, which raises Evt_I2CError, this is called on that event.
+ */
+void i2cLogErrors(void);
+
+/**
+ * @brief Queues a read of the Si7021 humidity result, raises I2C_COMPLETE when done.
  */
 void i2c_Read();
 
 /**
- * @brief Performs an I2C write operation.
+ * @brief Queues the Si7021 measure humidity command, raises I2C_COMPLETE when done.
  */
 void i2c_Write();
 
-uint32_t writeAdd_writeData(uint8_t reg,uint8_t data);
+/**
+ * @brief Queues a read of the temperature taken during the last humidity conversion,
+ *        raises I2C_COMPLETE when done.
+ */
+void i2c_ReadTempFromRH();
+
+/**
+ * @brief Returns true if the Si7021 NACKed the last humidity read, its conversion was
+ *        not finished yet and the read has to be repeated.
+ */
+bool i2c_ReadNacked();
+
+/**
+ * @brief Queues a read-modify-write of Si7021 user register 1 to set the measurement
+ *        resolution, no event is raised. Transfers run in queue order, so a measure command
+ *        queued after this one already uses the new resolution.
+ * @param res New resolution.
+ * @return False if the transfers could not be queued.
+ */
+bool I2C_si7021_set_resolution(si7021_resolution_t res);
 
-uint32_t writeAdd_readData(uint8_t reg,uint8_t *data);
+/**
+ * @brief Returns the result of the last I2C_si7021_set_resolution(),
+ *        i2cTransferInProgress until both transfers have finished.
+ */
+I2C_TransferReturn_TypeDef I2C_si7021_resolution_status();
 
-int read_block_data(uint8_t reg,uint8_t *data,uint8_t len);
+/**
+ * @brief Queues a burst read of APDS9960 registers, the bytes are copied by LDMA.
+ * @param reg First register.
+ * @param data Destination, must stay valid until the read is done.
+ * @param len Number of bytes.
+ * @param event Event bit(s) raised when the read is done.
+ * @param status Set to i2cTransferDone or the error code when the read is done.
+ * @return False if the read could not be queued.
+ */
+bool read_block_data_async(uint8_t reg,uint8_t *data,uint8_t len,uint32_t event,
+                           volatile I2C_TransferReturn_TypeDef *status);
 void check_read_return();
-void I2C_write_polled_pulse(uint8_t* cmd,int arr_length);
-void I2C_read_polled_pulse();
+
+/**
+ * @brief Returns the status byte of the last sensor hub response.
+ */
+uint8_t I2C_pulse_status();
+
+/**
+ * @brief Returns true if the last sensor hub response reported success.
+ */
+bool I2C_pulse_status_ok();
+
+/**
+ * @brief Queues a command write to the sensor hub.
+ *        Evt_OximeterI2C is raised when the last queued sensor hub transfer has finished.
+ * @param cmd Command bytes, must stay valid until the write is done.
+ * @param arr_length Number of bytes.
+ */
+void I2C_write_pulse(const uint8_t* cmd,int arr_length);
+
+/**
+ * @brief Queues a read of the sensor hub response into pulse_data.
+ *        Evt_OximeterI2C is raised when the last queued sensor hub transfer has finished.
+ * @param len Response bytes including the status byte, 0 for all of pulse_data.
+ * @param event Event bit(s) raised when done, 0 for none.
+ * @param check_return True to run check_read_return() on the status byte when done.
+ */
+void I2C_read_pulse(uint8_t len, uint32_t event, bool check_return);
+
+/**
+ * @brief Returns the number of samples the hub reported in its FIFO, 0 on a bad status.
+ */
+uint8_t I2C_pulse_fifo_level();
+
+/**
+ * @brief Queues one burst read of count samples from the hub output FIFO.
+ *        Evt_OximeterI2C is raised when the last queued sensor hub transfer has finished.
+ * @param count Samples to read, at most MAX32664_FIFO_MAX_SAMPLES.
+ * @param event Event bit(s) raised when done, 0 for none.
+ */
+void I2C_read_pulse_samples(uint8_t count, uint32_t event);
+
+/**
+ * @brief Parses the records of the last I2C_read_pulse_samples() into the sample ring.
+ * @return Number of samples added.
+ */
+uint8_t pulse_samples_parse();
+
+/**
+ * @brief Takes the oldest sample out of the ring.
+ * @return False if the ring is empty.
+ */
+bool pulse_ring_pop(pulse_sample_t *sample);
+
+/**
+ * @brief Returns the number of sensor hub transfers not finished yet.
+ */
+uint32_t I2C_pulse_pending();
 
 //uint32_t writeAdd_readData_MAX(uint8_t reg,uint8_t *data);
 
 //uint32_t writeAdd_writeData_MAX(uint8_t reg,uint8_t data);
 
+/**
+ * @brief Clears the samples of a single measurement, called when a session starts.
+ */
+void pulse_data_reset();
+
 int pulse_data_extract();
 
 /**
- * @brief Converts raw temperature data to Celsius.
- * @return Temperature in Celsius.
+ * @brief Empties the streaming window and clears the streaming counters.
+ */
+void pulse_stream_reset();
+
+/**
+ * @brief Moves the last FIFO read into the streaming window and sends the window
+ *        average every PULSE_STREAM_REPORT_EVERY finger-detected samples.
+ * @return Number of results sent.
+ */
+int pulse_stream_extract();
+
+/**
+ * @brief Returns the streaming counters.
+ */
+const pulse_stream_stats_t * pulse_stream_get_stats();
+
+/**
+ * @brief Logs samples in/out per second and the sample-to-report latency.
+ */
+void pulse_stream_log_stats();
+
+/**
+ * @brief Converts the last temperature read to milli-degrees Celsius, integer only.
+ * @return Temperature in milli-degrees Celsius.
+ */
+int32_t ConvertTempToMilliCelsius();
+
+/**
+ * @brief Converts the last humidity read to milli-percent relative humidity, integer only.
+ * @return Relative humidity in milli-percent.
  */
-int32_t ConvertTempToCelcius();
+int32_t ConvertHumidityToMilliRH();
 
 #endif /* SRC_I2C_H_ */
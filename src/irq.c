@@ -16,6 +16,8 @@
 #include "src/gpio.h"             // Include the general-purpose I/O (GPIO) header file
 #include "src/scheduler.h"
 #include "src/timers.h"
+#include "src/i2c.h"
+#include "src/pulse_oximeter.h"
 #include "src/oscillators.h"
 #include "em_i2c.h"
 #include "app.h"
@@ -43,70 +45,62 @@
  */
 void LETIMER0_IRQHandler(void)
 {
-  ble_data_struct_t *bleData = getBleDataPtr();
-
   // Get the enabled interrupt flags
       uint32_t flag = LETIMER_IntGetEnabled(LETIMER0);
 
       // Clear the interrupt flags
       LETIMER_IntClear(LETIMER0, flag);
 
-      // Check if the COMP1 (bit 1) interrupt flag is set
-      if (LETIMER_IF_COMP1)
+      // Check if the UF (bit 2) interrupt flag is set, counted first so the
+      // timer service sees the new period
+      if (flag & LETIMER_IF_UF)
         {
-          // Disable COMP1 interrupt
-          LETIMER_IntDisable(LETIMER0, LETIMER_IEN_COMP1);
-          // Set an event for the scheduler
-          schedulerSetEventCOMP1();
-      }
+          // Count the period and expire timers due in it
+          timerHandleUF();
 
-      // Check if the UF (bit 2) interrupt flag is set
-      if (LETIMER_IF_UF)
-        {
           // Set an event for the scheduler
           schedulerSetEventUF();
+      }
 
-          bleData->rollover_cnt+=1;
+      // Check if the COMP1 (bit 1) interrupt flag is set
+      if (flag & LETIMER_IF_COMP1)
+        {
+          // Expire due software timers and reprogram COMP1 for the next deadline
+          timerHandleCOMP1();
       }
 }
 
+/**
+ * @brief Interrupt handler for the LDMA, ends I2C burst reads.
+ */
+void LDMA_IRQHandler(void)
+{
+  i2cHandleLdmaIRQ();
+}
+
 /**
  * @brief Interrupt handler for I2C0 peripheral.
  *        Handles I2C transfer completion.
  */
 void I2C0_IRQHandler(void)
 {
-  // Perform I2C transfer and get transfer status
-      I2C_TransferReturn_TypeDef Trans_Status = I2C_Transfer(I2C0);
-
-      // Check if the transfer is done successfully
-      if (Trans_Status == i2cTransferDone)
-        {
-          // Disable I2C0 interrupt
-          NVIC_DisableIRQ(I2C0_IRQn);
-          // Set an event for the scheduler
-          schedulerSetEventI2Ccomplete();
-      }
-
-      // Check if there was an error during I2C transfer
-      if (Trans_Status < 0)
-        {
-          // Log the error
-          LOG_ERROR("I2C_TransferStatus %d : failed\n\r", (uint32_t)Trans_Status);
-      }
+  // Advance the queued transfer on the bus, completion events are raised by the I2C engine
+  i2cHandleIRQ();
 }
 
 void GPIO_EVEN_IRQHandler(void)
 {
   ble_data_struct_t *bleData = getBleDataPtr();
 
-  uint32_t flag=GPIO_IntGetEnabled();
+  // only take the even pins, the odd ones belong to GPIO_ODD_IRQHandler()
+  uint32_t flag=GPIO_IntGetEnabled() & 0x55555555;
 
   GPIO_IntClear(flag);
 
   uint8_t button_status = GPIO_PinInGet(BUTTON_PORT,PB0_BUTTON_PIN);
 
-  if(flag==64)
+  // test each pin's bit, several pins can be pending in one interrupt
+  if(flag & (1 << PB0_BUTTON_PIN))
   {
      if (button_status == 0)
        {
@@ -127,20 +121,24 @@ void GPIO_ODD_IRQHandler(void)
 {
   ble_data_struct_t *bleData = getBleDataPtr();
 
-  uint32_t flag=GPIO_IntGetEnabled();
+  // only take the odd pins, the even ones belong to GPIO_EVEN_IRQHandler()
+  uint32_t flag=GPIO_IntGetEnabled() & 0xAAAAAAAA;
 
   GPIO_IntClear(flag);
 
 #if DEVICE_IS_BLE_SERVER
 
-  if(flag == 2048)
+  if(flag & (1 << GESTURE_PIN))
     schedulerSetGestureEvent();
 
+  if(flag & (1 << MFIO_INT_NO))
+    schedulerSetEventMfio();
+
 #endif
 
   uint8_t button_status = GPIO_PinInGet(BUTTON_PORT,PB1_BUTTON_PIN);
 
-  if(flag==128)
+  if(flag & (1 << PB1_BUTTON_PIN))
   {
 
      if (button_status == 0)
@@ -164,9 +162,5 @@ void GPIO_ODD_IRQHandler(void)
  */
 uint32_t letimerMilliseconds()
 {
-  uint32_t time_ms;
-  ble_data_struct_t *ble_data;
-  ble_data= getBleDataPtr();
-  time_ms = ((ble_data->rollover_cnt)*3000);
-  return time_ms;
+  return ((uint32_t)(timerGetMicroseconds() / 1000));
 }
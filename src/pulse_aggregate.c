@@ -0,0 +1,127 @@
+/*
+ * pulse_aggregate.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only aggregation of pulse oximeter samples.
+ */
+
+#include "src/pulse_aggregate.h"
+
+/* Largest set of values sorted at once, covers the streaming window too */
+#define PULSE_AGG_SORT_MAX (32)
+
+/**
+ * @brief Copies up to PULSE_AGG_SORT_MAX values into sorted and sorts them ascending.
+ *        Insertion sort, the sets are a few tens of values at most.
+ * @return Number of values sorted.
+ */
+static uint8_t pulse_agg_sort(const uint16_t *values, uint8_t n, uint16_t *sorted)
+{
+  uint8_t k, j;
+  uint16_t v;
+
+  if(n > PULSE_AGG_SORT_MAX){
+      n = PULSE_AGG_SORT_MAX;
+  }
+
+  for(k = 0; k < n; k++){
+      v = values[k];
+      j = k;
+      while((j > 0) && (sorted[j - 1] > v)){
+          sorted[j] = sorted[j - 1];
+          j--;
+      }
+      sorted[j] = v;
+  }
+
+  return n;
+}
+
+/**
+ * @brief Returns true if a and b are at most tolerance apart.
+ */
+static bool pulse_agg_close(uint16_t a, uint16_t b, uint16_t tolerance)
+{
+  return ((a > b) ? (a - b) : (b - a)) <= tolerance;
+}
+
+void pulse_agg_reset(pulse_agg_t *agg)
+{
+  agg->count = 0;
+  agg->stable = 0;
+  agg->rejected = 0;
+}
+
+pulse_agg_status_t pulse_agg_add(pulse_agg_t *agg, uint16_t hr, uint16_t o2, uint8_t confidence)
+{
+  if(confidence < PULSE_AGG_MIN_CONFIDENCE){
+      agg->rejected++;
+      return PULSE_AGG_REJECTED;
+  }
+  if(agg->count == PULSE_AGG_MAX_SAMPLES){
+      return PULSE_AGG_FULL;
+  }
+
+  // a reading agreeing with the one before extends the run, anything else starts a new one
+  if((agg->count > 0) &&
+     pulse_agg_close(hr, agg->hr[agg->count - 1], PULSE_AGG_HR_TOLERANCE) &&
+     pulse_agg_close(o2, agg->o2[agg->count - 1], PULSE_AGG_O2_TOLERANCE)){
+      agg->stable++;
+  }
+  else{
+      agg->stable = 1;
+  }
+
+  agg->hr[agg->count] = hr;
+  agg->o2[agg->count] = o2;
+  agg->count++;
+
+  if(agg->stable >= PULSE_AGG_STABLE_COUNT){
+      return PULSE_AGG_STABLE;
+  }
+  if(agg->count == PULSE_AGG_MAX_SAMPLES){
+      return PULSE_AGG_FULL;
+  }
+
+  return PULSE_AGG_MORE;
+}
+
+void pulse_agg_result(const pulse_agg_t *agg, uint16_t *hr, uint16_t *o2)
+{
+  *hr = pulse_agg_median(agg->hr, agg->count);
+  *o2 = pulse_agg_median(agg->o2, agg->count);
+}
+
+uint16_t pulse_agg_median(const uint16_t *values, uint8_t n)
+{
+  uint16_t sorted[PULSE_AGG_SORT_MAX];
+
+  if(n == 0){
+      return 0;
+  }
+  n = pulse_agg_sort(values, n, sorted);
+
+  return sorted[n / 2];
+}
+
+uint16_t pulse_agg_trimmed_mean(const uint16_t *values, uint8_t n, uint8_t trim)
+{
+  uint16_t sorted[PULSE_AGG_SORT_MAX];
+  uint32_t sum = 0;
+  uint8_t k, used;
+
+  if(n == 0){
+      return 0;
+  }
+  n = pulse_agg_sort(values, n, sorted);
+  if(2 * trim >= n){
+      return sorted[n / 2];
+  }
+
+  used = n - 2 * trim;
+  for(k = trim; k < n - trim; k++){
+      sum += sorted[k];
+  }
+
+  return (uint16_t)((sum + used / 2) / used);
+}
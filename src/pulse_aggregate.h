@@ -0,0 +1,84 @@
+/*
+ * pulse_aggregate.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only aggregation of pulse oximeter samples. Samples are gated on
+ *              the algorithm confidence, the result is a median or a trimmed mean, and a
+ *              measurement can stop early once consecutive readings agree.
+ */
+
+#ifndef SRC_PULSE_AGGREGATE_H_
+#define SRC_PULSE_AGGREGATE_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Most samples one measurement collects */
+#define PULSE_AGG_MAX_SAMPLES (10)
+
+/** Samples below this algorithm confidence (0-100 %) are not used */
+#define PULSE_AGG_MIN_CONFIDENCE (50)
+
+/** The measurement stops once this many consecutive accepted samples agree */
+#define PULSE_AGG_STABLE_COUNT (4)
+
+/** Two heart rate readings agree within this many bpm */
+#define PULSE_AGG_HR_TOLERANCE (3)
+
+/** Two SpO2 readings agree within this many % */
+#define PULSE_AGG_O2_TOLERANCE (1)
+
+/**
+ * @brief Result of adding a sample.
+ */
+typedef enum {
+  PULSE_AGG_REJECTED,   /**< Confidence too low, the sample was not used */
+  PULSE_AGG_MORE,       /**< Sample used, more are needed */
+  PULSE_AGG_STABLE,     /**< Sample used, the last PULSE_AGG_STABLE_COUNT agree */
+  PULSE_AGG_FULL,       /**< Sample used, PULSE_AGG_MAX_SAMPLES collected */
+} pulse_agg_status_t;
+
+/**
+ * @brief Samples of one measurement.
+ */
+typedef struct {
+  uint16_t hr[PULSE_AGG_MAX_SAMPLES];   /**< Accepted heart rates, bpm */
+  uint16_t o2[PULSE_AGG_MAX_SAMPLES];   /**< Accepted SpO2 values, % */
+  uint8_t count;                        /**< Accepted samples */
+  uint8_t stable;                       /**< Consecutive accepted samples agreeing with the one before */
+  uint16_t rejected;                    /**< Samples dropped for low confidence */
+} pulse_agg_t;
+
+/**
+ * @brief Empties an aggregation, called at the start of a measurement.
+ */
+void pulse_agg_reset(pulse_agg_t *agg);
+
+/**
+ * @brief Adds a sample if its confidence is high enough.
+ * @param hr Heart rate in bpm.
+ * @param o2 SpO2 in %.
+ * @param confidence Algorithm confidence in %.
+ * @return What the caller has to do next, see pulse_agg_status_t.
+ */
+pulse_agg_status_t pulse_agg_add(pulse_agg_t *agg, uint16_t hr, uint16_t o2, uint8_t confidence);
+
+/**
+ * @brief Median of the accepted samples. The upper middle value for an even count.
+ * @param hr Set to the heart rate median, 0 without samples.
+ * @param o2 Set to the SpO2 median, 0 without samples.
+ */
+void pulse_agg_result(const pulse_agg_t *agg, uint16_t *hr, uint16_t *o2);
+
+/**
+ * @brief Median of n values, the values are not changed.
+ */
+uint16_t pulse_agg_median(const uint16_t *values, uint8_t n);
+
+/**
+ * @brief Mean of n values without the trim smallest and trim largest ones, rounded.
+ *        Falls back to the median when trimming would leave nothing.
+ */
+uint16_t pulse_agg_trimmed_mean(const uint16_t *values, uint8_t n, uint8_t trim);
+
+#endif /* SRC_PULSE_AGGREGATE_H_ */
@@ -25,23 +25,75 @@
 #include <stdbool.h>
 #include "em_gpio.h"
 #include <string.h>
+#include "src/timers.h"
+#include "src/scheduler.h"
 
 // Include logging for this file
 #define INCLUDE_LOG_DEBUG 1
 #include "src/log.h"
 
-uint8_t set_output_mode[3] = {0x10, 0x00, 0x02};  //set the output mode
-uint8_t setFifoThreshold[3] = {0x10, 0x01, 0x01}; //set threshold fifo, One sample before interrupt is fired.
-uint8_t agcAlgoControl[3] = {0x52, 0x00, 0x01}; // One sample before interrupt is fired.
-uint8_t max30101Control[3] = {0x44, 0x03, 0x01}; //
-uint8_t maximFastAlgoControl[3] = {0x52, 0x02, 0x01}; //
-uint8_t readAlgoSamples[3] = {0x51, 0x00, 0x03};
-uint8_t read_sensor_hub_status[2] = {0x00, 0x00};
-uint8_t numSamplesOutFifo[2] = {0x12, 0x00};
-uint8_t read_fill_array[2] = {0x12, 0x01};
-uint8_t disable_AFE[3] = {0x44, 0x03, 00};
-uint8_t disable_algo[3] = {0x52, 0x02, 0x00};
+/*
+ * Command tables, run by the sequencer below.
+ * Every command is written as [family, index, payload], then after delay_us the
+ * response of resp_len bytes is read and its status byte compared with expected_status.
+ */
 
+/* Full bring-up after the reset pulse and the 1s boot wait */
+static const max32664_cmd_t cold_cmds[] = {
+  // family index  payload     len resp  delay    expected             retries
+  { 0x02,  0x00,  {0x00, 0x00}, 0,  2,   10000,   0x00,                2 },  // read device mode, 0 = application
+  { 0x10,  0x00,  {0x02, 0x00}, 1,  1,   6000,    0x00,                2 },  // output mode: algorithm data
+  { 0x10,  0x01,  {0x01, 0x00}, 1,  1,   106000,  0x00,                2 },  // FIFO threshold: MFIO after one sample
+  { 0x52,  0x00,  {0x01, 0x00}, 1,  1,   106000,  MAX32664_STATUS_ANY, 0 },  // enable AGC algorithm
+  { 0x44,  0x03,  {0x01, 0x00}, 1,  1,   106000,  MAX32664_STATUS_ANY, 0 },  // enable MAX30101 AFE
+  { 0x52,  0x02,  {0x01, 0x00}, 1,  1,   106000,  MAX32664_STATUS_ANY, 0 },  // enable WHRM (MaximFast) algorithm
+  { 0x51,  0x00,  {0x03, 0x00}, 1,  2,   6000,    0x00,                2 },  // read AGC number of samples
+};
+
+/* Restart of a hub still in application mode with output mode and threshold set */
+static const max32664_cmd_t warm_cmds[] = {
+  // family index  payload     len resp  delay    expected             retries
+  { 0x44,  0x03,  {0x01, 0x00}, 1,  1,   106000,  0x00,                0 },  // enable MAX30101 AFE, failure means cold start
+  { 0x52,  0x02,  {0x01, 0x00}, 1,  1,   106000,  MAX32664_STATUS_ANY, 0 },  // enable WHRM (MaximFast) algorithm
+  { 0x51,  0x00,  {0x03, 0x00}, 1,  2,   6000,    0x00,                2 },  // read AGC number of samples
+};
+
+/* Before every FIFO read, the burst read itself follows the last command */
+static const max32664_cmd_t sample_cmds[] = {
+  // family index  payload     len resp  delay    expected             retries
+  { 0x00,  0x00,  {0x00, 0x00}, 0,  2,   6000,    0x00,                1 },  // read sensor hub status
+  { 0x12,  0x00,  {0x00, 0x00}, 0,  2,   6000,    0x00,                1 },  // number of samples in the output FIFO
+  { 0x12,  0x01,  {0x00, 0x00}, 0,  0,   6000,    MAX32664_STATUS_ANY, 0 },  // read output FIFO, response read by the caller
+};
+
+/* End of a session */
+static const max32664_cmd_t shutdown_cmds[] = {
+  // family index  payload     len resp  delay    expected             retries
+  { 0x44,  0x03,  {0x00, 0x00}, 1,  1,   6000,    0x00,                1 },  // disable MAX30101 AFE
+  { 0x52,  0x02,  {0x00, 0x00}, 1,  1,   6000,    0x00,                1 },  // disable WHRM (MaximFast) algorithm
+};
+
+#define SEQ_LEN(cmds) ((uint8_t)(sizeof(cmds) / sizeof((cmds)[0])))
+
+const max32664_seq_t max32664_seq_cold     = { "cold",     cold_cmds,     SEQ_LEN(cold_cmds) };
+const max32664_seq_t max32664_seq_warm     = { "warm",     warm_cmds,     SEQ_LEN(warm_cmds) };
+const max32664_seq_t max32664_seq_sample   = { "sample",   sample_cmds,   SEQ_LEN(sample_cmds) };
+const max32664_seq_t max32664_seq_shutdown = { "shutdown", shutdown_cmds, SEQ_LEN(shutdown_cmds) };
+
+/* Sequencer state */
+typedef enum {
+  SEQ_IDLE,     // no sequence running
+  SEQ_WRITE,    // command on the bus
+  SEQ_DELAY,    // waiting delay_us for the hub to process it
+  SEQ_READ,     // response on the bus
+} seq_phase_t;
+
+static const max32664_seq_t *seq = NULL;          // running sequence
+static uint8_t seq_step = 0;                      // command being run
+static uint8_t seq_attempt = 0;                   // retries used on it
+static seq_phase_t seq_phase = SEQ_IDLE;
+static uint8_t seq_tx[2 + MAX32664_PAYLOAD_MAX];  // command bytes, must outlive the queued write
+static soft_timer_t seq_timer = SOFT_TIMER_INIT(Evt_OximeterSeqTimer, NULL, NULL);  // own bit, a stale oximeter_timer event must not end a delay
 
 void pulse_oximeter_init_pins(){
 
@@ -68,76 +120,115 @@ void turn_on_mfio(){
 
 void set_MFIO_interrupt(){
   GPIO_PinModeSet(MAX30101_port, MFIO_pin, gpioModeInputPull, true);
-  GPIO_ExtIntConfig (MAX30101_port, MFIO_pin, MFIO_pin, false, true, true);
-
-}
-
-void set_output_mode_func(){
-
-  //set_output_mode
-  I2C_write_polled_pulse(set_output_mode, 3);
-}
-
-void setFifoThreshold_func(){
-
-  //set fifo threshold
-  I2C_write_polled_pulse(setFifoThreshold, 3);
-}
-
-void agcAlgoControl_func(){
-
-  //agcAlgoControl
-  I2C_write_polled_pulse(agcAlgoControl, 3);
-
-}
-
-void max30101Control_func(){
+  GPIO_ExtIntConfig (MAX30101_port, MFIO_pin, MFIO_INT_NO, false, true, true);
 
-  //max30101Control
-  I2C_write_polled_pulse(max30101Control, 3);
-
-}
-
-void maximFastAlgoControl_func(){
-
-  // Family Byte: ENABLE_ALGORITHM (0x52), Index Byte:
-  // ENABLE_WHRM_ALGO (0x02)
-  // This function enables (one) or disables (zero) the wrist heart rate monitor
-  // algorithm.
-  I2C_write_polled_pulse(maximFastAlgoControl, 3);
 }
 
-
-void readAlgoSamples_func(){
-
-  // Family Byte: READ_ALGORITHM_CONFIG (0x51), Index Byte:
-  // READ_AGC_NUM_SAMPLES (0x00), Write Byte: READ_AGC_NUM_SAMPLES_ID (0x03)
-  // This function changes the number of samples that are averaged.
-  // It takes a paramater of zero to 255.
-  I2C_write_polled_pulse(readAlgoSamples, 3);
-
+void clear_MFIO_interrupt(){
+  GPIO_IntDisable(1 << MFIO_INT_NO);
+  GPIO_IntClear(1 << MFIO_INT_NO);
 }
 
-void read_sensor_hub_status_func(){
-
-  I2C_write_polled_pulse(read_sensor_hub_status, 2);
+//the hub holds MFIO low while samples wait in its FIFO
+bool mfio_data_ready(){
+  return (GPIO_PinInGet(MAX30101_port, MFIO_pin) == 0);
 }
 
-void numSamplesOutFifo_func(){
-
-  I2C_write_polled_pulse(numSamplesOutFifo,2);
-
-}
-
-void read_fill_array_func(){
+/**
+ * @brief Writes the command of the current step.
+ */
+static void seq_write_step()
+{
+  const max32664_cmd_t *cmd = &seq->cmds[seq_step];
 
-  I2C_write_polled_pulse(read_fill_array, 2);
-}
+  seq_tx[0] = cmd->family;
+  seq_tx[1] = cmd->index;
+  memcpy(&seq_tx[2], cmd->payload, cmd->payload_len);
 
-void disable_AFE_func(){
-  I2C_write_polled_pulse(disable_AFE,3);
+  seq_phase = SEQ_WRITE;
+  I2C_write_pulse(seq_tx, 2 + cmd->payload_len);
 }
 
-void disable_algo_func(){
-  I2C_write_polled_pulse(disable_algo,3);
+/**
+ * @brief Moves to the next command.
+ * @return MAX32664_SEQ_DONE after the last one.
+ */
+static max32664_seq_result_t seq_next_step()
+{
+  seq_step++;
+  seq_attempt = 0;
+
+  if(seq_step == seq->count){
+      seq_phase = SEQ_IDLE;
+      return MAX32664_SEQ_DONE;
+  }
+
+  seq_write_step();
+  return MAX32664_SEQ_RUNNING;
+}
+
+void max32664_seq_start(const max32664_seq_t *sequence)
+{
+  timerStop(&seq_timer);
+  seq = sequence;
+  seq_step = 0;
+  seq_attempt = 0;
+  seq_write_step();
+}
+
+max32664_seq_result_t max32664_seq_handle_event(uint32_t event)
+{
+  const max32664_cmd_t *cmd;
+  uint8_t status;
+
+  if(seq_phase == SEQ_IDLE){
+      return MAX32664_SEQ_DONE;
+  }
+  cmd = &seq->cmds[seq_step];
+
+  switch(seq_phase){
+
+    case SEQ_WRITE:
+      //the delay counts from the end of the write
+      if((event == Evt_OximeterI2C) && (I2C_pulse_pending() == 0)){
+          seq_phase = SEQ_DELAY;
+          timerStart(&seq_timer, cmd->delay_us, false);
+      }
+      break;
+
+    case SEQ_DELAY:
+      if(event == Evt_OximeterSeqTimer){
+          if(cmd->resp_len == 0){
+              return seq_next_step();
+          }
+          seq_phase = SEQ_READ;
+          I2C_read_pulse(cmd->resp_len, 0, false);
+      }
+      break;
+
+    case SEQ_READ:
+      if((event == Evt_OximeterI2C) && (I2C_pulse_pending() == 0)){
+          status = I2C_pulse_status();
+          if((cmd->expected_status == MAX32664_STATUS_ANY) || (status == cmd->expected_status)){
+              return seq_next_step();
+          }
+          if(seq_attempt < cmd->retries){
+              seq_attempt++;
+              LOG_INFO("MAX32664 %s 0x%02x/0x%02x status %d, retry %d\n\r", seq->name,
+                       cmd->family, cmd->index, status, seq_attempt);
+              seq_write_step();
+              break;
+          }
+          LOG_ERROR("MAX32664 %s 0x%02x/0x%02x failed with status %d\n\r", seq->name,
+                    cmd->family, cmd->index, status);
+          seq_phase = SEQ_IDLE;
+          return MAX32664_SEQ_FAILED;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return MAX32664_SEQ_RUNNING;
 }
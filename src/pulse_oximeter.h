@@ -18,6 +18,19 @@
 
 #define RESET_pin 9
 
+/* EXTI line of MFIO. Line 7 belongs to PB1 (pin 7 of port F), pins 4-7 can use lines 4-7,
+ * so MFIO takes line 5 and is served by GPIO_ODD_IRQHandler() */
+#define MFIO_INT_NO 5
+
+/* Most payload bytes of a sensor hub command */
+#define MAX32664_PAYLOAD_MAX 2
+
+/* expected_status of a command whose response is not checked */
+#define MAX32664_STATUS_ANY 0xFF
+
+/* Without a data-ready interrupt for this long the sample is read anyway */
+#define OXIMETER_MFIO_WATCHDOG_US 1500000
+
 void turn_off_reset();
 
 void turn_on_reset();
@@ -28,28 +41,60 @@ void turn_on_mfio();
 
 void set_MFIO_interrupt();
 
-void pulse_oximeter_init_pins();
-
-void set_output_mode_func();
-
-void setFifoThreshold_func();
-
-void agcAlgoControl_func();
-
-void max30101Control_func();
+void clear_MFIO_interrupt();
 
-void maximFastAlgoControl_func();
+bool mfio_data_ready();
 
-void readAlgoSamples_func();
-
-void read_sensor_hub_status_func();
-
-void numSamplesOutFifo_func();
-
-void read_fill_array_func();
+void pulse_oximeter_init_pins();
 
-void disable_AFE_func();
+/**
+ * @brief Sequencer results.
+ */
+typedef enum {
+  MAX32664_SEQ_RUNNING,   /**< Waiting for a transfer or a delay */
+  MAX32664_SEQ_DONE,      /**< Every command answered with the expected status */
+  MAX32664_SEQ_FAILED,    /**< A command kept failing after its retries */
+} max32664_seq_result_t;
+
+/**
+ * @brief One sensor hub command of a sequence table.
+ */
+typedef struct {
+  uint8_t family;                         /**< Family byte */
+  uint8_t index;                          /**< Index byte */
+  uint8_t payload[MAX32664_PAYLOAD_MAX];  /**< Write bytes after family and index */
+  uint8_t payload_len;                    /**< Number of payload bytes used */
+  uint8_t resp_len;                       /**< Response bytes read, status byte included. 0 = no read */
+  uint32_t delay_us;                      /**< Wait between the end of the write and the read */
+  uint8_t expected_status;                /**< Status byte that passes, MAX32664_STATUS_ANY = not checked */
+  uint8_t retries;                        /**< Times the command is sent again on a bad status */
+} max32664_cmd_t;
+
+/**
+ * @brief A const command table.
+ */
+typedef struct {
+  const char *name;              /**< Used in the log */
+  const max32664_cmd_t *cmds;    /**< Commands in the order they are run */
+  uint8_t count;                 /**< Number of commands */
+} max32664_seq_t;
+
+extern const max32664_seq_t max32664_seq_cold;      /**< Configuration after a reset */
+extern const max32664_seq_t max32664_seq_warm;      /**< Re-enables AFE and algorithm of a configured hub */
+extern const max32664_seq_t max32664_seq_sample;    /**< Status, FIFO level and FIFO read command */
+extern const max32664_seq_t max32664_seq_shutdown;  /**< Disables AFE and algorithm */
+
+/**
+ * @brief Starts running a sequence, the first command is written right away.
+ */
+void max32664_seq_start(const max32664_seq_t *sequence);
 
-void disable_algo_func();
+/**
+ * @brief Advances the running sequence, called with every event the oximeter state machine gets.
+ *        Uses Evt_OximeterI2C for the end of its transfers and Evt_OximeterSeqTimer for its delays.
+ * @param event The scheduler event bit.
+ * @return MAX32664_SEQ_RUNNING until the sequence is done or failed.
+ */
+max32664_seq_result_t max32664_seq_handle_event(uint32_t event);
 
 #endif /* SRC_PULSE_OXIMETER_H_ */
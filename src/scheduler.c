@@ -27,85 +27,190 @@
 #include "src/lcd.h"
 #include "src/SparkFun_APDS9960.h"
 #include "src/pulse_oximeter.h"
+#include "src/si7021.h"
 
 
 int Count_PulseData=0;
 
-uint8_t Mode_ReadDevice[2] = {0x02, 0x00};  //send this command to begin the communication with pulse oximeter
 
 sl_status_t rc=0;
 
 uint32_t my_event; ///< Global variable to store the scheduler event
 
+#if DEVICE_IS_BLE_SERVER
+static soft_timer_t temp_timer = SOFT_TIMER_INIT(Evt_TempTimer, NULL, NULL);          ///< Temperature machine timeouts
+static soft_timer_t oximeter_timer = SOFT_TIMER_INIT(Evt_OximeterTimer, NULL, NULL);  ///< Oximeter machine timeouts
+static soft_timer_t gesture_timer = SOFT_TIMER_INIT(Evt_GestureTimer, NULL, NULL);    ///< Gesture FIFO read pauses
+static uint32_t oximeter_mfio_reads = 0;     ///< Samples read on the MFIO data-ready interrupt
+static uint32_t oximeter_watchdog_reads = 0; ///< Samples read because MFIO stayed quiet for OXIMETER_MFIO_WATCHDOG_US
+static bool oximeter_streaming = false;           ///< Continuous mode, started by a NEAR gesture
+static bool oximeter_hub_configured = false;      ///< Hub is in application mode with output mode and threshold set
+static bool oximeter_warm = false;                ///< The running session skipped the reset and configuration
+static uint64_t oximeter_bringup_start_us = 0;    ///< Start of the running session, for the bring-up time
+static volatile bool oximeter_stream_stop = false; ///< Set when the client or a gesture ends streaming
+static uint32_t gesture_int_wakeups = 0;         ///< FIFO drains started by an APDS batch interrupt
+static uint32_t gesture_timer_wakeups = 0;       ///< FIFO drains started by the fallback timer
+static uint32_t gestures_read = 0;               ///< Gesture reads that ran to a result
+static si7021_resolution_t temp_resolution = SI7021_RESOLUTION; ///< Resolution of the next measurement
+static bool temp_resolution_dirty = (SI7021_RESOLUTION != SI7021_RES_RH12_T14); ///< User register not written yet
+static bool temp_resolution_queued = false;      ///< Resolution change queued ahead of the measure command
+static si7021_resolution_t temp_resolution_queued_res; ///< Resolution that change writes
+static uint64_t temp_conversion_start_us = 0;    ///< When the measure command was sent
+static uint8_t temp_polls = 0;                   ///< Reads NACKed during the running conversion
+static si7021_power_policy_t temp_power_policy = SI7021_KEEP_WARM; ///< Supply handling between measurements
+static bool temp_power_policy_set = false;       ///< Policy picked for the sampling interval yet
+static bool temp_sensor_warm = false;            ///< Supply on and power-up wait done
+static uint32_t temp_powerups = 0;               ///< Power-up waits done
+static uint32_t temp_measurements = 0;           ///< Measurements started
+#endif
+
 
 #if DEVICE_IS_BLE_SERVER
 
-void handle_gesture() {
+/**
+ * @brief Reports a diagonal or U-turn gesture. These are not tied to a vital yet,
+ *        so gesture_value and the running measurement are left as they are.
+ * @param value Gesture value sent over BLE.
+ * @param name Gesture name for the log and display.
+ */
+static void report_extra_gesture(uint8_t value, const char *name) {
+
+  LOG_INFO("%s\n\r", name);
+  displayPrintf(DISPLAY_ROW_9, "Gesture = %s", name);
+  ble_EnqueueGesture(value);
+}
+
+/**
+ * @brief Reports a decoded gesture on the display and over BLE.
+ * @param motion Gesture returned by readGestureStep().
+ */
+void handle_gesture(int motion) {
 
   ble_data_struct_t *bleData = getBleDataPtr();
 
-  if ( isGestureAvailable() ) {
-      //LOG_INFO("Is gesture available?\n\r");
+  switch ( motion ) {
 
-      switch ( readGesture() ) {
+    case DIR_DOWN:
+      LOG_INFO("DOWN\n\r");
+      bleData->gesture_value = 0x04;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = DOWN");
+      //the registers are written in the background, Evt_GestureConfig reports the end
+      if(!disableGestureSensorAsync()) {
+          LOG_ERROR("Error disabling gesture\n\r");
+      }
+      bleData->gesture_on = false;
+      displayPrintf(DISPLAY_ROW_ACTION, "Gesture sensor OFF");
+      //LOG_INFO("Sending down gesture\n\r");
+      ble_EnqueueGesture(0x04);
+      break;
 
-        case DIR_DOWN:
-          LOG_INFO("DOWN\n\r");
-          bleData->gesture_value = 0x04;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = DOWN");
-          disableGestureSensor();
-          bleData->gesture_on = false;
-          displayPrintf(DISPLAY_ROW_ACTION, "Gesture sensor OFF");
-          //LOG_INFO("Sending down gesture\n\r");
-          ble_EnqueueGesture(0x04);
-          break;
+    case DIR_UP:
+      LOG_INFO("UP\n\r");
+      bleData->gesture_value = 0x03;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = UP");
+      //LOG_INFO("Sending up gesture\n\r");
+      ble_EnqueueGesture(0x03);
+      break;
 
-        case DIR_UP:
-          LOG_INFO("UP\n\r");
-          bleData->gesture_value = 0x03;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = UP");
-          //LOG_INFO("Sending up gesture\n\r");
-          ble_EnqueueGesture(0x03);
-          break;
+    case DIR_LEFT:
+      LOG_INFO("LEFT\n\r");
+      bleData->gesture_value = 0x01;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = LEFT");
+      //LOG_INFO("Sending left gesture\n\r");
+      ble_EnqueueGesture(0x01);
+      break;
 
-        case DIR_LEFT:
-          LOG_INFO("LEFT\n\r");
-          bleData->gesture_value = 0x01;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = LEFT");
-          //LOG_INFO("Sending left gesture\n\r");
-          ble_EnqueueGesture(0x01);
-          break;
+    case DIR_RIGHT:
+      LOG_INFO("RIGHT\n\r");
+      bleData->gesture_value = 0x02;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = RIGHT");
+      // LOG_INFO("Sending right gesture\n\r");
+      ble_EnqueueGesture(0x02);
+      break;
 
-        case DIR_RIGHT:
-          LOG_INFO("RIGHT\n\r");
-          bleData->gesture_value = 0x02;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = RIGHT");
-          // LOG_INFO("Sending right gesture\n\r");
-          ble_EnqueueGesture(0x02);
-          break;
+    case DIR_NEAR:
+      LOG_INFO("NEAR\n\r");
+      bleData->gesture_value = 0x05;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = NEAR");
+      // LOG_INFO("Sending near gesture\n\r");
+      ble_EnqueueGesture(0x05);
+      break;
 
-        case DIR_NEAR:
-          LOG_INFO("NEAR\n\r");
-          bleData->gesture_value = 0x05;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = NEAR");
-          // LOG_INFO("Sending near gesture\n\r");
-          ble_EnqueueGesture(0x05);
-          break;
+    case DIR_FAR:
+      LOG_INFO("FAR\n\r");
+      bleData->gesture_value = 0x06;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = FAR");
+      //LOG_INFO("Sending far gesture\n\r");
+      ble_EnqueueGesture(0x06);
+      break;
 
-        case DIR_FAR:
-          LOG_INFO("FAR\n\r");
-          bleData->gesture_value = 0x06;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = FAR");
-          //LOG_INFO("Sending far gesture\n\r");
-          ble_EnqueueGesture(0x06);
-          break;
+    case DIR_UP_LEFT:
+      report_extra_gesture(0x07, "UP-LEFT");
+      break;
 
-        default:
-          LOG_INFO("NONE");
-          bleData->gesture_value = 0x00;
-          displayPrintf(DISPLAY_ROW_9, "Gesture = NONE");
-          ble_EnqueueGesture(0x00);
-      }
+    case DIR_UP_RIGHT:
+      report_extra_gesture(0x08, "UP-RIGHT");
+      break;
+
+    case DIR_DOWN_LEFT:
+      report_extra_gesture(0x09, "DOWN-LEFT");
+      break;
+
+    case DIR_DOWN_RIGHT:
+      report_extra_gesture(0x0A, "DOWN-RIGHT");
+      break;
+
+    case DIR_UTURN_UP_DOWN:
+      report_extra_gesture(0x0B, "UP-DOWN");
+      break;
+
+    case DIR_UTURN_DOWN_UP:
+      report_extra_gesture(0x0C, "DOWN-UP");
+      break;
+
+    case DIR_UTURN_LEFT_RIGHT:
+      report_extra_gesture(0x0D, "LEFT-RIGHT");
+      break;
+
+    case DIR_UTURN_RIGHT_LEFT:
+      report_extra_gesture(0x0E, "RIGHT-LEFT");
+      break;
+
+    default:
+      LOG_INFO("NONE");
+      bleData->gesture_value = 0x00;
+      displayPrintf(DISPLAY_ROW_9, "Gesture = NONE");
+      ble_EnqueueGesture(0x00);
+  }
+}
+
+/**
+ * @brief Finishes turning the gesture sensor on or off, called on Evt_GestureConfig.
+ *        Runs next to the read states, the reads only start once the sensor is on.
+ */
+static void gesture_config_event(void) {
+
+  ble_data_struct_t *bleData = getBleDataPtr();
+
+  switch(gestureConfigStep()) {
+
+    case GESTURE_CONFIG_PENDING:
+      break;
+
+    case GESTURE_CONFIG_ON:
+      displayPrintf(DISPLAY_ROW_10, "Gesture Sensor ON!");
+      bleData->gesture_on = true;
+      bleData->gesture_value = 0x00;
+      break;
+
+    case GESTURE_CONFIG_OFF:
+      LOG_INFO("Gesture sensor off\n\r");
+      break;
+
+    default:
+      LOG_ERROR("Error configuring the gesture sensor\n\r");
+      displayPrintf(DISPLAY_ROW_10, "Gesture sensor error");
+      break;
   }
 }
 
@@ -113,6 +218,12 @@ void gesture_state_machine(sl_bt_msg_t *evt) {
 
   state currentState;
   static state nextState = State0_Gesture_Wait;
+  int motion;
+
+  if(evt->data.evt_system_external_signal.extsignals == Evt_GestureConfig) {
+      gesture_config_event();
+      return;
+  }
 
 
   currentState = nextState;     //set current state of the process
@@ -128,16 +239,82 @@ void gesture_state_machine(sl_bt_msg_t *evt) {
 
           LOG_INFO("GestureInt event\n\r");
 
-          handle_gesture();
+          // start of the gesture-to-indication latency measurement
+          getBleDataPtr()->gesture_time_us = schedulerGetRaiseTime(Evt_GestureInt);
 
-          nextState = State1_Gesture;
+          //GSTATUS is read in the background, it tells whether there is a gesture to read
+          if(readGestureStart()) {
+              nextState = State2_Gesture_Fifo;
+          }
       }
 
       break;
 
     case State1_Gesture:
 
-      nextState = State0_Gesture_Wait;
+      nextState = State1_Gesture;          //default
+
+      //drain the FIFO on every batch interrupt until the gesture is decoded, the timer
+      //reads it anyway when no interrupt came within getGestureWakeTimeoutUs()
+      if((evt->data.evt_system_external_signal.extsignals == Evt_GestureTimer) ||
+         (evt->data.evt_system_external_signal.extsignals == Evt_GestureInt)) {
+
+          if(evt->data.evt_system_external_signal.extsignals == Evt_GestureInt) {
+              gesture_int_wakeups++;
+          }
+          else {
+              gesture_timer_wakeups++;
+          }
+
+          timerStop(&gesture_timer);
+          motion = readGestureStep();
+
+          if(motion == GESTURE_READ_FIFO) {
+              nextState = State2_Gesture_Fifo;
+          }
+          else if(motion == ERROR) {
+              LOG_ERROR("Gesture sensor read failed, gesture dropped\n\r");
+              nextState = State0_Gesture_Wait;
+          }
+          else {
+              gestures_read++;
+              handle_gesture(motion);
+              nextState = State0_Gesture_Wait;
+          }
+      }
+
+      break;
+
+    case State2_Gesture_Fifo:
+
+      nextState = State2_Gesture_Fifo;          //default
+
+      //the CPU is free while LDMA reads GFLVL/GSTATUS or the FIFO, act on the bytes once they are in
+      if(evt->data.evt_system_external_signal.extsignals == Evt_GestureFifo) {
+
+          motion = readGestureFifoDone();
+
+          if(motion == GESTURE_READ_PENDING) {
+              //let the FIFO fill before reading it again
+              timerStart(&gesture_timer, getGestureWakeTimeoutUs(), false);
+              nextState = State1_Gesture;
+          }
+          else if(motion == GESTURE_READ_FIFO) {
+              nextState = State2_Gesture_Fifo;
+          }
+          else if(motion == GESTURE_READ_NONE) {
+              nextState = State0_Gesture_Wait;
+          }
+          else if(motion == ERROR) {
+              LOG_ERROR("Gesture status or FIFO read failed, gesture dropped\n\r");
+              nextState = State0_Gesture_Wait;
+          }
+          else {
+              gestures_read++;
+              handle_gesture(motion);
+              nextState = State0_Gesture_Wait;
+          }
+      }
 
       break;
 
@@ -149,12 +326,111 @@ void gesture_state_machine(sl_bt_msg_t *evt) {
 
 }
 
+/**
+ * @brief Logs how often the MCU woke up to drain the gesture FIFO and what woke it.
+ */
+void gestureLogStats(void)
+{
+  uint32_t wakeups = gesture_int_wakeups + gesture_timer_wakeups;
+
+  LOG_INFO("gesture wakeups: %lu batch interrupts, %lu timer, %lu gestures, %lu.%lu per gesture\n\r",
+           (unsigned long)gesture_int_wakeups, (unsigned long)gesture_timer_wakeups,
+           (unsigned long)gestures_read,
+           (unsigned long)(gestures_read ? (wakeups / gestures_read) : 0),
+           (unsigned long)(gestures_read ? (((wakeups * 10) / gestures_read) % 10) : 0));
+}
+
+/**
+ * @brief Ends continuous streaming after the sample being processed.
+ *        Called when the client turns off oximeter indications or the connection closes.
+ */
+void oximeterStopStreaming(void)
+{
+  oximeter_stream_stop = true;
+}
+
+/**
+ * @brief Checks whether continuous streaming has to end: the client stopped it,
+ *        a FAR gesture was made or the connection is gone.
+ * @return True if the session has to be shut down.
+ */
+static bool oximeter_stream_ending(ble_data_struct_t *bleData)
+{
+  if(!oximeter_streaming){
+      return false;
+  }
+  if(!oximeter_stream_stop && (bleData->gesture_value != 0x06) && bleData->connected){
+      return false;
+  }
+
+  pulse_stream_log_stats();
+  oximeter_streaming = false;
+
+  return true;
+}
+
+/**
+ * @brief Starts the full bring-up: reset low with MFIO high, state_wait_10ms continues it.
+ */
+static void oximeter_cold_start(void)
+{
+  oximeter_warm = false;
+
+  //setting MFIO and RESET as output, reset is set and mfio is cleared
+  pulse_oximeter_init_pins();
+  //bio_hub_init();
+  //clear the reset in and set the MFIO pin
+  turn_off_reset();
+
+  //Set the MFIO pin
+  turn_on_mfio();
+
+  //wait 10ms
+  timerStart(&oximeter_timer, 10000, false);
+}
+
+/**
+ * @brief Waits for the next MFIO data-ready interrupt, with the oximeter timer as watchdog.
+ */
+static void oximeter_wait_data_ready(void)
+{
+  timerStart(&oximeter_timer, OXIMETER_MFIO_WATCHDOG_US, false);
+  if(mfio_data_ready()){
+      schedulerSetEventMfio();
+  }
+}
+
+/**
+ * @brief Ends a session, the shutdown sequence has run (or the bring-up failed).
+ * @param hub_ok True if the hub can be restarted warm next time.
+ */
+static void oximeter_session_end(ble_data_struct_t *bleData, bool hub_ok)
+{
+  //output mode and FIFO threshold survive disabling the AFE and the algorithm
+  oximeter_hub_configured = hub_ok;
+  oximeter_warm = false;
+
+  timerStop(&oximeter_timer);
+  clear_MFIO_interrupt();
+  LOG_INFO("Oximeter samples read on MFIO=%lu on watchdog=%lu\n\r",
+           (unsigned long)oximeter_mfio_reads, (unsigned long)oximeter_watchdog_reads);
+  oximeter_mfio_reads = 0;
+  oximeter_watchdog_reads = 0;
+
+  Count_PulseData = 0;
+  bleData->pulse_on = false;
+  bleData->gesture_value = 0x00;
+  bleData->gesture_on = true;
+}
+
 void oximeter_state_machine(sl_bt_msg_t *evt) {
 
   state currentState;
   static state nextState = state_pulse_sensor_init;
   ble_data_struct_t *bleData = getBleDataPtr();
-  //bool gesture_check =false;
+  uint32_t signal = evt->data.evt_system_external_signal.extsignals;
+  max32664_seq_result_t result;
+  uint8_t fifo_level;
 
     currentState = nextState;     //set current state of the process
 
@@ -162,31 +438,48 @@ void oximeter_state_machine(sl_bt_msg_t *evt) {
 
             case state_pulse_sensor_init:
              // LOG_INFO("In state_pulse_sensor_init\n\r");
-              //setting MFIO and RESET as output, reset is set and mfio is cleared
-              pulse_oximeter_init_pins();
-              //bio_hub_init();
-              //clear the reset in and set the MFIO pin
-              turn_off_reset();
+              //start a measurement on a LEFT/RIGHT gesture, the machine then runs to completion on its own timer
+              //a NEAR gesture starts continuous streaming, it runs until FAR or the client stops it
+              if((bleData->gesture_value != 0x01) && (bleData->gesture_value != 0x02) &&
+                 (bleData->gesture_value != 0x05)){
+                  break;
+              }
+              bleData->pulse_on = true;
+              oximeter_streaming = (bleData->gesture_value == 0x05);
+              oximeter_stream_stop = false;
+              if(oximeter_streaming){
+                  pulse_stream_reset();
+              }
+              else{
+                  pulse_data_reset();
+              }
 
-              //Set the MFIO pin
-              turn_on_mfio();
+              oximeter_bringup_start_us = timerGetMicroseconds();
 
-              //wait 10ms
-              timerWaitUs_irq(10000);
+              //the hub kept its output mode and FIFO threshold from the last session,
+              //only the AFE and the algorithm have to be turned back on
+              if(oximeter_hub_configured){
+                  oximeter_warm = true;
+                  set_MFIO_interrupt();
+                  max32664_seq_start(&max32664_seq_warm);
+                  nextState = state_seq_bringup;
+                  break;
+              }
 
+              oximeter_cold_start();
               nextState = state_wait_10ms;
 
               break;
 
             case state_wait_10ms:
             //  LOG_INFO("In state_wait_10ms\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
+              if(signal == Evt_OximeterTimer ){
                   LOG_INFO("In if case of state_wait_10ms\n\r");
                 //set reset pin
                 turn_on_reset();
 
                 //wait for 1 second
-                timerWaitUs_irq(1000000);
+                timerStart(&oximeter_timer, 1000000, false);
 
                 nextState = state_wait_1s;
               }
@@ -195,352 +488,259 @@ void oximeter_state_machine(sl_bt_msg_t *evt) {
 
             case state_wait_1s:
              // LOG_INFO("In state_wait_1s\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
+              if(signal == Evt_OximeterTimer ){
                   LOG_INFO("In if case of state_wait_1s\n\r");
                 //set MFIO pin as an interrupt
                 set_MFIO_interrupt();
-                //bio_hub_init_bootloader_mode();
 
-                //settings for putting the device into read mode
-                I2C_write_polled_pulse(Mode_ReadDevice, 2);
+                //the hub is in application mode, configure it
+                max32664_seq_start(&max32664_seq_cold);
 
-                //wait for 10ms before performing a read
-                timerWaitUs_irq(10000);
-
-                nextState = state_read_return_check;
-              }
-
-              break;
-
-            case state_read_return_check:
-          //    LOG_INFO("In state_read_return_check\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                  //perform read to check if it returns 0
-                  check_read_return();
-                 // bio_hub_read_sensor_hub_status();
-                  //set the output mode
-                  set_output_mode_func();
-                //  bio_hub_set_output_mode();
-                  //wait for 6ms between a write and a read
-                  timerWaitUs_irq(6000);
-
-                  nextState = state_set_output_mode;
+                nextState = state_seq_bringup;
               }
 
               break;
 
-            case state_set_output_mode:
-           //   LOG_INFO("In state_set_output_mode\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
+            case state_seq_bringup:
+              result = max32664_seq_handle_event(signal);
 
-                 //perform read to check the return value
-                  I2C_read_polled_pulse();
+              if(result == MAX32664_SEQ_DONE){
+                  LOG_INFO("%s bring-up took %lu ms\n\r", oximeter_warm ? "Warm" : "Cold",
+                           (unsigned long)((timerGetMicroseconds() - oximeter_bringup_start_us) / 1000));
 
-                  //perform read to check if it returns 0
-                  check_read_return();
-                  // bio_hub_read_sensor_hub_status();
-                  //set the fifo threshold
-                  setFifoThreshold_func();
-                 // bio_hub_set_fifo_threshold();
-                  //wait for 6ms before performing a read
-                  timerWaitUs_irq(6000);
-
-                  nextState = state_setFifoThreshold;
-              }
-
-              break;
-
-            case state_setFifoThreshold:
-          //    LOG_INFO("In state_setFifoThreshold\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //LOG_INFO("In state_setFifoThreshold!!\n\r");
-
-                  //wait for 100ms before performing red
-                  //NOTE:This is set to match the timings as per the arduino code provided in Github
-                  timerWaitUs_polled(100000);
-
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                   //perform read to check if it returns 0
-                  check_read_return();
-                  // bio_hub_read_sensor_hub_status();
-                   //agc algo control commands
-                   agcAlgoControl_func();
-       //            bio_hub_agc_algo_control();
-                   //wait for 6ms before performing a read
-                   timerWaitUs_irq(6000);
+                   //wait 6 seconds before taking the actual reading
+                   timerStart(&oximeter_timer, 6000000, false);
 
-                   nextState = state_agcAlgoControl;
+                   nextState = state_wait_before_reading;
               }
-
-              break;
-
-            case state_agcAlgoControl:
-        //      LOG_INFO("In state_agcAlgoControl\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //LOG_INFO("In state_agcAlgoControl!!\n\r");
-
-                  //wait for 100ms before performing red
-                  //NOTE:This is set to match the timings as per the arduino code provided in Github
-                  timerWaitUs_polled(100000);
-
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                   //set the control for the sensor
-                   max30101Control_func();
-
-                   //wait for 6ms before performing a read
-                   timerWaitUs_irq(6000);
-
-                   nextState = state_max30101Control;
-
+              else if((result == MAX32664_SEQ_FAILED) && oximeter_warm){
+                  LOG_ERROR("Sensor hub warm restart failed, doing a cold start\n\r");
+                  oximeter_cold_start();
+                  nextState = state_wait_10ms;
               }
-
-              break;
-
-            case state_max30101Control:
-     //         LOG_INFO("In state_max30101Control\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //LOG_INFO("In state_max30101Control!!\n\r");
-                  //wait for 100ms before performing red
-                  //NOTE:This is set to match the timings as per the arduino code provided in Github
-                  timerWaitUs_polled(100000);
-
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                   //maximum fast algo control
-                   maximFastAlgoControl_func();
-                  // bio_hub_maxim_fast_algo_control)();
-                   //wait for 6ms before performing a read
-                   timerWaitUs_irq(6000);
-
-                   nextState = state_maximFastAlgoControl;
-
+              else if(result == MAX32664_SEQ_FAILED){
+                  LOG_ERROR("Sensor hub bring-up failed\n\r");
+                  oximeter_streaming = false;
+                  oximeter_session_end(bleData, false);
+                  nextState = state_pulse_sensor_init;
               }
 
               break;
 
-            case state_maximFastAlgoControl:
-        //      LOG_INFO("In state_maximFastAlgoControl\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //LOG_INFO("In state_maximFastAlgoControl!!\n\r");
-                  //wait for 100ms before performing red
-                  //NOTE:This is set to match the timings as per the arduino code provided in Github
-                  timerWaitUs_polled(100000);
-
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                   //read the algo samples before taking the actual readings
-                   readAlgoSamples_func();
-
-                   //wait for 6ms before performing a read
-                   timerWaitUs_irq(6000);
+            case state_wait_before_reading:
+        //      LOG_INFO("In state_wait_before_reading\n\r");
+              if(signal == Evt_OximeterTimer ){
 
-                   nextState = state_readAlgoSamples;
+                  //status, FIFO level and the FIFO read command
+                  max32664_seq_start(&max32664_seq_sample);
 
+                  nextState = state_seq_sample;
               }
 
               break;
 
-            case state_readAlgoSamples:
-       //       LOG_INFO("In state_readAlgoSamples\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
+            case state_wait_data_ready:
+        //      LOG_INFO("In state_wait_data_ready\n\r");
+              if((signal == Evt_OximeterMfio) || (signal == Evt_OximeterTimer)){
 
+                  if(signal == Evt_OximeterMfio){
+                      //data is ready, the watchdog is not needed
+                      timerStop(&oximeter_timer);
+                      oximeter_mfio_reads++;
+                  }
+                  else{
+                      //a quiet hub must not keep a stopped stream alive
+                      if(oximeter_stream_ending(bleData)){
+                          max32664_seq_start(&max32664_seq_shutdown);
+                          nextState = state_seq_shutdown;
+                          break;
+                      }
+                      LOG_INFO("No MFIO data-ready interrupt, reading on the watchdog\n\r");
+                      oximeter_watchdog_reads++;
+                  }
 
-                  //perform read to check the return value
-                  I2C_read_polled_pulse();
-
-                   //perform read to check if it returns 0
-                  check_read_return();
-
-                   //wait 6 seconds before taking the actual reading
-                   timerWaitUs_irq(6000000);
-
-                   nextState = state_wait_before_reading;
+                  //status, FIFO level and the FIFO read command
+                  max32664_seq_start(&max32664_seq_sample);
 
+                  nextState = state_seq_sample;
               }
 
               break;
 
-            case state_wait_before_reading:
-        //      LOG_INFO("In state_wait_before_reading\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                  //read the sensor status
-                   read_sensor_hub_status_func();
+            case state_seq_sample:
+              result = max32664_seq_handle_event(signal);
 
-                   //wait 6 seconds before taking the actual reading
-                   timerWaitUs_irq(6000);
+              if(result == MAX32664_SEQ_DONE){
 
-                   nextState = state_read_sensor_hub_status;
+                  //read every sample waiting in the hub FIFO in one burst
+                  fifo_level = I2C_pulse_fifo_level();
+                  if(fifo_level == 0){
+                      //nothing to read yet, wait for the next data-ready interrupt
+                      oximeter_wait_data_ready();
+                      nextState = state_wait_data_ready;
+                      break;
+                  }
+                  I2C_read_pulse_samples(fifo_level, Evt_OximeterSample);
 
+                  nextState = state_read_sample;
               }
-
-              else if(bleData->pulse_on){
-
-            //      LOG_INFO("In else if of state_wait_before_reading\n\r");
-                  //read the sensor status
-                   read_sensor_hub_status_func();
-
-                   //wait 6 seconds before taking the actual reading
-                   timerWaitUs_irq(6000);
-
-                   nextState = state_read_sensor_hub_status;
+              else if(result == MAX32664_SEQ_FAILED){
+                  oximeter_wait_data_ready();
+                  nextState = state_wait_data_ready;
               }
 
               break;
 
-            case state_read_sensor_hub_status:
-       //       LOG_INFO("In state_read_Sensor_hub_status\n\r");
-                  if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                        //read for checking the return value
-                      I2C_read_polled_pulse();
-
-                        //perform read to check if it returns 0
-                      check_read_return();
-
-                        //number of samples out of the fifo
-                        numSamplesOutFifo_func();
-
-                        //wair for 6ms before performing a read
-                        timerWaitUs_irq(6000);
-
-                         nextState = state_numSamplesOutFifo;
-                  }
-
-              break;
-
-            case state_numSamplesOutFifo:
-     //         LOG_INFO("In state_numSamplesOutFifo\n\r");
-                if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1 ){
-
-                    //perform a read to check the return value
-                    I2C_read_polled_pulse();
-
-                    //perform read to check if it returns 0
-                    check_read_return();
-
-                    //start reading sesnor data by sending read commands
-                    read_fill_array_func();
-
-                    //wair for 6ms before performing a read
-                    timerWaitUs_irq(6000);
-
-                     nextState = state_read_fill_array;
-
-                }
+            case state_read_sample:
+      //        LOG_INFO("In state_read_sample\n\r");
+                if(signal == Evt_OximeterSample){
 
-              break;
+                    if(oximeter_streaming){
 
-            case state_read_fill_array:
-      //        LOG_INFO("In state_read_fill_array\n\r");
-                if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1){
+                        //the hub stays configured, keep sending window results at the algorithm rate
+                        pulse_stream_extract();
 
-                    //read the actual data
-                    I2C_read_polled_pulse();
+                        if(oximeter_stream_ending(bleData)){
+                            max32664_seq_start(&max32664_seq_shutdown);
+                            nextState = state_seq_shutdown;
+                        }
+                        else{
+                            oximeter_wait_data_ready();
+                            nextState = state_wait_data_ready;
+                        }
+                    }
 
-                    //read 15 values to give sensor time to acquire appropriate values
-                      if(Count_PulseData <1){
+                    //collect 10 values to give sensor time to acquire appropriate values
+                    else if(Count_PulseData <1){
 
-                          //stop after 15 counts
+                          //process every sample of the burst, stop after 10 counts
                           Count_PulseData = pulse_data_extract();
 
-                          //read after every second
-                          timerWaitUs_irq(1000000);
+                          //read again when the hub signals data ready, the timer is only a watchdog
+                          oximeter_wait_data_ready();
 
-                          nextState = state_wait_before_reading;
+                          nextState = state_wait_data_ready;
                       }
 
                       else{
-                          bleData->pulse_on = false;
-                          Count_PulseData = 0;
-                          timerWaitUs_irq(6000);
-                          nextState = state_disable_AFE;
-
+                          max32664_seq_start(&max32664_seq_shutdown);
+                          nextState = state_seq_shutdown;
                       }
 
                 }
 
               break;
 
-            case state_disable_AFE:
-      //        LOG_INFO("In state_disable_AFE\n\r");
-                  if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1){
-                  //disable AFE
-                              disable_AFE_func();
+            case state_seq_shutdown:
+              result = max32664_seq_handle_event(signal);
 
-                              //wair for 6ms before performing a read
-                              timerWaitUs_irq(6000);
-
-                               nextState = state_disable_algo;
-                  }
+              if(result != MAX32664_SEQ_RUNNING){
+                  oximeter_session_end(bleData, (result == MAX32664_SEQ_DONE));
+                  nextState = state_pulse_sensor_init;
+              }
 
               break;
 
-            case state_disable_algo:
-       //       LOG_INFO("In state_disableAlgo\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1){
-
-                          //perform a read to check the return value
-                  I2C_read_polled_pulse();
-
-                          //perform read to check if it returns 0
-                  check_read_return();
-
-                          //start reading sesnor data by sending read commands
-                          disable_algo_func();
-
-                          //wair for 6ms before performing a read
-                          timerWaitUs_irq(6000);
-
-                           nextState = state_pulse_done;
+            default:
+              LOG_INFO("Something wrong!! In the default state of oximeter state machine");
 
-                    }
               break;
 
-           case state_pulse_done:
-       //      LOG_INFO("In state_pulse_dones\n\r");
-              if(evt->data.evt_system_external_signal.extsignals == LETIMER0_COMP1){
-                            //perform a read to check the return value
-                  I2C_read_polled_pulse();
-
-                            //perform read to check if it returns 0
-                  check_read_return();
+      }
+    return;
+}
+/**
+ * @brief Picks the supply handling for the sampling interval. The power model weighs one
+ *        power-up against standby for one interval, see si7021_crossover_interval_s().
+ */
+void tempSetSamplingInterval(uint32_t interval_ms)
+{
+#if TEMP_SENSOR_SHARES_DISPLAY_ENABLE
+  // the display keeps the supply on anyway, cycling it would blank the LCD
+  (void)interval_ms;
+  temp_power_policy = SI7021_KEEP_WARM;
+#else
+  temp_power_policy = si7021_power_policy_for(interval_ms);
+#endif
+  temp_power_policy_set = true;
+}
 
-                            nextState = state_pulse_done;
-              }
-              else if(bleData->pulse_on){
-                  bleData->gesture_value = 0x00;
-                  bleData->gesture_on = true;
-                  nextState = state_pulse_sensor_init;
-              }
+void tempLogPowerStats(void)
+{
+  LOG_INFO("Si7021 %s, %lu measurements, %lu power-ups, crossover %lu s\n\r",
+           (temp_power_policy == SI7021_KEEP_WARM) ? "kept warm" : "power cycled",
+           (unsigned long)temp_measurements, (unsigned long)temp_powerups,
+           (unsigned long)si7021_crossover_interval_s());
+  LOG_INFO("Si7021 per hour at %d ms: on %lu ms %lu uC kept warm, on %lu ms %lu uC power cycled\n\r",
+           LETIMER_PERIOD_MS,
+           (unsigned long)si7021_on_time_ms_per_hour(SI7021_KEEP_WARM, LETIMER_PERIOD_MS, temp_resolution),
+           (unsigned long)si7021_charge_uc_per_hour(SI7021_KEEP_WARM, LETIMER_PERIOD_MS, temp_resolution),
+           (unsigned long)si7021_on_time_ms_per_hour(SI7021_POWER_CYCLE, LETIMER_PERIOD_MS, temp_resolution),
+           (unsigned long)si7021_charge_uc_per_hour(SI7021_POWER_CYCLE, LETIMER_PERIOD_MS, temp_resolution));
+}
 
-          break;
+/**
+ * @brief Applies a pending resolution change and sends the measure command.
+ */
+static void temp_start_measurement(void)
+{
+  // the user register only has to be written when the setting changes or the sensor was powered off,
+  // the change goes on the bus ahead of the measure command and is checked with its I2C_COMPLETE
+  if(temp_resolution_dirty){
+      temp_resolution_queued = I2C_si7021_set_resolution(temp_resolution);
+      temp_resolution_queued_res = temp_resolution;
+      if(!temp_resolution_queued){
+          LOG_ERROR("Si7021 resolution not queued, measuring with the previous one\n\r");
+      }
+  }
+  temp_measurements++;
+  i2c_Write();                               // Perform I2C write operation
+}
 
+/**
+ * @brief Checks the resolution change queued by temp_start_measurement(), its transfers
+ *        have finished once the measure command has.
+ */
+static void temp_check_resolution(void)
+{
+  if(!temp_resolution_queued){
+      return;
+  }
+  temp_resolution_queued = false;
 
-            default:
-              LOG_INFO("Something wrong!! In the default state of oximeter state machine");
+  // a change requested while this one was on the bus stays dirty for the next measurement
+  if(I2C_si7021_resolution_status() != i2cTransferDone){
+      LOG_ERROR("Si7021 resolution not set, measuring with the previous one\n\r");
+  }
+  else if(temp_resolution == temp_resolution_queued_res){
+      temp_resolution_dirty = false;
+  }
+}
 
-              break;
+/**
+ * @brief Ends a measurement, powers the sensor off if the policy cycles it.
+ */
+static void temp_end_measurement(ble_data_struct_t *bleData)
+{
+  bleData->gesture_value = 0x00;
+  if(temp_power_policy == SI7021_POWER_CYCLE){
+#if !TEMP_SENSOR_SHARES_DISPLAY_ENABLE
+      gpioTempSensorDisable();
+#endif
+      temp_sensor_warm = false;
+      // the user register is back to its power-up default after the next power-up
+      temp_resolution_dirty = (temp_resolution != SI7021_RES_RH12_T14);
+  }
+}
 
-      }
-    /* Keep feeding this state machine until done, even if a new gesture (e.g. UP) arrives. */
-    bleData->oximeter_busy = (nextState != state_pulse_done);
-    return;
+void tempSetResolution(si7021_resolution_t res)
+{
+  if(res != temp_resolution){
+      temp_resolution = res;
+      temp_resolution_dirty = true;
+  }
 }
+
 /**
  * @brief State machine to control the temperature sensor
  * @param event The event triggered by interrupts
@@ -558,12 +758,25 @@ void temp_state_machine(sl_bt_msg_t *event)
        case StateA_Sleep:
        Next_State = StateA_Sleep; // Default next state
 
-       // Check if LETIMER0 underflow event occurred
-        if (event->data.evt_system_external_signal.extsignals == LETIMER0_UF)
+       // Check if LETIMER0 underflow event occurred after an UP gesture
+        if ((event->data.evt_system_external_signal.extsignals == LETIMER0_UF) &&
+            (bleData->gesture_value == 0x03))
         {
      //     LOG_INFO("timerUF event\n\r");
-          timerWaitUs_irq(80000);        // Wait for 80 milliseconds
-          Next_State = StateB_Wait;      // Transition to StateB_Wait
+          if(!temp_power_policy_set){
+              tempSetSamplingInterval(LETIMER_PERIOD_MS);
+          }
+          if(temp_sensor_warm){
+              // kept powered since the last measurement, no power-up wait
+              temp_start_measurement();
+              Next_State = StateC_WriteCmd;
+          }
+          else{
+              gpioTempSensorEnable();
+              temp_powerups++;
+              timerStart(&temp_timer, SI7021_POWERUP_US, false);        // Wait for power-up
+              Next_State = StateB_Wait;      // Transition to StateB_Wait
+          }
         }
        break;
 
@@ -571,12 +784,13 @@ void temp_state_machine(sl_bt_msg_t *event)
             Next_State = StateB_Wait; // Default next state
 
             // Check if LETIMER0 compare1 event occurred
-            if (event->data.evt_system_external_signal.extsignals ==LETIMER0_COMP1 )
+            if (event->data.evt_system_external_signal.extsignals == Evt_TempTimer )
             {
      //           LOG_INFO("Comp1 event\n\r");
                 // Remove energy mode requirement EM1.
                 //sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1); // Add EM1 requirement
-                i2c_Write();                               // Perform I2C write operation
+                temp_sensor_warm = true;
+                temp_start_measurement();
                 Next_State = StateC_WriteCmd;             // Transition to StateC_WriteCmd
             }
             break;
@@ -590,7 +804,15 @@ void temp_state_machine(sl_bt_msg_t *event)
       //          LOG_INFO("write transfer done\n\r");
                 //sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1); // Remove EM1 requirement
 
-                timerWaitUs_irq(10800);         // Wait for 10.8 milliseconds
+                temp_check_resolution();
+
+                // no-hold polling reads as soon as the conversion is typically done, otherwise wait the worst case
+                temp_conversion_start_us = timerGetMicroseconds();
+                temp_polls = 0;
+                timerStart(&temp_timer,
+                           SI7021_NOHOLD_POLLING ? si7021_rh_conversion_typ_us(temp_resolution)
+                                                 : si7021_rh_conversion_max_us(temp_resolution),
+                           false);
 
                 Next_State = StateD_WriteWait;  // Transition to StateD_WriteWait
             }
@@ -600,11 +822,11 @@ void temp_state_machine(sl_bt_msg_t *event)
             Next_State = StateD_WriteWait; // Default next state
 
             // Check if LETIMER0 compare1 event occurred
-            if (event->data.evt_system_external_signal.extsignals ==LETIMER0_COMP1 )
+            if (event->data.evt_system_external_signal.extsignals == Evt_TempTimer )
             {
                 // Remove energy mode requirement EM1.
                 // sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1); // Add EM1 requirement
-                i2c_Read();                                      // Read temperature
+                i2c_Read();                                      // Read humidity
                 Next_State = StateE_Read;                         // Transition to StateE_Read
             }
             break;
@@ -617,11 +839,43 @@ void temp_state_machine(sl_bt_msg_t *event)
             {
    //             LOG_INFO("read transfer  done\n\r");
                //sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1); // Remove EM1 requirement
-                                                   // Disable temperature sensor
-                NVIC_DisableIRQ(I2C0_IRQn);                                  // Disable I2C interrupt
-                LOG_INFO("Temperature = %f C\n\r", ConvertTempToCelcius());  // Log temperature
+                if(i2c_ReadNacked())
+                {
+                    // conversion still running, poll again until the worst case time has passed
+                    if((timerGetMicroseconds() - temp_conversion_start_us) <
+                       (si7021_rh_conversion_max_us(temp_resolution) + SI7021_POLL_INTERVAL_US))
+                    {
+                        temp_polls++;
+                        timerStart(&temp_timer, SI7021_POLL_INTERVAL_US, false);
+                        Next_State = StateD_WriteWait;
+                    }
+                    else
+                    {
+                        LOG_ERROR("Si7021 conversion did not finish\n\r");
+                        temp_end_measurement(bleData);
+                        Next_State = StateA_Sleep;
+                    }
+                    break;
+                }
+                // the humidity conversion measured temperature too, read it back without a new conversion
+                i2c_ReadTempFromRH();
+                Next_State = StateF_ReadTemp;                                // Transition to StateF_ReadTemp
+            }
+            break;
+
+        case StateF_ReadTemp:
+            Next_State = StateF_ReadTemp; // Default next state
+
+            // Check if I2C operation is complete
+            if (event->data.evt_system_external_signal.extsignals ==I2C_COMPLETE)
+            {
+                LOG_INFO("Temperature = %ld mC, humidity = %ld m%%RH\n\r",
+                         (long)ConvertTempToMilliCelsius(), (long)ConvertHumidityToMilliRH());
+                LOG_INFO("Si7021 conversion read after %lu us, %d polls\n\r",
+                         (unsigned long)(timerGetMicroseconds() - temp_conversion_start_us), temp_polls);
                 ble_SendTemperature();
-                bleData->gesture_value = 0x00;
+                ble_SendHumidity();
+                temp_end_measurement(bleData);
                 Next_State = StateA_Sleep;                                   // Transition to StateA_Sleep
             }
             break;
@@ -630,8 +884,6 @@ void temp_state_machine(sl_bt_msg_t *event)
   //          LOG_ERROR("not in the state machine\n\r"); // Log error if not in any defined state
             break;
     }
-    /* Keep feeding this state machine until done, even if a new gesture (e.g. LEFT/RIGHT) arrives. */
-    bleData->temp_busy = (Next_State != StateA_Sleep);
     return;
 }
 
@@ -978,117 +1230,3 @@ void discovery_state_machine(sl_bt_msg_t *evt){
 }
 
 #endif
-
-/**
- * @brief Sets a scheduler event when LETIMER0 underflow interrupt occurs.
- */
-void schedulerSetEventUF()
-{
-// enter critical section
-  CORE_DECLARE_IRQ_STATE;
-  // Disable interrupts
-  CORE_ENTER_CRITICAL();
-// set the event in your data structure, this has to be a read-modify-write
- // my_event|=LETIMER0_UF;
-
-  sl_bt_external_signal(LETIMER0_UF);
-// exit critical section
-    // Enable interrupts
-  CORE_EXIT_CRITICAL();
-} // schedulerSetEventUF()
-
-/**
- * @brief Sets a scheduler event when LETIMER0 COMP1 interrupt occurs.
- */
-void schedulerSetEventCOMP1()
-{
-// enter critical section
-  CORE_DECLARE_IRQ_STATE;
-  // Disable interrupts
-  CORE_ENTER_CRITICAL();
-// set the event in your data structure, this has to be a read-modify-write
- // my_event|=LETIMER0_COMP1;
-
-  sl_bt_external_signal(LETIMER0_COMP1);
-// exit critical section
-    // Enable interrupts
-  CORE_EXIT_CRITICAL();
-} // schedulerSetEventCOMP1()
-
-
-/**
- * @brief Sets a scheduler event when I2C transfer completes.
- */
-void schedulerSetEventI2Ccomplete()
-{
-// enter critical section
-  CORE_DECLARE_IRQ_STATE;
-  // Disable interrupts
-  CORE_ENTER_CRITICAL();
-// set the event in your data structure, this has to be a read-modify-write
-//  my_event|=I2C_COMPLETE;
-
-  sl_bt_external_signal(I2C_COMPLETE);
-// exit critical section
-    // Enable interrupts
-  CORE_EXIT_CRITICAL();
-} // schedulerSetEventI2C_COMPLETE()
-
-/**
- * @brief Sets the event indicating a button press in the scheduler.
- *
- * This function sets the event indicating that a button press has occurred in the scheduler.
- * It disables interrupts before setting the event to ensure atomicity of the operation.
- * After setting the event, interrupts are re-enabled.
- */
-void schedulerSetEventButtonPressed()
-{
-  // enter critical section
-    CORE_DECLARE_IRQ_STATE;
-    // Disable interrupts
-    CORE_ENTER_CRITICAL();
-
-    // Signal the scheduler about button press event
-    sl_bt_external_signal(Evt_Button_Pressed);
-  // exit critical section
-      // Enable interrupts
-    CORE_EXIT_CRITICAL();
-
-}     //schedulerSetEventPB0ButtonPressed()
-
-/**
- * @brief Sets the event indicating a button release in the scheduler.
- *
- * This function sets the event indicating that a button release has occurred in the scheduler.
- * It disables interrupts before setting the event to ensure atomicity of the operation.
- * After setting the event, interrupts are re-enabled.
- */
-void schedulerSetEventButtonReleased()
-{
-  // enter critical section
-    CORE_DECLARE_IRQ_STATE;
-    // Disable interrupts
-    CORE_ENTER_CRITICAL();
-
-    // Signal the scheduler about button release event
-    sl_bt_external_signal(Evt_Button_Released);
-  // exit critical section
-      // Enable interrupts
-    CORE_EXIT_CRITICAL();
-
-}     //schedulerSetEventButtonReleased()
-
-// scheduler routine to set a scheduler event
-void schedulerSetGestureEvent()
-{
-  // enter critical section
-  CORE_DECLARE_IRQ_STATE;
-  CORE_ENTER_CRITICAL();
-
-  sl_bt_external_signal(Evt_GestureInt);
-
-  // exit critical section
-  CORE_EXIT_CRITICAL();
-
-} // schedulerSetEventXXX()
-
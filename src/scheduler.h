@@ -9,25 +9,63 @@
 #ifndef SRC_SCHEDULER_H_
 #define SRC_SCHEDULER_H_
 
+#include "stdint.h"
+#include "stdbool.h"
 #include "sl_bt_api.h"
+#include "src/si7021.h"
 
 
 
 
 /**
  * @brief Enumeration of scheduler events.
+ *
+ * Each event owns one bit. sl_bt_external_signal() ORs signals that are raised
+ * before the stack gets to deliver them, so a single external signal event can
+ * carry several of these bits at once. schedulerDispatchEvent() splits such an
+ * event so that every state machine still sees one event bit per call.
  */
 enum
 {
-  no_event     = 0             ,     /**< No event */
-  LETIMER0_UF              ,     /**< LETIMER0 underflow event */
-  LETIMER0_COMP1           ,
-  I2C_COMPLETE             ,
-  Evt_Button_Pressed       ,
-  Evt_Button_Released      ,
-  Evt_GestureInt           ,
+  no_event            = 0,           /**< No event */
+  LETIMER0_UF         = (1U << 0),   /**< LETIMER0 underflow event */
+  LETIMER0_COMP1      = (1U << 1),   /**< LETIMER0 COMP1 event */
+  I2C_COMPLETE        = (1U << 2),   /**< I2C transfer complete event */
+  Evt_Button_Pressed  = (1U << 3),   /**< PB0/PB1 pressed */
+  Evt_Button_Released = (1U << 4),   /**< PB0/PB1 released */
+  Evt_GestureInt      = (1U << 5),   /**< APDS9960 interrupt pin asserted */
+  Evt_TempTimer       = (1U << 6),   /**< Temperature state machine timer expired */
+  Evt_OximeterTimer   = (1U << 7),   /**< Oximeter state machine timer expired */
+  Evt_GestureTimer    = (1U << 8),   /**< Gesture FIFO read pause expired */
+  Evt_OximeterI2C     = (1U << 9),   /**< All queued sensor hub transfers finished */
+  Evt_OximeterSample  = (1U << 10),  /**< Sensor hub sample read into pulse_data */
+  Evt_GestureFifo     = (1U << 11),  /**< LDMA read of the gesture status or FIFO finished */
+  Evt_OximeterMfio    = (1U << 12),  /**< Sensor hub pulled MFIO low, data is ready */
+  Evt_I2CError        = (1U << 13),  /**< An I2C transfer failed, see i2cLogErrors() */
+  Evt_OximeterSeqTimer = (1U << 14), /**< Sensor hub command delay expired */
+  Evt_GestureConfig   = (1U << 15),  /**< APDS9960 shadow read or register write batch finished */
 };
 
+/** Number of event bits defined above */
+#define SCHEDULER_NUM_EVENTS   (16)
+
+/**
+ * @brief Per-bit event counters, used to see how often signals get coalesced.
+ */
+typedef struct {
+  uint32_t raised[SCHEDULER_NUM_EVENTS];     /**< Times the bit was raised by an ISR */
+  uint32_t dispatched[SCHEDULER_NUM_EVENTS]; /**< Times the bit was handed to the state machines */
+  uint32_t coalesced[SCHEDULER_NUM_EVENTS];  /**< Times the bit arrived together with other bits */
+  uint32_t multi_bit_signals;                /**< External signal events carrying more than one bit */
+  uint64_t last_raised_us[SCHEDULER_NUM_EVENTS]; /**< timerGetMicroseconds() of the last raise */
+  uint32_t handler_max_us[SCHEDULER_NUM_EVENTS]; /**< Longest time the state machines took for the bit */
+} scheduler_stats_t;
+
+/**
+ * @brief Handler called by schedulerDispatchEvent() for every (split) event.
+ */
+typedef void (*scheduler_handler_t)(sl_bt_msg_t *evt);
+
 /**
  * @brief States of the state machine
  */
@@ -39,6 +77,7 @@ typedef enum {
     StateC_WriteCmd,   /**< State C: Write Command *////< StateC_WriteCmd
     StateD_WriteWait,  /**< State D: Write Wait */   ///< StateD_WriteWait
     StateE_Read,        /**< State E: Read */         ///< StateE_Read
+    StateF_ReadTemp,   /**< State F: Read Temperature */ ///< StateF_ReadTemp
 
     //states for discovery state machine
     State0_client_idle,   // Initial state
@@ -58,6 +97,7 @@ typedef enum {
 
     State0_Gesture_Wait,
     State1_Gesture,
+    State2_Gesture_Fifo,
 
     State_No_Gesture,
 
@@ -65,24 +105,57 @@ typedef enum {
     state_pulse_sensor_init,
     state_wait_10ms,
     state_wait_1s,
-    state_read_return_check,
-    state_set_output_mode,
-    state_setFifoThreshold,
-    state_agcAlgoControl,
-    state_max30101Control,
-    state_maximFastAlgoControl,
-    state_readAlgoSamples,
+    state_seq_bringup,
     state_wait_before_reading,
-    state_read_sensor_hub_status,
-    state_numSamplesOutFifo,
-    state_read_fill_array,
-    state_disable_AFE,
-    state_disable_algo,
-    state_pulse_done,
+    state_wait_data_ready,
+    state_seq_sample,
+    state_read_sample,
+    state_seq_shutdown,
 }state;
 
 
 
+/**
+ * @brief Raises one or more scheduler event bits through sl_bt_external_signal().
+ * @param event OR of the event bits to raise.
+ */
+void schedulerSetEvent(uint32_t event);
+
+/**
+ * @brief Passes a Bluetooth stack event to the handler.
+ *
+ * External signal events are fanned out, the handler is called once for every
+ * set event bit (lowest bit first) with extsignals holding only that bit.
+ * All other events are passed through unchanged.
+ *
+ * @param evt Event coming from the Bluetooth stack.
+ * @param handler Function feeding the event to the state machines.
+ */
+void schedulerDispatchEvent(sl_bt_msg_t *evt, scheduler_handler_t handler);
+
+/**
+ * @brief Returns the per-bit raise/dispatch/coalesce counters.
+ */
+const scheduler_stats_t * schedulerGetStats(void);
+
+/**
+ * @brief Returns true while schedulerDispatchEvent() is running a handler,
+ *        i.e. code is running on the BLE event path.
+ */
+bool schedulerIsDispatching(void);
+
+/**
+ * @brief Returns when the (lowest) given event bit was last raised.
+ * @param event Event bit.
+ * @return timerGetMicroseconds() at the last raise, 0 if never raised.
+ */
+uint64_t schedulerGetRaiseTime(uint32_t event);
+
+/**
+ * @brief Logs the per-bit event counters.
+ */
+void schedulerLogStats(void);
+
 /**
  * @brief Sets a scheduler event when LETIMER0 underflow interrupt occurs.
  */
@@ -125,18 +198,52 @@ void schedulerSetEventButtonReleased();
 
 void schedulerSetGestureEvent();
 
+/**
+ * @brief Sets the event indicating the sensor hub MFIO data-ready interrupt.
+ */
+void schedulerSetEventMfio();
+
 /**
  * @brief State machine to control the temperature sensor
  * @param event The event triggered by interrupts
  */
 void temp_state_machine(sl_bt_msg_t *evt);
 
+/**
+ * @brief Selects the Si7021 resolution, applied before the next measurement starts.
+ *        Lower resolutions convert several times faster.
+ * @param res New resolution.
+ */
+void tempSetResolution(si7021_resolution_t res);
 
-void handle_gesture();
+/**
+ * @brief Picks keep-warm or power-cycle for the sensor supply from the sampling interval.
+ *        Called with LETIMER_PERIOD_MS before the first measurement if not called earlier.
+ * @param interval_ms Time between two measurements.
+ */
+void tempSetSamplingInterval(uint32_t interval_ms);
+
+/**
+ * @brief Logs the supply policy, power-ups and the estimated sensor on-time and charge per hour.
+ */
+void tempLogPowerStats(void);
+
+
+void handle_gesture(int motion);
 
 void gesture_state_machine(sl_bt_msg_t *evt);
 
 void oximeter_state_machine(sl_bt_msg_t *evt);
+
+/**
+ * @brief Ends continuous oximeter streaming after the sample being processed.
+ */
+void oximeterStopStreaming(void);
+
+/**
+ * @brief Logs the gesture FIFO wakeup counters, batch interrupts versus fallback timer.
+ */
+void gestureLogStats(void);
 /**
  * @brief Handles the state machine for BLE discovery.
  *
@@ -0,0 +1,228 @@
+/*
+ * scheduler_events.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Scheduler event bits. ISRs raise them through sl_bt_external_signal(),
+ *              schedulerDispatchEvent() hands them to the state machines one bit at a time.
+ *              Kept apart from the state machines in scheduler.c so it builds on the host.
+ */
+
+#define INCLUDE_LOG_DEBUG 1
+#include "stdbool.h"
+#include "src/log.h"
+#include "src/scheduler.h"
+#include "src/timers.h"
+#include "sl_bt_api.h"
+#include "em_core.h"
+
+static scheduler_stats_t scheduler_stats; ///< Per-bit event counters
+
+static bool dispatching = false; ///< True while a handler runs from schedulerDispatchEvent()
+
+/**
+ * @brief Raises one or more scheduler event bits through sl_bt_external_signal().
+ * @param event OR of the event bits to raise.
+ */
+void schedulerSetEvent(uint32_t event)
+{
+  uint64_t now;
+
+  // enter critical section
+  CORE_DECLARE_IRQ_STATE;
+  // Disable interrupts
+  CORE_ENTER_CRITICAL();
+
+  now = timerGetMicroseconds();
+
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      if (event & (1U << bit))
+        {
+          scheduler_stats.raised[bit]++;
+          scheduler_stats.last_raised_us[bit] = now;
+        }
+    }
+
+  // the stack ORs this into any signal that is still pending
+  sl_bt_external_signal(event);
+
+  // exit critical section
+  // Enable interrupts
+  CORE_EXIT_CRITICAL();
+} // schedulerSetEvent()
+
+/**
+ * @brief Passes a Bluetooth stack event to the handler, one event bit at a time.
+ * @param evt Event coming from the Bluetooth stack.
+ * @param handler Function feeding the event to the state machines.
+ */
+void schedulerDispatchEvent(sl_bt_msg_t *evt, scheduler_handler_t handler)
+{
+  uint32_t signals;
+  bool     coalesced;
+  uint64_t start_us;
+  uint32_t took_us;
+
+  dispatching = true;
+
+  if (SL_BT_MSG_ID(evt->header) != sl_bt_evt_system_external_signal_id)
+    {
+      handler(evt);
+      dispatching = false;
+      return;
+    }
+
+  signals = evt->data.evt_system_external_signal.extsignals;
+
+  // more than one bit set means several ISRs fired before this event was delivered
+  coalesced = ((signals & (signals - 1)) != 0);
+  if (coalesced)
+    {
+      scheduler_stats.multi_bit_signals++;
+    }
+
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      if (signals & (1U << bit))
+        {
+          scheduler_stats.dispatched[bit]++;
+          if (coalesced)
+            {
+              scheduler_stats.coalesced[bit]++;
+            }
+
+          // state machines compare extsignals against a single event bit
+          evt->data.evt_system_external_signal.extsignals = (1U << bit);
+          start_us = timerGetMicroseconds();
+          handler(evt);
+
+          // time the stack could not run, a long one can cost connection events
+          took_us = (uint32_t)(timerGetMicroseconds() - start_us);
+          if (took_us > scheduler_stats.handler_max_us[bit])
+            {
+              scheduler_stats.handler_max_us[bit] = took_us;
+            }
+        }
+    }
+
+  evt->data.evt_system_external_signal.extsignals = signals;
+
+  dispatching = false;
+} // schedulerDispatchEvent()
+
+/**
+ * @brief Returns true while schedulerDispatchEvent() is running a handler.
+ */
+bool schedulerIsDispatching(void)
+{
+  return dispatching;
+}
+
+/**
+ * @brief Returns the per-bit raise/dispatch/coalesce counters.
+ */
+const scheduler_stats_t * schedulerGetStats(void)
+{
+  return (&scheduler_stats);
+}
+
+/**
+ * @brief Returns when the (lowest) given event bit was last raised.
+ */
+uint64_t schedulerGetRaiseTime(uint32_t event)
+{
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      if (event & (1U << bit))
+        {
+          return (scheduler_stats.last_raised_us[bit]);
+        }
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Logs the per-bit event counters.
+ *        raised - dispatched is the number of signals merged with an identical pending one.
+ */
+void schedulerLogStats(void)
+{
+  LOG_INFO("multi-bit external signals = %lu\n\r", (unsigned long)scheduler_stats.multi_bit_signals);
+  LOG_INFO("polled waits on the event path = %lu\n\r", (unsigned long)timerGetPolledWaitsOnEventPath());
+
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      LOG_INFO("event bit %lu: raised=%lu dispatched=%lu coalesced=%lu handler max=%lu us\n\r",
+               (unsigned long)bit,
+               (unsigned long)scheduler_stats.raised[bit],
+               (unsigned long)scheduler_stats.dispatched[bit],
+               (unsigned long)scheduler_stats.coalesced[bit],
+               (unsigned long)scheduler_stats.handler_max_us[bit]);
+    }
+}
+
+/**
+ * @brief Sets a scheduler event when LETIMER0 underflow interrupt occurs.
+ */
+void schedulerSetEventUF()
+{
+  schedulerSetEvent(LETIMER0_UF);
+} // schedulerSetEventUF()
+
+/**
+ * @brief Sets a scheduler event when LETIMER0 COMP1 interrupt occurs.
+ */
+void schedulerSetEventCOMP1()
+{
+  schedulerSetEvent(LETIMER0_COMP1);
+} // schedulerSetEventCOMP1()
+
+
+/**
+ * @brief Sets a scheduler event when I2C transfer completes.
+ */
+void schedulerSetEventI2Ccomplete()
+{
+  schedulerSetEvent(I2C_COMPLETE);
+} // schedulerSetEventI2C_COMPLETE()
+
+/**
+ * @brief Sets the event indicating a button press in the scheduler.
+ *
+ * This function sets the event indicating that a button press has occurred in the scheduler.
+ * It disables interrupts before setting the event to ensure atomicity of the operation.
+ * After setting the event, interrupts are re-enabled.
+ */
+void schedulerSetEventButtonPressed()
+{
+  // Signal the scheduler about button press event
+  schedulerSetEvent(Evt_Button_Pressed);
+}     //schedulerSetEventPB0ButtonPressed()
+
+/**
+ * @brief Sets the event indicating a button release in the scheduler.
+ *
+ * This function sets the event indicating that a button release has occurred in the scheduler.
+ * It disables interrupts before setting the event to ensure atomicity of the operation.
+ * After setting the event, interrupts are re-enabled.
+ */
+void schedulerSetEventButtonReleased()
+{
+  // Signal the scheduler about button release event
+  schedulerSetEvent(Evt_Button_Released);
+}     //schedulerSetEventButtonReleased()
+
+// scheduler routine to set a scheduler event
+void schedulerSetGestureEvent()
+{
+  schedulerSetEvent(Evt_GestureInt);
+} // schedulerSetEventXXX()
+
+/**
+ * @brief Sets the event indicating the sensor hub MFIO data-ready interrupt.
+ */
+void schedulerSetEventMfio()
+{
+  schedulerSetEvent(Evt_OximeterMfio);
+} // schedulerSetEventMfio()
@@ -0,0 +1,147 @@
+/*
+ * si7021.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only conversion of Si7021 measurement codes.
+ *              Reference: Si7021-A20 datasheet, sections 5.1.1 and 5.1.2.
+ */
+
+#include "src/si7021.h"
+
+/*
+ * 175720 / 65536 and 125000 / 65536 reduce to 21965 / 8192 and 15625 / 8192.
+ * The largest product, 21965 * 65535, still fits in 32 bits.
+ */
+#define SI7021_TEMP_SCALE   (21965u)
+#define SI7021_TEMP_OFFSET  (46850)
+#define SI7021_RH_SCALE     (15625u)
+#define SI7021_RH_OFFSET    (6000)
+#define SI7021_SHIFT        (13)
+#define SI7021_ROUND        (1u << (SI7021_SHIFT - 1))
+
+/**
+ * @brief Conversion times of one resolution setting in microseconds, datasheet table 2.
+ */
+typedef struct {
+  uint16_t rh_typ_us;
+  uint16_t rh_max_us;
+  uint16_t temp_typ_us;
+  uint16_t temp_max_us;
+} si7021_timing_t;
+
+/**
+ * @brief Returns the conversion times of a resolution setting.
+ */
+static const si7021_timing_t * si7021_timing(si7021_resolution_t res)
+{
+  static const si7021_timing_t rh12_t14 = { 10000, 12000, 7000, 10800 };
+  static const si7021_timing_t rh8_t12  = {  2600,  3100, 2400,  3800 };
+  static const si7021_timing_t rh10_t13 = {  3700,  4500, 4000,  6200 };
+  static const si7021_timing_t rh11_t11 = {  5800,  7000, 1500,  2400 };
+
+  switch(res){
+    case SI7021_RES_RH8_T12:
+      return &rh8_t12;
+    case SI7021_RES_RH10_T13:
+      return &rh10_t13;
+    case SI7021_RES_RH11_T11:
+      return &rh11_t11;
+    case SI7021_RES_RH12_T14:
+    default:
+      return &rh12_t14;
+  }
+}
+
+uint32_t si7021_rh_conversion_max_us(si7021_resolution_t res)
+{
+  const si7021_timing_t *t = si7021_timing(res);
+
+  return (uint32_t)t->rh_max_us + t->temp_max_us;
+}
+
+uint32_t si7021_rh_conversion_typ_us(si7021_resolution_t res)
+{
+  const si7021_timing_t *t = si7021_timing(res);
+
+  return (uint32_t)t->rh_typ_us + t->temp_typ_us;
+}
+
+int32_t si7021_code_to_millicelsius(uint16_t code)
+{
+  uint32_t scaled = (SI7021_TEMP_SCALE * (uint32_t)code + SI7021_ROUND) >> SI7021_SHIFT;
+
+  return (int32_t)scaled - SI7021_TEMP_OFFSET;
+}
+
+int32_t si7021_code_to_millirh(uint16_t code)
+{
+  uint32_t scaled = (SI7021_RH_SCALE * (uint32_t)code + SI7021_ROUND) >> SI7021_SHIFT;
+  int32_t rh = (int32_t)scaled - SI7021_RH_OFFSET;
+
+  // codes near the ends of the range give slightly negative or above 100 % values
+  if(rh < 0){
+      rh = 0;
+  }
+  if(rh > 100000){
+      rh = 100000;
+  }
+
+  return rh;
+}
+
+/* one hour in milliseconds */
+#define SI7021_HOUR_MS (3600000ull)
+
+uint32_t si7021_on_time_ms_per_hour(si7021_power_policy_t policy, uint32_t interval_ms,
+                                    si7021_resolution_t res)
+{
+  uint64_t on_ms;
+
+  if(policy == SI7021_KEEP_WARM || interval_ms == 0){
+      return (uint32_t)SI7021_HOUR_MS;
+  }
+
+  // scaled by the interval rather than by whole samples, intervals over an hour count too
+  on_ms = SI7021_HOUR_MS * (SI7021_POWERUP_US + si7021_rh_conversion_max_us(res)) / 1000 / interval_ms;
+
+  return (on_ms > SI7021_HOUR_MS) ? (uint32_t)SI7021_HOUR_MS : (uint32_t)on_ms;
+}
+
+uint32_t si7021_charge_uc_per_hour(si7021_power_policy_t policy, uint32_t interval_ms,
+                                   si7021_resolution_t res)
+{
+  const si7021_timing_t *t = si7021_timing(res);
+  uint64_t sample_pc;       // picocoulombs, uA * us
+  uint64_t total_pc;
+
+  if(interval_ms == 0){
+      interval_ms = 1;
+  }
+
+  // conversions cost the same under both policies
+  sample_pc = (uint64_t)SI7021_IDD_RH_UA * t->rh_max_us + (uint64_t)SI7021_IDD_TEMP_UA * t->temp_max_us;
+  if(policy != SI7021_KEEP_WARM){
+      sample_pc += (uint64_t)SI7021_IDD_POWERUP_UA * SI7021_POWERUP_US;
+  }
+  total_pc = SI7021_HOUR_MS * sample_pc / interval_ms;
+
+  if(policy == SI7021_KEEP_WARM){
+      // nA * ms = pC
+      total_pc += (uint64_t)SI7021_IDD_STANDBY_NA * SI7021_HOUR_MS;
+  }
+
+  return (uint32_t)(total_pc / 1000000);
+}
+
+uint32_t si7021_crossover_interval_s(void)
+{
+  // power-up charge in pC divided by the standby current in nA gives milliseconds
+  uint64_t powerup_pc = (uint64_t)SI7021_IDD_POWERUP_UA * SI7021_POWERUP_US;
+
+  return (uint32_t)(powerup_pc / SI7021_IDD_STANDBY_NA / 1000);
+}
+
+si7021_power_policy_t si7021_power_policy_for(uint32_t interval_ms)
+{
+  return ((interval_ms / 1000) >= si7021_crossover_interval_s()) ? SI7021_POWER_CYCLE : SI7021_KEEP_WARM;
+}
@@ -0,0 +1,141 @@
+/*
+ * si7021.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Integer-only conversion of Si7021 measurement codes. Results are in
+ *              milli-units so the fraction of a degree or a percent is kept.
+ */
+
+#ifndef SRC_SI7021_H_
+#define SRC_SI7021_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/** Commands, no-hold master mode */
+#define SI7021_CMD_MEASURE_RH    (0xF5)  ///< Measure humidity, temperature is measured with it
+#define SI7021_CMD_MEASURE_TEMP  (0xF3)  ///< Measure temperature only
+#define SI7021_CMD_TEMP_FROM_RH  (0xE0)  ///< Read the temperature of the last humidity measurement
+#define SI7021_CMD_WRITE_USER_REG (0xE6) ///< Write user register 1
+#define SI7021_CMD_READ_USER_REG (0xE7)  ///< Read user register 1
+
+/** RES1 (bit 7) and RES0 (bit 0) of user register 1, the other bits must be kept */
+#define SI7021_USER_REG_RES_MASK (0x81)
+
+/** Power-up value of user register 1 */
+#define SI7021_USER_REG_DEFAULT  (0x3A)
+
+/**
+ * @brief Measurement resolutions, the value is the RES1/RES0 bits of user register 1.
+ *        RH and temperature resolution are set together, only these four pairs exist.
+ */
+typedef enum {
+  SI7021_RES_RH12_T14 = 0x00,   ///< Power-up default
+  SI7021_RES_RH8_T12  = 0x01,
+  SI7021_RES_RH10_T13 = 0x80,
+  SI7021_RES_RH11_T11 = 0x81,
+} si7021_resolution_t;
+
+/** Resolution the temperature state machine starts with */
+#define SI7021_RESOLUTION (SI7021_RES_RH12_T14)
+
+/**
+ * 1: read the result after the typical conversion time and retry every
+ *    SI7021_POLL_INTERVAL_US while the sensor NACKs its address.
+ * 0: always wait out the worst case conversion time.
+ */
+#define SI7021_NOHOLD_POLLING (1)
+
+/** Time between two reads of a conversion that was not finished yet */
+#define SI7021_POLL_INTERVAL_US (1000)
+
+/** Worst case time from enabling the supply until the sensor accepts commands */
+#define SI7021_POWERUP_US (80000)
+
+/**
+ * Supply currents of the power model, datasheet typical values. The power-up
+ * current is the peak, charged over the whole power-up time it is an upper bound.
+ */
+#define SI7021_IDD_STANDBY_NA   (60)     ///< Powered, no conversion running
+#define SI7021_IDD_RH_UA        (150)    ///< RH conversion in progress
+#define SI7021_IDD_TEMP_UA      (90)     ///< Temperature conversion in progress
+#define SI7021_IDD_POWERUP_UA   (3500)   ///< Peak during power-up
+
+/**
+ * @brief How the sensor supply is handled between measurements.
+ */
+typedef enum {
+  SI7021_POWER_CYCLE,   ///< Supply enabled for each measurement, power-up wait every time
+  SI7021_KEEP_WARM,     ///< Supply stays on, measurements start right away
+} si7021_power_policy_t;
+
+/**
+ * @brief Estimated time per hour the sensor is powered for a sampling interval.
+ * @param policy Supply handling.
+ * @param interval_ms Time between two measurements.
+ * @param res Resolution, sets the conversion time.
+ * @return Powered milliseconds per hour.
+ */
+uint32_t si7021_on_time_ms_per_hour(si7021_power_policy_t policy, uint32_t interval_ms,
+                                    si7021_resolution_t res);
+
+/**
+ * @brief Estimated charge per hour the sensor draws for a sampling interval.
+ * @param policy Supply handling.
+ * @param interval_ms Time between two measurements.
+ * @param res Resolution, sets the conversion time.
+ * @return Charge in microcoulombs (uA * s) per hour.
+ */
+uint32_t si7021_charge_uc_per_hour(si7021_power_policy_t policy, uint32_t interval_ms,
+                                   si7021_resolution_t res);
+
+/**
+ * @brief Sampling interval above which power cycling draws less charge than keeping
+ *        the sensor powered: one power-up costs as much as this long in standby.
+ * @return Crossover interval in seconds.
+ */
+uint32_t si7021_crossover_interval_s(void);
+
+/**
+ * @brief Picks the supply handling that draws less charge for a sampling interval.
+ * @param interval_ms Time between two measurements.
+ */
+si7021_power_policy_t si7021_power_policy_for(uint32_t interval_ms);
+
+/**
+ * @brief Returns the worst case time of a humidity conversion, which includes the
+ *        temperature conversion that comes with it.
+ * @param res Resolution set in the user register.
+ * @return Conversion time in microseconds.
+ */
+uint32_t si7021_rh_conversion_max_us(si7021_resolution_t res);
+
+/**
+ * @brief Returns the typical time of a humidity conversion, including its temperature
+ *        conversion. Reading earlier than this only costs NACKed polls.
+ * @param res Resolution set in the user register.
+ * @return Conversion time in microseconds.
+ */
+uint32_t si7021_rh_conversion_typ_us(si7021_resolution_t res);
+
+/** The two LSBs of a measurement code are status bits, not data */
+#define SI7021_CODE_MASK (0xFFFC)
+
+/**
+ * @brief Converts a temperature code to milli-degrees Celsius.
+ *        175.72 * code / 65536 - 46.85 as (21965 * code) / 8192 - 46850, rounded.
+ * @param code Raw 16 bit temperature code, MSB first on the bus.
+ * @return Temperature in milli-degrees Celsius, -46850 to 128867.
+ */
+int32_t si7021_code_to_millicelsius(uint16_t code);
+
+/**
+ * @brief Converts a relative humidity code to milli-percent.
+ *        125 * code / 65536 - 6 as (15625 * code) / 8192 - 6000, rounded and
+ *        clamped to 0-100 % as the datasheet recommends.
+ * @param code Raw 16 bit humidity code, MSB first on the bus.
+ * @return Relative humidity in milli-percent, 0 to 100000.
+ */
+int32_t si7021_code_to_millirh(uint16_t code);
+
+#endif /* SRC_SI7021_H_ */
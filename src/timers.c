@@ -17,11 +17,14 @@
 #include "em_letimer.h"    // Include the Energy Micro Low Energy Timer header file
 #include "app.h"           // Include the application header file
 #include "src/oscillators.h"
+#include "src/scheduler.h"
+#include "em_core.h"
 
 #define CLOCK_RESOLUTION (LOWEST_ENERGY_MODE==3?1000:61)   // Clock resolution
 
-#define MIN_WAIT ((LOWEST_ENERGY_MODE==3)?1000:61) // Minimum wait time range check
-#define MAX_WAIT 3000000        //Maximum wait time range check
+#define US_PER_SECOND (1000000)  // Microseconds per second, also the fractional tick unit
+
+static uint32_t polled_waits_on_event_path = 0;  // timerWaitUs_polled() calls from a BLE event handler
 
 
 /*
@@ -70,11 +73,21 @@ LETIMER_IntEnable (LETIMER0, LETIMER_IEN_UF);
  *
  * @param us_wait The duration to wait in microseconds.
  * @note The function will wait for the specified duration using the LETIMER timer.
+ *       No driver calls it any more, it is kept only so a busy wait that comes back on
+ *       the BLE event path is counted by timerGetPolledWaitsOnEventPath(). Remove both
+ *       together.
  */
 void timerWaitUs_polled(uint32_t us_wait)
 {
     uint16_t current_cnt = 0, req_cnt = 0, req_ticks = 0;
 
+    // Busy waits belong to init code only, count any that run on the BLE event path
+    if (schedulerIsDispatching())
+    {
+        polled_waits_on_event_path++;
+        LOG_ERROR("Polled wait of %lu us on the event path\n\r", (unsigned long)us_wait);
+    }
+
     // Calculate the required number of ticks for the given duration
     req_ticks = (us_wait / CLOCK_RESOLUTION);
 
@@ -98,55 +111,339 @@ void timerWaitUs_polled(uint32_t us_wait)
 }
 
 /**
- * @brief Waits for a specified duration in microseconds using the LETIMER peripheral with interrupts.
- * @param us_wait The duration to wait in microseconds.
- *        It should be within the range [MIN_WAIT, MAX_WAIT].
+ * @brief Returns how many timerWaitUs_polled() calls ran from a BLE event handler.
+ */
+uint32_t timerGetPolledWaitsOnEventPath(void)
+{
+    return polled_waits_on_event_path;
+}
+
+/*
+ * Software timer service.
+ *
+ * LETIMER0 free runs from VALUE_TO_COMP0 down to 0, the UF interrupt counts the
+ * periods. A point in time is the pair (rollover count, ticks into the period).
+ * COMP1 is programmed for the earliest deadline when that deadline falls in the
+ * current period, otherwise the next UF re-evaluates the queue.
+ */
+
+static soft_timer_t *timer_queue = NULL;        ///< Running timers sorted by deadline
+static volatile uint32_t timer_rollovers = 0;   ///< LETIMER0 periods since init
+
+/**
+ * @brief Reads the current position of LETIMER0. Must be called with interrupts disabled.
+ *        A UF that is pending but not yet counted by the ISR is accounted for here.
+ */
+static void timerNow(uint32_t *rollover, uint32_t *offset)
+{
+  uint32_t ro  = timer_rollovers;
+  uint32_t cnt = LETIMER_CounterGet(LETIMER0);
+
+  if (LETIMER_IntGet(LETIMER0) & LETIMER_IF_UF)
+    {
+      // the counter reloaded, read it again so it belongs to the new period
+      cnt = LETIMER_CounterGet(LETIMER0);
+      ro++;
+    }
+
+  *rollover = ro;
+  *offset   = (uint32_t)VALUE_TO_COMP0 - cnt;
+}
+
+/**
+ * @brief Returns true if point a is before point b.
+ */
+static bool timerIsBefore(uint32_t ro_a, uint32_t off_a, uint32_t ro_b, uint32_t off_b)
+{
+  return ((ro_a < ro_b) || ((ro_a == ro_b) && (off_a < off_b)));
+}
+
+/**
+ * @brief Moves a point in time forward by ticks, carrying into the rollover count.
+ */
+static void timerAddTicks(uint32_t *rollover, uint32_t *offset, uint32_t ticks)
+{
+  uint32_t sum;
+
+  *rollover += ticks / LETIMER_PERIOD_TICKS;
+  sum = *offset + (ticks % LETIMER_PERIOD_TICKS);
+
+  if (sum >= LETIMER_PERIOD_TICKS)
+    {
+      sum -= LETIMER_PERIOD_TICKS;
+      *rollover += 1;
+    }
+
+  *offset = sum;
+}
+
+/**
+ * @brief Converts microseconds to LETIMER0 ticks without losing precision.
+ * @param us Duration in microseconds.
+ * @param frac Returns the remainder in millionths of a tick.
+ * @return Whole ticks, rounded down.
+ */
+static uint32_t timerUsToTicks(uint32_t us, uint32_t *frac)
+{
+  uint64_t scaled = (uint64_t)us * (uint64_t)ACTUAL_FREQ;
+
+  *frac = (uint32_t)(scaled % US_PER_SECOND);
+
+  return (uint32_t)(scaled / US_PER_SECOND);
+}
+
+/**
+ * @brief Returns the ticks to the next expiry of a periodic timer, adding the carried fraction.
+ */
+static uint32_t timerNextPeriod(soft_timer_t *timer)
+{
+  uint32_t ticks = timer->period_ticks;
+
+  timer->frac_acc += timer->period_frac;
+  if (timer->frac_acc >= US_PER_SECOND)
+    {
+      timer->frac_acc -= US_PER_SECOND;
+      ticks++;
+    }
+
+  return ticks;
+}
+
+/**
+ * @brief Inserts a timer into the deadline queue, after timers with the same deadline.
+ */
+static void timerQueueInsert(soft_timer_t *timer)
+{
+  soft_timer_t **link = &timer_queue;
+
+  while ((*link != NULL) &&
+         !timerIsBefore(timer->deadline_rollover, timer->deadline_offset,
+                        (*link)->deadline_rollover, (*link)->deadline_offset))
+    {
+      link = &((*link)->next);
+    }
+
+  timer->next    = *link;
+  *link          = timer;
+  timer->running = true;
+}
+
+/**
+ * @brief Removes a timer from the deadline queue.
+ */
+static void timerQueueRemove(soft_timer_t *timer)
+{
+  soft_timer_t **link = &timer_queue;
+
+  while (*link != NULL)
+    {
+      if (*link == timer)
+        {
+          *link = timer->next;
+          break;
+        }
+      link = &((*link)->next);
+    }
+
+  timer->next    = NULL;
+  timer->running = false;
+}
+
+/**
+ * @brief Expires every due timer and programs COMP1 for the earliest remaining deadline.
  */
-void timerWaitUs_irq(uint32_t us_wait)
+static void timerService(void)
 {
-  uint16_t current_cnt = 0;   // Current counter value
-  uint16_t req_cnt = 0;       // Required counter value
-  uint16_t req_ticks = 0;     // Required number of ticks for the given duration
+  uint32_t ro, off;
+  soft_timer_t *head;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
 
-     // Check if the specified duration is within the valid range
-  if ((us_wait < (uint32_t)MIN_WAIT) || (us_wait > (uint32_t)MAX_WAIT))
+  while (1)
     {
-     LOG_INFO("TimerWait range\n\r");
+      timerNow(&ro, &off);
+
+      // expire everything whose deadline has been reached
+      while ((timer_queue != NULL) &&
+             !timerIsBefore(ro, off, timer_queue->deadline_rollover, timer_queue->deadline_offset))
+        {
+          head = timer_queue;
+          timerQueueRemove(head);
+
+          if (head->period_ticks != 0)
+            {
+              timerAddTicks(&head->deadline_rollover, &head->deadline_offset, timerNextPeriod(head));
+              timerQueueInsert(head);
+            }
+
+          if (head->event != 0)
+            {
+              schedulerSetEvent(head->event);
+            }
+
+          if (head->callback != NULL)
+            {
+              head->callback(head->arg);
+            }
+        }
+
+      head = timer_queue;
+
+      // nothing left, or the earliest deadline is in a later period: the next UF looks again
+      if ((head == NULL) || (head->deadline_rollover != ro))
+        {
+          LETIMER_IntDisable(LETIMER0, LETIMER_IEN_COMP1);
+          break;
+        }
+
+      LETIMER_IntClear(LETIMER0, LETIMER_IFC_COMP1);
+      LETIMER_CompareSet(LETIMER0, 1, (uint32_t)VALUE_TO_COMP0 - head->deadline_offset);
+      LETIMER_IntEnable(LETIMER0, LETIMER_IEN_COMP1);
+
+      // if the counter already reached the compare value while programming it, expire it here
+      timerNow(&ro, &off);
+      if (timerIsBefore(ro, off, head->deadline_rollover, head->deadline_offset))
+        {
+          break;
+        }
+    }
+
+  CORE_EXIT_CRITICAL();
+}
 
-         // Adjust the specified duration to the valid range
-     if (us_wait > (uint32_t)MAX_WAIT)
-       {
-           us_wait = MAX_WAIT;
-       }
-     else if (us_wait < (uint32_t)MIN_WAIT)
-       {
-           us_wait = MIN_WAIT;
-       }
-     }
+/**
+ * @brief Sets up a software timer.
+ */
+void timerInit(soft_timer_t *timer, uint32_t event, timer_callback_t callback, void *arg)
+{
+  timer->next              = NULL;
+  timer->deadline_rollover = 0;
+  timer->deadline_offset   = 0;
+  timer->period_ticks      = 0;
+  timer->period_frac       = 0;
+  timer->frac_acc          = 0;
+  timer->event             = event;
+  timer->callback          = callback;
+  timer->arg               = arg;
+  timer->running           = false;
+}
 
-     // Calculate the required number of ticks for the given duration
-     req_ticks = (us_wait / CLOCK_RESOLUTION);
+/**
+ * @brief (Re)starts a software timer.
+ * @param us_wait The duration to wait in microseconds, may span any number of LETIMER0 periods.
+ */
+void timerStart(soft_timer_t *timer, uint32_t us_wait, bool periodic)
+{
+  uint32_t req_ticks;     // Required number of ticks for the given duration
+  uint32_t frac;          // Fraction of a tick left over
 
-     // Get the current counter value
-     current_cnt = LETIMER_CounterGet(LETIMER0);
+  // Calculate the required number of ticks for the given duration
+  req_ticks = timerUsToTicks(us_wait, &frac);
 
-     // Calculate the required counter value to reach the desired wait duration
-     req_cnt = current_cnt - req_ticks;
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
 
-     // Handle counter overflow
-     if (req_cnt > VALUE_TO_COMP0)
-     {
-         req_cnt = VALUE_TO_COMP0 - (0xFFFF - req_cnt);
-     }
+  if (timer->running)
+    {
+      timerQueueRemove(timer);
+    }
+
+  if (periodic)
+    {
+      // a period shorter than a tick would expire continuously
+      if (req_ticks == 0)
+        {
+          req_ticks = 1;
+          frac      = 0;
+        }
+      timer->period_ticks = req_ticks;
+      timer->period_frac  = frac;
+      timer->frac_acc     = 0;
+      req_ticks           = timerNextPeriod(timer);
+    }
+  else
+    {
+      // never expire before the requested time
+      if ((frac != 0) || (req_ticks == 0))
+        {
+          req_ticks++;
+        }
+      timer->period_ticks = 0;
+      timer->period_frac  = 0;
+      timer->frac_acc     = 0;
+    }
 
-     LETIMER_IntClear(LETIMER0, LETIMER_IFC_COMP1);
-     // Set the compare value to trigger interrupt after the specified duration
-     LETIMER_CompareSet(LETIMER0, 1, req_cnt);
+  timerNow(&timer->deadline_rollover, &timer->deadline_offset);
+  timerAddTicks(&timer->deadline_rollover, &timer->deadline_offset, req_ticks);
 
-     // Enable COMP1 interrupt
-     LETIMER_IntEnable(LETIMER0, LETIMER_IEN_COMP1);
+  timerQueueInsert(timer);
+  timerService();
 
-     // Enable COMP1 interrupt in LETIMER0->IEN register
-     LETIMER0->IEN |= LETIMER_IEN_COMP1;
+  CORE_EXIT_CRITICAL();
+}
 
+/**
+ * @brief Stops a software timer.
+ */
+void timerStop(soft_timer_t *timer)
+{
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+
+  if (timer->running)
+    {
+      timerQueueRemove(timer);
+      timerService();
+    }
+
+  CORE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Returns true while the timer is waiting to expire.
+ */
+bool timerIsRunning(const soft_timer_t *timer)
+{
+  return timer->running;
+}
+
+/**
+ * @brief Returns the LETIMER0 ticks elapsed since init_LETIMER0().
+ */
+uint64_t timerGetTicks(void)
+{
+  uint32_t ro, off;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  timerNow(&ro, &off);
+  CORE_EXIT_CRITICAL();
+
+  return (((uint64_t)ro * LETIMER_PERIOD_TICKS) + off);
+}
+
+/**
+ * @brief Returns the microseconds elapsed since init_LETIMER0().
+ */
+uint64_t timerGetMicroseconds(void)
+{
+  return ((timerGetTicks() * US_PER_SECOND) / (uint64_t)ACTUAL_FREQ);
+}
+
+/**
+ * @brief Counts an LETIMER0 underflow and services the timer queue.
+ */
+void timerHandleUF(void)
+{
+  timer_rollovers++;
+  timerService();
+}
+
+/**
+ * @brief Expires due timers and reprograms COMP1.
+ */
+void timerHandleCOMP1(void)
+{
+  timerService();
 }
@@ -10,10 +10,46 @@
 #define SRC_TIMERS_H_
 
 #include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
 
 #define LETIMER_PERIOD_MS 3000
 #define VALUE_TO_COMP0 (LETIMER_PERIOD_MS*ACTUAL_FREQ)/1000
 
+/** LETIMER0 counts from VALUE_TO_COMP0 down to 0 and reloads, one period is VALUE_TO_COMP0+1 ticks */
+#define LETIMER_PERIOD_TICKS ((VALUE_TO_COMP0) + 1)
+
+/**
+ * @brief Function called from interrupt context when a software timer expires.
+ */
+typedef void (*timer_callback_t)(void *arg);
+
+/**
+ * @brief Software timer multiplexed on LETIMER0 COMP1.
+ *
+ * Running timers are kept in a list sorted by deadline and COMP1 is always
+ * programmed for the head of that list. The deadline is kept as the LETIMER0
+ * period (UF rollover count) plus the tick offset into that period.
+ * The structure is owned by the caller, so any number of timers can exist.
+ */
+typedef struct soft_timer {
+  struct soft_timer *next;        /**< Next timer in the deadline queue */
+  uint32_t deadline_rollover;     /**< LETIMER0 period in which the timer expires */
+  uint32_t deadline_offset;       /**< Ticks into that period */
+  uint32_t period_ticks;          /**< Reload value for periodic timers, 0 for one-shot */
+  uint32_t period_frac;           /**< Fractional part of the period, in millionths of a tick */
+  uint32_t frac_acc;              /**< Accumulated fractional ticks, carried into the next reload */
+  uint32_t event;                 /**< Scheduler event bit(s) raised on expiry, 0 for none */
+  timer_callback_t callback;      /**< Called from the LETIMER0 ISR on expiry, may be NULL */
+  void *arg;                      /**< Argument passed to callback */
+  bool running;                   /**< True while the timer is in the deadline queue */
+} soft_timer_t;
+
+/** Static initializer for a soft_timer_t */
+#define SOFT_TIMER_INIT(evt, cb, cb_arg) \
+  { .next = NULL, .deadline_rollover = 0, .deadline_offset = 0, .period_ticks = 0, \
+    .period_frac = 0, .frac_acc = 0, .event = (evt), .callback = (cb), .arg = (cb_arg), .running = false }
+
 /**
  * @brief Initializes the Low Energy Timer (LETIMER0) with the specified configuration based on the lowest energy mode.
  *        Configures LETIMER0 to generate periodic interrupts and sets compare values.
@@ -28,13 +64,75 @@ void init_LETIMER0();
  *
  * @param us_wait The duration to wait in microseconds.
  * @note The function will wait for the specified duration using the LETIMER timer.
+ *       No driver calls it any more, it is kept only so a busy wait that comes back on
+ *       the BLE event path is counted by timerGetPolledWaitsOnEventPath(). Remove both
+ *       together.
  */
 void timerWaitUs_polled(uint32_t us_wait);
+
 /**
- * @brief Waits for a specified duration in microseconds using the LETIMER peripheral with interrupts.
- * @param us_wait The duration to wait in microseconds.
- *        It should be within the range [MIN_WAIT, MAX_WAIT].
+ * @brief Returns how many timerWaitUs_polled() calls ran from a BLE event handler.
+ *        Polled waits keep the core in EM0 and starve the stack, this must stay 0.
+ */
+uint32_t timerGetPolledWaitsOnEventPath(void);
+
+/**
+ * @brief Sets up a software timer.
+ * @param timer Timer to set up, must not be running.
+ * @param event Scheduler event bit(s) raised on expiry, 0 for none.
+ * @param callback Called from interrupt context on expiry, may be NULL.
+ * @param arg Argument passed to callback.
+ */
+void timerInit(soft_timer_t *timer, uint32_t event, timer_callback_t callback, void *arg);
+
+/**
+ * @brief (Re)starts a software timer. A running timer is restarted with the new timeout.
+ *
+ * Waits longer than one LETIMER0 period are counted in UF rollovers plus a COMP1
+ * remainder. A one-shot timeout is rounded up to whole ticks so it never expires
+ * early, a periodic timer carries the fraction of a tick from one reload to the
+ * next so its average period is exact.
+ *
+ * @param timer Timer to start.
+ * @param us_wait Timeout in microseconds, at least one tick is waited.
+ * @param periodic True to reload the timer with the same timeout on every expiry.
+ */
+void timerStart(soft_timer_t *timer, uint32_t us_wait, bool periodic);
+
+/**
+ * @brief Stops a software timer. Does nothing if the timer is not running.
+ * @param timer Timer to stop.
+ */
+void timerStop(soft_timer_t *timer);
+
+/**
+ * @brief Returns true while the timer is waiting to expire.
+ * @param timer Timer to check.
+ */
+bool timerIsRunning(const soft_timer_t *timer);
+
+/**
+ * @brief Returns the LETIMER0 ticks elapsed since init_LETIMER0(), monotonic.
+ *        Safe to call from any context, a UF still pending in the NVIC is accounted for.
+ */
+uint64_t timerGetTicks(void);
+
+/**
+ * @brief Returns the microseconds elapsed since init_LETIMER0(), monotonic.
+ *        Resolution is one LETIMER0 tick (61 us with the LFXO, 1 ms with the ULFRCO).
+ */
+uint64_t timerGetMicroseconds(void);
+
+/**
+ * @brief Counts an LETIMER0 underflow and services the timer queue.
+ *        Called from LETIMER0_IRQHandler() after the UF flag is cleared.
+ */
+void timerHandleUF(void);
+
+/**
+ * @brief Expires due timers and reprograms COMP1.
+ *        Called from LETIMER0_IRQHandler() after the COMP1 flag is cleared.
  */
-void timerWaitUs_irq(uint32_t us_wait);
+void timerHandleCOMP1(void);
 
 #endif /* SRC_TIMERS_H_ */
@@ -0,0 +1,359 @@
+#!/usr/bin/env python3
+#
+# gattdb_gen.py
+#
+#  Created on: 17-Oct-2026
+# Description: Rebuilds autogen/gatt_db.c and gatt_db.h from config/btconf, for trees where
+#              the Simplicity Studio GATT configurator (slc) is not available. It follows the
+#              layout the configurator emitted for this project: Generic Attribute service on
+#              handles 1-8, then the btconf services in file order, then the OTA service, with
+#              implicit CCCDs after indicate and notify values.
+#
+#              python3 gattdb_gen.py --check   compare with autogen/, exit 1 on a difference
+#              python3 gattdb_gen.py --write   regenerate autogen/gatt_db.c and gatt_db.h
+#
+#              Any btconf feature this project does not use (encrypted or authenticated
+#              properties, secondary services, includes, ...) is an error rather than a guess,
+#              regenerate with the configurator instead.
+#
+
+import os
+import sys
+import xml.etree.ElementTree as ET
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+BTCONF = [os.path.join(HERE, "..", "config", "btconf", "gatt_configuration.btconf"),
+          os.path.join(HERE, "..", "config", "btconf", "ota_dfu.xml")]
+AUTOGEN = os.path.join(HERE, "..", "autogen")
+
+UUID_PRIMARY = 0x2800
+UUID_SECONDARY = 0x2801
+UUID_CHARACTERISTIC = 0x2803
+UUID_CCCD = 0x2902
+
+PROP_BITS = {"read": 0x02, "write_no_response": 0x04, "write": 0x08,
+             "notify": 0x10, "indicate": 0x20}
+
+PERM_DISCOVERABLE = 0x800
+PERM_ADVERTISE = 0x8000
+PERM_READ = 0x01
+PERM_WRITE = 0x02
+PERM_READ_BONDED = 0x40
+PERM_NOTIFY_BONDED = 0x4000
+
+DT_CONST = 0x00
+DT_DYNAMIC = 0x01
+DT_CONFIG = 0x03
+DT_CHARACTERISTIC = 0x05
+DT_USER = 0x07
+
+
+class GenError(Exception):
+    pass
+
+
+def uuid_bytes(text):
+    """Little endian bytes of a 16-bit or 128-bit UUID, as the stack stores them"""
+    digits = text.replace("-", "")
+    if len(digits) not in (4, 32):
+        raise GenError("bad UUID " + text)
+    return bytes(reversed(bytes.fromhex(digits)))
+
+
+def value_bytes(node):
+    """Initial value of a characteristic or descriptor, padded to its length"""
+    value = node.find("value")
+    if value is None:
+        raise GenError("no value for " + node.get("name", "?"))
+    if value.get("variable_length") != "false":
+        raise GenError("variable length values are not supported: " + node.get("name", "?"))
+    length = int(value.get("length"))
+    kind = value.get("type")
+    text = (value.text or "").strip()
+
+    if kind == "user":
+        return kind, length, b""
+    if kind == "utf-8":
+        data = text.encode("utf-8")
+    elif kind == "hex":
+        data = bytes.fromhex(text)
+    else:
+        raise GenError("value type " + str(kind) + " is not supported")
+    if len(data) > length:
+        raise GenError("value longer than its length: " + node.get("name", "?"))
+    return kind, length, data + bytes(length - len(data))
+
+
+def properties(node):
+    """Characteristic property byte and value permissions"""
+    props = node.find("properties")
+    bits = 0
+    perms = PERM_DISCOVERABLE
+
+    for child in props:
+        if child.tag not in PROP_BITS:
+            raise GenError("property " + child.tag + " is not supported")
+        if child.get("authenticated") == "true" or child.get("encrypted") == "true":
+            raise GenError("authenticated or encrypted properties are not supported")
+        bonded = child.get("bonded") == "true"
+        bits |= PROP_BITS[child.tag]
+        if child.tag == "read":
+            perms |= PERM_READ | (PERM_READ_BONDED if bonded else 0)
+        elif child.tag in ("write", "write_no_response"):
+            if bonded:
+                raise GenError("bonded writes are not supported")
+            perms |= PERM_WRITE
+        elif bonded:
+            perms |= PERM_NOTIFY_BONDED
+    return bits, perms
+
+
+class Db:
+    def __init__(self):
+        self.attrs = []             # dicts, index + 1 is the handle
+        self.uuid16 = [UUID_PRIMARY, UUID_SECONDARY, UUID_CHARACTERISTIC]
+        self.uuid128 = []
+        self.ids = []               # (name, handle)
+        self.num_ccfg = 0
+
+    def uuid_index(self, text):
+        raw = uuid_bytes(text)
+        if len(raw) == 2:
+            uuid = int(text, 16)
+            if uuid not in self.uuid16:
+                self.uuid16.append(uuid)
+            return self.uuid16.index(uuid)
+        if raw not in self.uuid128:
+            self.uuid128.append(raw)
+        return 0x8000 + self.uuid128.index(raw)
+
+    def add(self, **attr):
+        self.attrs.append(attr)
+        return len(self.attrs)
+
+    def service(self, uuid, advertise):
+        perms = PERM_DISCOVERABLE | PERM_READ | (PERM_ADVERTISE if advertise else 0)
+        self.add(uuid=0, perms=perms, dt=DT_CONST, const=uuid_bytes(uuid))
+
+    def characteristic(self, uuid, bits, perms, kind, length, data, const, ident):
+        uuid_idx = self.uuid_index(uuid)
+        self.add(uuid=2, perms=PERM_DISCOVERABLE | PERM_READ, dt=DT_CHARACTERISTIC,
+                 props=bits, char_uuid=uuid_idx)
+        if kind == "user":
+            handle = self.add(uuid=uuid_idx, perms=perms, dt=DT_USER)
+        elif const:
+            handle = self.add(uuid=uuid_idx, perms=perms, dt=DT_CONST, const=data)
+        else:
+            handle = self.add(uuid=uuid_idx, perms=perms, dt=DT_DYNAMIC,
+                              props=bits, data=data)
+        if ident:
+            self.ids.append((ident, handle))
+        if bits & (PROP_BITS["notify"] | PROP_BITS["indicate"]):
+            flags = (0x02 if bits & PROP_BITS["indicate"] else 0) | \
+                    (0x01 if bits & PROP_BITS["notify"] else 0)
+            # registered on first use, explicit 2902 descriptors register it earlier
+            if UUID_CCCD in self.uuid16:
+                cccd = self.uuid16.index(UUID_CCCD)
+            else:
+                cccd = None
+            self.add(uuid=cccd, perms=PERM_DISCOVERABLE | PERM_READ | PERM_WRITE,
+                     dt=DT_CONFIG, flags=flags, ccfg=self.num_ccfg)
+            self.num_ccfg += 1
+
+
+def add_generic_attribute(db):
+    """The Generic Attribute service the configurator puts on handles 1-8"""
+    db.service("1801", False)
+    db.characteristic("2A05", 0x20, PERM_DISCOVERABLE, "hex", 4, bytes(4), False,
+                      "service_changed_char")
+    db.characteristic("2B2A", 0x02, PERM_DISCOVERABLE | PERM_READ, "hex", 16, bytes(16),
+                      False, "database_hash")
+    db.characteristic("2B29", 0x0a, PERM_DISCOVERABLE | PERM_READ | PERM_WRITE, "hex", 1,
+                      bytes(1), False, "client_support_features")
+
+
+def add_services(db, root):
+    for service in root.findall("service"):
+        if service.get("type") != "primary":
+            raise GenError("only primary services are supported")
+        db.service(service.get("uuid"), service.get("advertise") == "true")
+
+        for char in service.findall("characteristic"):
+            bits, perms = properties(char)
+            kind, length, data = value_bytes(char)
+            db.characteristic(char.get("uuid"), bits, perms, kind, length, data,
+                              char.get("const") == "true", char.get("id"))
+
+            for desc in char.findall("descriptor"):
+                if desc.get("uuid") == "2902":
+                    # folded into the CCCD the characteristic already has, only the UUID
+                    # table sees it
+                    db.uuid_index("2902")
+                    continue
+                dbits, dperms = properties(desc)
+                kind, length, data = value_bytes(desc)
+                handle = db.add(uuid=db.uuid_index(desc.get("uuid")), perms=dperms,
+                                dt=DT_CONST if desc.get("const") == "true" else DT_DYNAMIC,
+                                props=dbits, data=data, const=data)
+                if desc.get("id"):
+                    db.ids.append((desc.get("id"), handle))
+
+
+def build(paths):
+    roots = [ET.parse(p).getroot() for p in paths]
+    main = roots[0]
+
+    if main.get("generic_attribute_service") != "true" or main.get("gatt_caching") != "true":
+        raise GenError("the layout assumes generic_attribute_service and gatt_caching")
+
+    db = Db()
+    # handles: Generic Attribute first, but its UUIDs go after the btconf ones
+    gatt = Db()
+    add_generic_attribute(gatt)
+    for root in roots:
+        add_services(db, root)
+
+    # merge: UUID tables in processing order, btconf first, then Generic Attribute
+    if UUID_CCCD not in db.uuid16:
+        db.uuid16.append(UUID_CCCD)
+    for uuid in gatt.uuid16:
+        if uuid not in db.uuid16:
+            db.uuid16.append(uuid)
+
+    def remap(attr, table):
+        attr = dict(attr)
+        if attr["uuid"] is None:
+            attr["uuid"] = db.uuid16.index(UUID_CCCD)
+        elif attr["uuid"] < 0x8000:
+            attr["uuid"] = db.uuid16.index(table[attr["uuid"]])
+        if "char_uuid" in attr and attr["char_uuid"] < 0x8000:
+            attr["char_uuid"] = db.uuid16.index(table[attr["char_uuid"]])
+        return attr
+
+    gatt_attrs = [remap(a, gatt.uuid16) for a in gatt.attrs]
+    for a in gatt_attrs:
+        if a["dt"] == DT_CONFIG:
+            a["ccfg"] = 0
+    offset = len(gatt_attrs)
+    main_attrs = [remap(a, db.uuid16) for a in db.attrs]
+    for a in main_attrs:
+        if a["dt"] == DT_CONFIG:
+            a["ccfg"] += gatt.num_ccfg
+
+    db.attrs = gatt_attrs + main_attrs
+    db.ids = gatt.ids + [(n, h + offset) for n, h in db.ids]
+    db.num_ccfg += gatt.num_ccfg
+    return db
+
+
+def hexlist(data):
+    return "".join("0x%02x, " % b for b in data)
+
+
+def render_c(db):
+    out = []
+    out.append("/********************************************************************\n"
+               " * Autogenerated file, do not edit.\n"
+               " *******************************************************************/\n\n"
+               "#include <stdint.h>\n"
+               "#include \"sli_bt_gattdb_def.h\"\n\n"
+               "#define GATT_HEADER(F) F\n"
+               "#define GATT_DATA(F) F\n")
+    out.append("GATT_DATA(const uint16_t gattdb_uuidtable_16_map[]) =\n{\n")
+    out.extend("  0x%04x,\n" % u for u in db.uuid16)
+    out.append("};\n\n")
+    out.append("GATT_DATA(const uint8_t gattdb_uuidtable_128_map[]) =\n{\n")
+    out.extend("  %s\n" % hexlist(u) for u in db.uuid128)
+    out.append("};\n")
+
+    for index in reversed(range(len(db.attrs))):
+        a = db.attrs[index]
+        if a["dt"] == DT_CONST:
+            out.append("GATT_DATA(const sli_bt_gattdb_value_t gattdb_attribute_field_%d) = {\n"
+                       "  .len = %d,\n  .data = { %s}\n};\n"
+                       % (index, len(a["const"]), hexlist(a["const"])))
+        elif a["dt"] == DT_DYNAMIC:
+            out.append("GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_%d) = {\n"
+                       "  .properties = 0x%02x,\n  .max_len = %d,\n  .data = { %s},\n};\n"
+                       % (index, a["props"], len(a["data"]), hexlist(a["data"])))
+
+    out.append("\nGATT_DATA(const sli_bt_gattdb_attribute_t gattdb_attributes_map[]) = {\n")
+    for index, a in enumerate(db.attrs):
+        head = ("  { .handle = 0x%02x, .uuid = 0x%04x, .permissions = 0x%x, .caps = 0xffff, "
+                ".state = 0x00, .datatype = 0x%02x, " % (index + 1, a["uuid"], a["perms"], a["dt"]))
+        if a["dt"] == DT_CONST:
+            tail = ".constdata = &gattdb_attribute_field_%d" % index
+        elif a["dt"] == DT_DYNAMIC:
+            tail = ".dynamicdata = &gattdb_attribute_field_%d" % index
+        elif a["dt"] == DT_USER:
+            tail = ".dynamicdata = NULL"
+        elif a["dt"] == DT_CONFIG:
+            tail = ".configdata = { .flags = 0x%02x, .clientconfig_index = 0x%02x }" % (
+                a["flags"], a["ccfg"])
+        else:
+            tail = ".characteristic = { .properties = 0x%02x, .char_uuid = 0x%04x }" % (
+                a["props"], a["char_uuid"])
+        out.append(head + tail + " },\n")
+    out.append("};\n\n")
+
+    out.append("GATT_HEADER(const sli_bt_gattdb_t gattdb) = {\n"
+               "  .attributes = gattdb_attributes_map,\n"
+               "  .attribute_table_size = %d,\n  .attribute_num = %d,\n"
+               "  .uuid16 = gattdb_uuidtable_16_map,\n"
+               "  .uuid16_table_size = %d,\n  .uuid16_num = %d,\n"
+               "  .uuid128 = gattdb_uuidtable_128_map,\n"
+               "  .uuid128_table_size = %d,\n  .uuid128_num = %d,\n"
+               "  .num_ccfg = %d,\n  .caps_mask = 0xffff,\n  .enabled_caps = 0xffff,\n};\n"
+               "const sli_bt_gattdb_t *static_gattdb = &gattdb;\n"
+               % (len(db.attrs), len(db.attrs), len(db.uuid16), len(db.uuid16),
+                  len(db.uuid128), len(db.uuid128), db.num_ccfg))
+    return "".join(out)
+
+
+def render_h(db):
+    out = ["/********************************************************************\n"
+           " * Autogenerated file, do not edit.\n"
+           " *******************************************************************/\n\n"
+           "#ifndef __GATT_DB_H\n#define __GATT_DB_H\n\n"
+           "#include \"sli_bt_gattdb_def.h\"\n\n"
+           "extern const sli_bt_gattdb_t gattdb;\n\n"]
+    for name, handle in db.ids:
+        out.append("#define %-37s %d\n" % ("gattdb_" + name, handle))
+    out.append("\n\n#endif // __GATT_DB_H\n")
+    return "".join(out)
+
+
+def main(argv):
+    mode = argv[1] if len(argv) > 1 else "--check"
+    sources = argv[2:4] if len(argv) > 3 else BTCONF
+    outdir = argv[4] if len(argv) > 4 else AUTOGEN
+
+    try:
+        db = build(sources)
+    except GenError as err:
+        print("gattdb_gen.py: %s" % err)
+        return 2
+
+    files = {"gatt_db.c": render_c(db), "gatt_db.h": render_h(db)}
+    stale = []
+    for name, text in files.items():
+        path = os.path.join(outdir, name)
+        if mode == "--write":
+            with open(path, "w", newline="\n") as f:
+                f.write(text)
+            continue
+        with open(path, newline="") as f:
+            if f.read() != text:
+                stale.append(name)
+
+    if stale:
+        print("gattdb_gen.py: %s out of date with the btconf, run gattdb_gen.py --write"
+              % ", ".join(stale))
+        return 1
+    if mode != "--write":
+        print("gattdb_gen.py: ok")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
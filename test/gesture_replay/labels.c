@@ -0,0 +1,34 @@
+/*
+ * labels.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Gesture label names, in DIR_ order.
+ */
+
+#include <string.h>
+
+#include "src/SparkFun_APDS9960.h"
+#include "replay.h"
+
+static const char *const label_names[DIR_ALL] = {
+    "none", "left", "right", "up", "down", "near", "far",
+    "up_left", "up_right", "down_left", "down_right",
+    "uturn_up_down", "uturn_down_up", "uturn_left_right", "uturn_right_left",
+};
+
+const char *replay_label_name(int dir)
+{
+  return ((dir >= 0) && (dir < DIR_ALL)) ? label_names[dir] : "?";
+}
+
+int replay_label_from_name(const char *name)
+{
+  for (int dir = 0; dir < DIR_ALL; dir++)
+    {
+      if (strcmp(name, label_names[dir]) == 0)
+        {
+          return dir;
+        }
+    }
+  return -1;
+}
@@ -0,0 +1,485 @@
+/*
+ * replay.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Replays recorded gesture traces through the firmware decoder on the host.
+ *              src/SparkFun_APDS9960.c and src/gesture_decoder.c are linked unchanged:
+ *              every DATA frame is pushed to the gesture ring and handed to
+ *              processGestureData() as one FIFO read, decodeGesture() runs on the END
+ *              frame. Prints a confusion matrix and the decode time per gesture label,
+ *              and benchmarks the decoder in host cycles per dataset.
+ *
+ *              gesture_replay [--quiet] [--min-accuracy <percent>] <corpus dir>...
+ *
+ *              --min-accuracy fails the run when fewer gestures decode as their label.
+ *
+ *              A corpus dir holds one subdirectory per label (see labels.c), each with any
+ *              number of trace files. A trace file is the raw VCOM stream of a capture with
+ *              GESTURE_TRACE_ENABLE set, text log lines in between are skipped.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "src/SparkFun_APDS9960.h"
+#include "src/gesture_trace.h"
+#include "src/i2c.h"
+#include "src/gesture_decoder.h"
+#include "replay.h"
+
+/* Timed replays of each gesture, the decode of one gesture is too short to time once */
+#define REPLAY_TIMING_RUNS (200)
+
+/* Most datasets one gesture may hold, a 10 s hold at the dataset rate */
+#define REPLAY_MAX_DATASETS (4096)
+#define REPLAY_MAX_BATCHES  (1024)
+
+/* Result of decodeGesture(), a global of SparkFun_APDS9960.c */
+extern int gesture_motion;
+
+/* Platform the decoder file is linked against, none of it runs in a replay */
+const i2c_device_profile_t i2c_profile_apds9960;
+void gesture_trace_start(void) {}
+void gesture_trace_data(const uint8_t *fifo, uint8_t len) {}
+void gesture_trace_end(int motion) {}
+void schedulerSetEvent(uint32_t event) {}
+bool read_block_data_async(uint8_t reg, uint8_t *data, uint8_t len, uint32_t event,
+                           volatile I2C_TransferReturn_TypeDef *status) { return false; }
+size_t i2cWriteRegTableAsync(const i2c_device_profile_t *device,
+                             const i2c_reg_value_t *table, size_t count,
+                             uint32_t event, volatile I2C_TransferReturn_TypeDef *status)
+{
+  return 0;
+}
+
+/** One recorded gesture, the datasets of all its FIFO reads back to back */
+typedef struct {
+  int label;
+  int recorded;               ///< DIR_ value in the END frame, DIR_ALL if none
+  bool same_params;           ///< Recorded with the parameters compiled in here
+  uint16_t datasets;
+  uint16_t batches;
+  uint8_t *data;              ///< U D L R per dataset
+  uint16_t *batch_len;        ///< Datasets per FIFO read
+} gesture_t;
+
+static gesture_t *corpus;
+static size_t corpus_len;
+static size_t corpus_cap;
+static uint32_t bad_frames;
+
+/* Results per label */
+static uint32_t confusion[DIR_ALL][DIR_ALL];
+static uint32_t count[DIR_ALL];
+static uint32_t datasets[DIR_ALL];
+static double ns_sum[DIR_ALL];
+static double ns_max[DIR_ALL];
+static uint64_t cycles_sum[DIR_ALL];
+
+static gesture_t *corpus_add(int label)
+{
+  gesture_t *g;
+
+  if (corpus_len == corpus_cap)
+    {
+      corpus_cap = corpus_cap ? 2 * corpus_cap : 256;
+      corpus = realloc(corpus, corpus_cap * sizeof(*corpus));
+    }
+  g = &corpus[corpus_len++];
+  memset(g, 0, sizeof(*g));
+  g->label = label;
+  g->recorded = DIR_ALL;
+  g->data = malloc(REPLAY_MAX_DATASETS * 4);
+  g->batch_len = malloc(REPLAY_MAX_BATCHES * sizeof(uint16_t));
+  return g;
+}
+
+/**
+ * @brief Splits a capture into gestures. Frames are found by their sync bytes, a frame
+ *        with a bad sum is dropped, DATA frames outside START...END are ignored.
+ */
+static void load_trace(const char *path, int label)
+{
+  FILE *f = fopen(path, "rb");
+  uint8_t *buf;
+  long size;
+  gesture_t *g = NULL;
+
+  if (f == NULL)
+    {
+      perror(path);
+      return;
+    }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(size);
+  if (fread(buf, 1, size, f) != (size_t)size)
+    {
+      size = 0;
+    }
+  fclose(f);
+
+  for (long i = 0; i + 4 <= size; )
+    {
+      uint8_t type, len, sum = 0;
+      const uint8_t *payload;
+
+      if ((buf[i] != GESTURE_TRACE_SYNC0) || (buf[i + 1] != GESTURE_TRACE_SYNC1))
+        {
+          i++;
+          continue;
+        }
+      type = buf[i + 2];
+      len = buf[i + 3];
+      if ((len < 4) || (i + 4 + len + 1 > size))
+        {
+          i++;
+          continue;
+        }
+      for (long k = i + 2; k < i + 4 + len; k++)
+        {
+          sum += buf[k];
+        }
+      if (sum != buf[i + 4 + len])
+        {
+          bad_frames++;
+          i++;
+          continue;
+        }
+
+      // skip the timestamp, the replay runs as fast as it can
+      payload = &buf[i + 8];
+      len -= 4;
+      switch (type)
+        {
+          case GESTURE_TRACE_START:
+            g = corpus_add(label);
+            g->same_params = (len >= 3) && (payload[0] == GESTURE_THRESHOLD_OUT) &&
+                             (payload[1] == GESTURE_SENSITIVITY_1) &&
+                             (payload[2] == GESTURE_SENSITIVITY_2);
+            break;
+
+          case GESTURE_TRACE_DATA:
+            if ((g != NULL) && (g->batches < REPLAY_MAX_BATCHES) &&
+                (g->datasets + len / 4 <= REPLAY_MAX_DATASETS))
+              {
+                memcpy(&g->data[g->datasets * 4], payload, len & ~3);
+                g->datasets += len / 4;
+                g->batch_len[g->batches++] = len / 4;
+              }
+            break;
+
+          case GESTURE_TRACE_END:
+            if ((g != NULL) && (len >= 1))
+              {
+                g->recorded = payload[0];
+              }
+            g = NULL;
+            break;
+
+          default:
+            break;
+        }
+      i += 4 + buf[i + 3] + 1;
+    }
+
+  free(buf);
+}
+
+/** Loads every label directory of a corpus */
+static void load_corpus(const char *root)
+{
+  DIR *top = opendir(root);
+  struct dirent *label_ent;
+  char path[1024];
+
+  if (top == NULL)
+    {
+      perror(root);
+      return;
+    }
+  while ((label_ent = readdir(top)) != NULL)
+    {
+      int label = replay_label_from_name(label_ent->d_name);
+      DIR *dir;
+      struct dirent *file;
+
+      if (label_ent->d_name[0] == '.')
+        {
+          continue;
+        }
+      if (label < 0)
+        {
+          fprintf(stderr, "%s/%s: not a gesture label, skipped\n", root, label_ent->d_name);
+          continue;
+        }
+      snprintf(path, sizeof(path), "%s/%s", root, label_ent->d_name);
+      dir = opendir(path);
+      if (dir == NULL)
+        {
+          continue;
+        }
+      while ((file = readdir(dir)) != NULL)
+        {
+          if (file->d_name[0] == '.')
+            {
+              continue;
+            }
+          snprintf(path, sizeof(path), "%s/%s/%s", root, label_ent->d_name, file->d_name);
+          load_trace(path, label);
+        }
+      closedir(dir);
+    }
+  closedir(top);
+}
+
+/**
+ * @brief Feeds one gesture to the firmware decoder the way readGestureFifoDone() and
+ *        readGestureStep() do: ring push and processGestureData() per FIFO read,
+ *        decodeGesture() at the end.
+ * @return The decoded DIR_ value.
+ */
+static int replay_gesture(const gesture_t *g)
+{
+  gesture_data_type *ring = getGestureDataPtr();
+  const uint8_t *p = g->data;
+  int motion;
+
+  resetGestureParameters();
+  for (uint16_t b = 0; b < g->batches; b++)
+    {
+      for (uint16_t i = 0; i < g->batch_len[b]; i++, p += 4)
+        {
+          gestureRingPush(ring, p[0], p[1], p[2], p[3]);
+        }
+      processGestureData();
+    }
+  decodeGesture();
+  motion = gesture_motion;
+  resetGestureParameters();
+
+  return motion;
+}
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Host cycle counter, the TSC on x86. It ticks at a fixed rate, not the core
+ *        clock, so figures are comparable between runs on one machine only.
+ * @return Cycles, 0 where no counter is available.
+ */
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Benchmarks gesture_decoder_step() and gesture_decoder_result() alone over every
+ *        dataset of the corpus, without the ring and the batch bookkeeping around them.
+ */
+static void bench_decoder(void)
+{
+  gesture_decoder_t dec;
+  uint64_t total = 0;
+  uint64_t step_cycles = 0, result_cycles = 0;
+  double step_ns = 0.0;
+  volatile int sink = 0;
+
+  for (size_t n = 0; n < corpus_len; n++)
+    {
+      const gesture_t *g = &corpus[n];
+      uint64_t c0, c1, c2;
+      double t0, t1;
+
+      c0 = now_cycles();
+      t0 = now_ns();
+      for (int r = 0; r < REPLAY_TIMING_RUNS; r++)
+        {
+          gesture_decoder_reset(&dec);
+          for (uint16_t i = 0; i < g->datasets; i++)
+            {
+              const uint8_t *p = &g->data[i * 4];
+
+              gesture_decoder_step(&dec, p[0], p[1], p[2], p[3]);
+            }
+        }
+      c1 = now_cycles();
+      t1 = now_ns();
+      for (int r = 0; r < REPLAY_TIMING_RUNS; r++)
+        {
+          sink += gesture_decoder_result(&dec);
+        }
+      c2 = now_cycles();
+
+      step_cycles += c1 - c0;
+      result_cycles += c2 - c1;
+      step_ns += t1 - t0;
+      total += (uint64_t)g->datasets * REPLAY_TIMING_RUNS;
+    }
+
+  printf("decoder alone: %.1f ns per dataset", step_ns / total);
+  if (step_cycles != 0)
+    {
+      printf(", %.1f cycles per dataset, %.1f cycles per result",
+             (double)step_cycles / total,
+             (double)result_cycles / ((double)corpus_len * REPLAY_TIMING_RUNS));
+    }
+  printf("\n");
+  (void)sink;
+}
+
+/** Confusion matrix and the per label table */
+static void print_report(void)
+{
+  printf("%lu gestures, %lu bad frames skipped\n\n", (unsigned long)corpus_len,
+         (unsigned long)bad_frames);
+
+  printf("Confusion matrix, rows are labels, columns what the decoder returned\n%-19s", "");
+  for (int c = 0; c < DIR_ALL; c++)
+    {
+      printf("%4d", c);
+    }
+  printf("\n");
+  for (int r = 0; r < DIR_ALL; r++)
+    {
+      if (count[r] == 0)
+        {
+          continue;
+        }
+      printf("%2d %-16s", r, replay_label_name(r));
+      for (int c = 0; c < DIR_ALL; c++)
+        {
+          printf("%4lu", (unsigned long)confusion[r][c]);
+        }
+      printf("\n");
+    }
+
+  printf("\n%-19s %6s %8s %9s %12s %12s %12s\n", "label", "count", "correct", "datasets",
+         "decode ns", "max ns", "cyc/dataset");
+  for (int r = 0; r < DIR_ALL; r++)
+    {
+      if (count[r] == 0)
+        {
+          continue;
+        }
+      printf("%2d %-16s %6lu %7.1f%% %9.1f %12.0f %12.0f %12.1f\n", r, replay_label_name(r),
+             (unsigned long)count[r], 100.0 * confusion[r][r] / count[r],
+             (double)datasets[r] / count[r], ns_sum[r] / count[r], ns_max[r],
+             (double)cycles_sum[r] / datasets[r]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t correct = 0;
+  uint32_t checked = 0, agree = 0;
+  double min_accuracy = -1.0;
+  double accuracy;
+  bool quiet = false;
+  int i;
+
+  for (i = 1; (i < argc) && (strncmp(argv[i], "--", 2) == 0); i++)
+    {
+      if (strcmp(argv[i], "--quiet") == 0)
+        {
+          quiet = true;
+        }
+      else if ((strcmp(argv[i], "--min-accuracy") == 0) && (i + 1 < argc))
+        {
+          min_accuracy = atof(argv[++i]);
+        }
+      else
+        {
+          break;
+        }
+    }
+  if (i >= argc)
+    {
+      fprintf(stderr, "usage: %s [--quiet] [--min-accuracy <percent>] <corpus dir>...\n",
+              argv[0]);
+      return 2;
+    }
+  for ( ; i < argc; i++)
+    {
+      load_corpus(argv[i]);
+    }
+  if (corpus_len == 0)
+    {
+      fprintf(stderr, "no gestures found\n");
+      return 1;
+    }
+
+  for (size_t n = 0; n < corpus_len; n++)
+    {
+      const gesture_t *g = &corpus[n];
+      int motion = replay_gesture(g);
+      double t0, ns;
+      uint64_t c0;
+
+      t0 = now_ns();
+      c0 = now_cycles();
+      for (int r = 0; r < REPLAY_TIMING_RUNS; r++)
+        {
+          replay_gesture(g);
+        }
+      cycles_sum[g->label] += (now_cycles() - c0) / REPLAY_TIMING_RUNS;
+      ns = (now_ns() - t0) / REPLAY_TIMING_RUNS;
+
+      confusion[g->label][motion]++;
+      correct += (motion == g->label);
+      count[g->label]++;
+      datasets[g->label] += g->datasets;
+      ns_sum[g->label] += ns;
+      if (ns > ns_max[g->label])
+        {
+          ns_max[g->label] = ns;
+        }
+
+      // a capture with the same parameters has to decode as it did on the board
+      if ((g->recorded < DIR_ALL) && g->same_params)
+        {
+          checked++;
+          agree += (motion == g->recorded);
+        }
+    }
+
+  accuracy = 100.0 * correct / corpus_len;
+  if (!quiet)
+    {
+      print_report();
+      if (checked > 0)
+        {
+          printf("\nagrees with the on-board decode on %lu of %lu captures\n",
+                 (unsigned long)agree, (unsigned long)checked);
+        }
+      printf("\n");
+    }
+
+  bench_decoder();
+  printf("accuracy %.1f%% (%lu of %lu)\n", accuracy, (unsigned long)correct,
+         (unsigned long)corpus_len);
+  if (accuracy < min_accuracy)
+    {
+      printf("accuracy below %.1f%%\n", min_accuracy);
+      return 1;
+    }
+
+  return 0;
+}
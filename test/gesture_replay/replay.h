@@ -0,0 +1,22 @@
+/*
+ * replay.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Gesture label names shared by the replay harness and the synthetic corpus
+ *              writer. A corpus directory holds one subdirectory per label, named as here.
+ */
+
+#ifndef TEST_GESTURE_REPLAY_REPLAY_H_
+#define TEST_GESTURE_REPLAY_REPLAY_H_
+
+/**
+ * @brief Returns the directory name of a DIR_ value, "?" if out of range.
+ */
+const char *replay_label_name(int dir);
+
+/**
+ * @brief Returns the DIR_ value of a directory name, -1 if it is not a label.
+ */
+int replay_label_from_name(const char *name);
+
+#endif /* TEST_GESTURE_REPLAY_REPLAY_H_ */
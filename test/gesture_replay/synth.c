@@ -0,0 +1,211 @@
+/*
+ * synth.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Writes a synthetic gesture corpus in the GESTURE_TRACE_ENABLE capture format,
+ *              one directory per gesture label. A hand is modelled as a reflection moving
+ *              over the four photodiodes: each pair splits the overall brightness by the
+ *              position of the hand along its axis, the brightness rises as the hand comes
+ *              in and falls as it leaves, and every photodiode gets noise and a gain error.
+ *
+ *              The corpus exercises the harness and catches decoder regressions, it is not
+ *              a substitute for captures from the board. Those go in traces/<label>/.
+ *
+ *              gesture_synth <dir> [gestures per label]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "src/SparkFun_APDS9960.h"
+#include "src/gesture_trace.h"
+#include "replay.h"
+
+/* Datasets per DATA frame and their spacing, GFIFOTH_8 at GWTIME 2.8 ms */
+#define SYNTH_BATCH         (8)
+#define SYNTH_DATASET_US    (2800 + GESTURE_DATASET_PULSE_US)
+
+static uint32_t rng_state = 20261017;
+
+/** Deterministic generator, the corpus is the same on every run */
+static double rnd(void)
+{
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return (rng_state >> 8) / 16777216.0;
+}
+
+static double rnd_range(double lo, double hi)
+{
+  return lo + (hi - lo) * rnd();
+}
+
+/** Roughly normal, sum of uniforms */
+static double rnd_noise(double sigma)
+{
+  return (rnd() + rnd() + rnd() + rnd() - 2.0) * sigma * 1.7;
+}
+
+/** Frame writer, the same layout gesture_trace.c sends over VCOM */
+static void frame(FILE *f, uint8_t type, uint32_t t_us, const uint8_t *payload, uint8_t len)
+{
+  uint8_t head[8] = { GESTURE_TRACE_SYNC0, GESTURE_TRACE_SYNC1, type, (uint8_t)(len + 4),
+                      (uint8_t)t_us, (uint8_t)(t_us >> 8), (uint8_t)(t_us >> 16),
+                      (uint8_t)(t_us >> 24) };
+  uint8_t sum = 0;
+
+  for (int i = 2; i < 8; i++)
+    {
+      sum += head[i];
+    }
+  for (int i = 0; i < len; i++)
+    {
+      sum += payload[i];
+    }
+  fwrite(head, 1, sizeof(head), f);
+  fwrite(payload, 1, len, f);
+  fwrite(&sum, 1, 1, f);
+}
+
+static uint8_t clamp_u8(double v)
+{
+  return (v < 0.0) ? 0 : (v > 255.0) ? 255 : (uint8_t)lround(v);
+}
+
+/**
+ * @brief Path of the hand for a label: position (x, y) in -1..1 and brightness scale
+ *        at progress p in 0..1. x grows towards RIGHT, y towards DOWN as in the decoder.
+ */
+static void path(int label, double p, double angle, double *x, double *y, double *scale)
+{
+  double s = -1.0 + 2.0 * p;              // straight swipe, edge to edge
+  double out = sin(M_PI * p);             // U-turn, out and back
+  double ca = cos(angle);
+  double sa = sin(angle);
+  double along = 0.0;
+  double dx = 0.0, dy = 0.0;
+
+  *scale = 1.0;
+  switch (label)
+    {
+      case DIR_LEFT:  dx = -1; along = s; break;
+      case DIR_RIGHT: dx =  1; along = s; break;
+      case DIR_UP:    dy = -1; along = s; break;
+      case DIR_DOWN:  dy =  1; along = s; break;
+      case DIR_UP_LEFT:    dx = -M_SQRT1_2; dy = -M_SQRT1_2; along = s; break;
+      case DIR_UP_RIGHT:   dx =  M_SQRT1_2; dy = -M_SQRT1_2; along = s; break;
+      case DIR_DOWN_LEFT:  dx = -M_SQRT1_2; dy =  M_SQRT1_2; along = s; break;
+      case DIR_DOWN_RIGHT: dx =  M_SQRT1_2; dy =  M_SQRT1_2; along = s; break;
+      case DIR_UTURN_UP_DOWN:    dy = -1; along = out; break;
+      case DIR_UTURN_DOWN_UP:    dy =  1; along = out; break;
+      case DIR_UTURN_LEFT_RIGHT: dx = -1; along = out; break;
+      case DIR_UTURN_RIGHT_LEFT: dx =  1; along = out; break;
+      case DIR_NEAR: *scale = 0.6 + 0.6 * p; break;
+      case DIR_FAR:  *scale = 1.2 - 0.6 * p; break;
+      default: break;
+    }
+
+  // the direction is rotated by the jitter angle, a real hand never moves straight
+  *x = along * (dx * ca - dy * sa);
+  *y = along * (dx * sa + dy * ca);
+}
+
+/**
+ * @brief Writes one gesture: START, DATA frames of SYNTH_BATCH datasets, END.
+ */
+static void write_gesture(FILE *f, int label, uint32_t *t_us)
+{
+  static const uint8_t params[4] = { GESTURE_THRESHOLD_OUT, GESTURE_SENSITIVITY_1,
+                                     GESTURE_SENSITIVITY_2, GESTURE_CAPTURE_MODE };
+  bool hold = (label == DIR_NEAR) || (label == DIR_FAR) || (label == DIR_NONE);
+  int datasets = hold ? (int)rnd_range(40, 90) : (int)rnd_range(10, 70);
+  double peak = rnd_range(60, 230);
+  double contrast = rnd_range(0.5, 0.9);
+  double angle = rnd_range(-0.26, 0.26);
+  double gain[4];
+  double ox = rnd_noise(0.08), oy = rnd_noise(0.08);
+  uint8_t batch[SYNTH_BATCH * 4];
+  int n = 0;
+
+  for (int i = 0; i < 4; i++)
+    {
+      gain[i] = rnd_range(0.9, 1.1);
+    }
+  if (label == DIR_NONE)
+    {
+      // a hand hovering at the edge of the range, barely above the threshold
+      peak = rnd_range(GESTURE_THRESHOLD_OUT + 2, GESTURE_THRESHOLD_OUT + 20);
+    }
+
+  frame(f, GESTURE_TRACE_START, *t_us, params, sizeof(params));
+  for (int k = 0; k < datasets; k++)
+    {
+      double p = (double)k / (datasets - 1);
+      double x, y, scale;
+      double env;
+      double b;
+
+      path(label, p, angle, &x, &y, &scale);
+      x += ox;
+      y += oy;
+      // swipes come into range and leave again, holds stay in range
+      env = hold ? 1.0 : pow(sin(M_PI * (0.05 + 0.9 * p)), 0.5);
+      b = peak * env * scale;
+
+      batch[n * 4 + 0] = clamp_u8(gain[0] * b * (1.0 + contrast * y) + rnd_noise(2.0));
+      batch[n * 4 + 1] = clamp_u8(gain[1] * b * (1.0 - contrast * y) + rnd_noise(2.0));
+      batch[n * 4 + 2] = clamp_u8(gain[2] * b * (1.0 + contrast * x) + rnd_noise(2.0));
+      batch[n * 4 + 3] = clamp_u8(gain[3] * b * (1.0 - contrast * x) + rnd_noise(2.0));
+      n++;
+      *t_us += SYNTH_DATASET_US;
+
+      if ((n == SYNTH_BATCH) || (k == datasets - 1))
+        {
+          frame(f, GESTURE_TRACE_DATA, *t_us, batch, (uint8_t)(n * 4));
+          n = 0;
+        }
+    }
+  // the decoder's answer is not known here, DIR_ALL marks the END frame as synthetic
+  frame(f, GESTURE_TRACE_END, *t_us, (const uint8_t[]){ DIR_ALL }, 1);
+  *t_us += 500000;
+}
+
+int main(int argc, char **argv)
+{
+  int per_label = (argc > 2) ? atoi(argv[2]) : 40;
+  char path_buf[512];
+  uint32_t t_us = 0;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "usage: %s <dir> [gestures per label]\n", argv[0]);
+      return 2;
+    }
+  mkdir(argv[1], 0777);
+
+  for (int label = DIR_NONE; label < DIR_ALL; label++)
+    {
+      FILE *f;
+
+      snprintf(path_buf, sizeof(path_buf), "%s/%s", argv[1], replay_label_name(label));
+      mkdir(path_buf, 0777);
+      snprintf(path_buf, sizeof(path_buf), "%s/%s/synthetic.bin", argv[1],
+               replay_label_name(label));
+      f = fopen(path_buf, "wb");
+      if (f == NULL)
+        {
+          perror(path_buf);
+          return 1;
+        }
+      for (int i = 0; i < per_label; i++)
+        {
+          write_gesture(f, label, &t_us);
+        }
+      fclose(f);
+    }
+
+  return 0;
+}
@@ -0,0 +1,7 @@
+/* Host stand-in for the SDK app_log.h: firmware logging is dropped in the tests */
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+#define app_log(...) ((void)0)
+
+#endif
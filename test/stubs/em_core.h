@@ -0,0 +1,16 @@
+/* Host stand-in for emlib em_core.h. Declares irqState like the real macro so a
+   second CORE_DECLARE_IRQ_STATE in one scope fails to compile here as well. */
+#ifndef EM_CORE_H
+#define EM_CORE_H
+
+#include <stdint.h>
+
+typedef uint32_t CORE_irqState_t;
+
+#define CORE_DECLARE_IRQ_STATE   CORE_irqState_t irqState
+#define CORE_ENTER_CRITICAL()    ((void)(irqState = 1))
+#define CORE_EXIT_CRITICAL()     ((void)irqState)
+#define CORE_ENTER_ATOMIC()      ((void)(irqState = 1))
+#define CORE_EXIT_ATOMIC()       ((void)irqState)
+
+#endif
@@ -0,0 +1,62 @@
+/* Host stand-in for emlib em_gpio.h. Interrupt flags and pin levels are plain
+   variables the tests set before calling a handler. */
+#ifndef EM_GPIO_H
+#define EM_GPIO_H
+
+#include <stdint.h>
+
+typedef enum {
+  gpioPortA = 0,
+  gpioPortB = 1,
+  gpioPortC = 2,
+  gpioPortD = 3,
+  gpioPortE = 4,
+  gpioPortF = 5
+} GPIO_Port_TypeDef;
+
+typedef enum {
+  gpioModeDisabled,
+  gpioModeInput,
+  gpioModeInputPull,
+  gpioModePushPull
+} GPIO_Mode_TypeDef;
+
+typedef enum {
+  gpioDriveStrengthWeakAlternateWeak,
+  gpioDriveStrengthStrongAlternateStrong
+} GPIO_DriveStrength_TypeDef;
+
+extern uint32_t fake_gpio_if;          ///< Pending interrupt flags
+extern uint32_t fake_gpio_ien;         ///< Enabled interrupts
+extern uint8_t  fake_gpio_in[6][16];   ///< Input level per port and pin
+
+static inline uint32_t GPIO_IntGetEnabled(void)
+{
+  return fake_gpio_if & fake_gpio_ien;
+}
+
+static inline void GPIO_IntClear(uint32_t flags)
+{
+  fake_gpio_if &= ~flags;
+}
+
+static inline void GPIO_IntDisable(uint32_t flags)
+{
+  fake_gpio_ien &= ~flags;
+}
+
+/* Pin setup and outputs are not modelled */
+static inline void GPIO_DriveStrengthSet(GPIO_Port_TypeDef port, GPIO_DriveStrength_TypeDef strength) {}
+static inline void GPIO_PinModeSet(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode,
+                                   unsigned int out) {}
+static inline void GPIO_PinOutSet(GPIO_Port_TypeDef port, unsigned int pin) {}
+static inline void GPIO_PinOutClear(GPIO_Port_TypeDef port, unsigned int pin) {}
+static inline void GPIO_ExtIntConfig(GPIO_Port_TypeDef port, unsigned int pin, unsigned int intNo,
+                                     int risingEdge, int fallingEdge, int enable) {}
+
+static inline unsigned int GPIO_PinInGet(GPIO_Port_TypeDef port, unsigned int pin)
+{
+  return fake_gpio_in[port][pin];
+}
+
+#endif
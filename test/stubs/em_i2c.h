@@ -0,0 +1,39 @@
+/* Host stand-in for emlib em_i2c.h, types and constants only */
+#ifndef EM_I2C_H
+#define EM_I2C_H
+
+#include <stdint.h>
+
+#define I2C_FREQ_STANDARD_MAX   92000
+
+#define I2C_FLAG_WRITE          0x0001
+#define I2C_FLAG_READ           0x0002
+#define I2C_FLAG_WRITE_READ     0x0004
+#define I2C_FLAG_WRITE_WRITE    0x0008
+
+typedef enum {
+  i2cClockHLRStandard  = 0,
+  i2cClockHLRAsymetric = 1,
+  i2cClockHLRFast      = 2
+} I2C_ClockHLR_TypeDef;
+
+typedef enum {
+  i2cTransferInProgress = 1,
+  i2cTransferDone       = 0,
+  i2cTransferNack       = -1,
+  i2cTransferBusErr     = -2,
+  i2cTransferArbLost    = -3,
+  i2cTransferUsageFault = -4,
+  i2cTransferSwFault    = -5
+} I2C_TransferReturn_TypeDef;
+
+typedef struct {
+  uint16_t addr;
+  uint16_t flags;
+  struct {
+    uint8_t  *data;
+    uint16_t len;
+  } buf[2];
+} I2C_TransferSeq_TypeDef;
+
+#endif
@@ -0,0 +1,64 @@
+/* Host stand-in for emlib em_letimer.h. LETIMER0 is a plain struct the tests
+   drive: CNT counts down from COMP0 and IF holds the pending flags. */
+#ifndef EM_LETIMER_H
+#define EM_LETIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+  uint32_t CNT;
+  uint32_t COMP0;
+  uint32_t COMP1;
+  uint32_t IF;
+  uint32_t IEN;
+} LETIMER_TypeDef;
+
+extern LETIMER_TypeDef fake_letimer0;
+
+#define LETIMER0 (&fake_letimer0)
+
+#define LETIMER_IF_COMP0   0x1UL
+#define LETIMER_IF_COMP1   0x2UL
+#define LETIMER_IF_UF      0x4UL
+#define LETIMER_IEN_COMP0  LETIMER_IF_COMP0
+#define LETIMER_IEN_COMP1  LETIMER_IF_COMP1
+#define LETIMER_IEN_UF     LETIMER_IF_UF
+#define LETIMER_IFC_COMP1  LETIMER_IF_COMP1
+#define LETIMER_IFC_UF     LETIMER_IF_UF
+
+typedef enum { letimerUFOANone } LETIMER_UFOA_TypeDef;
+typedef enum { letimerRepeatFree } LETIMER_RepeatMode_TypeDef;
+
+typedef struct {
+  bool enable;
+  bool debugRun;
+  bool comp0Top;
+  bool bufTop;
+  uint8_t out0Pol;
+  uint8_t out1Pol;
+  LETIMER_UFOA_TypeDef ufoa0;
+  LETIMER_UFOA_TypeDef ufoa1;
+  LETIMER_RepeatMode_TypeDef repMode;
+  uint32_t topValue;
+} LETIMER_Init_TypeDef;
+
+static inline void LETIMER_Init(LETIMER_TypeDef *t, const LETIMER_Init_TypeDef *init) { (void)t; (void)init; }
+static inline void LETIMER_Enable(LETIMER_TypeDef *t, bool enable) { (void)t; (void)enable; }
+static inline uint32_t LETIMER_CounterGet(LETIMER_TypeDef *t) { return t->CNT; }
+static inline uint32_t LETIMER_IntGet(LETIMER_TypeDef *t) { return t->IF; }
+static inline uint32_t LETIMER_IntGetEnabled(LETIMER_TypeDef *t) { return t->IF & t->IEN; }
+static inline void LETIMER_IntClear(LETIMER_TypeDef *t, uint32_t flags) { t->IF &= ~flags; }
+static inline void LETIMER_IntEnable(LETIMER_TypeDef *t, uint32_t flags) { t->IEN |= flags; }
+static inline void LETIMER_IntDisable(LETIMER_TypeDef *t, uint32_t flags) { t->IEN &= ~flags; }
+
+static inline void LETIMER_CompareSet(LETIMER_TypeDef *t, unsigned int comp, uint32_t value)
+{
+  if (comp == 0) {
+    t->COMP0 = value;
+  } else {
+    t->COMP1 = value;
+  }
+}
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for the SDK sl_bgapi.h */
+#ifndef SL_BGAPI_H
+#define SL_BGAPI_H
+
+#include <stdint.h>
+
+#define SL_BGAPI_MSG_ID(HDR) ((HDR) & 0xffff00f8)
+
+#endif
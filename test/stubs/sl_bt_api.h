@@ -0,0 +1,32 @@
+/* Host stand-in for the SDK sl_bt_api.h, only what the scheduler core and ble.h use */
+#ifndef SL_BT_API_H
+#define SL_BT_API_H
+
+#include <stdint.h>
+#include "sl_status.h"
+#include "sl_bgapi.h"
+
+typedef struct {
+  uint8_t addr[6];
+} bd_addr;
+
+#define sl_bt_evt_system_external_signal_id 0x030000a0
+#define sl_bt_evt_system_boot_id            0x000000a0
+
+typedef struct {
+  uint32_t extsignals;
+} sl_bt_evt_system_external_signal_t;
+
+typedef struct {
+  uint32_t header;
+  union {
+    sl_bt_evt_system_external_signal_t evt_system_external_signal;
+    uint8_t payload[32];
+  } data;
+} sl_bt_msg_t;
+
+#define SL_BT_MSG_ID(HDR) SL_BGAPI_MSG_ID(HDR)
+
+sl_status_t sl_bt_external_signal(uint32_t signals);
+
+#endif
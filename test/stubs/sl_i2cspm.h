@@ -0,0 +1,8 @@
+/* Host stand-in for the SDK sl_i2cspm.h */
+#ifndef SL_I2CSPM_H
+#define SL_I2CSPM_H
+
+#include "em_gpio.h"
+#include "em_i2c.h"
+
+#endif
@@ -0,0 +1,12 @@
+/* Host stand-in for the SDK sl_status.h */
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK   ((sl_status_t)0x0000)
+#define SL_STATUS_FAIL ((sl_status_t)0x0001)
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * test.h
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Minimal check macros for the host tests. Every test is its own
+ *              program, it prints the failed checks and exits non-zero.
+ */
+
+#ifndef TEST_TEST_H_
+#define TEST_TEST_H_
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long long check_a = (long long)(a), check_b = (long long)(b); \
+    if (check_a != check_b) { \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+             __FILE__, __LINE__, #a, #b, check_a, check_b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+/** Ends main(): prints the result and gives make the exit status */
+#define TEST_DONE() \
+  do { \
+    printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "ok"); \
+    return test_failures ? 1 : 0; \
+  } while (0)
+
+#endif /* TEST_TEST_H_ */
@@ -0,0 +1,210 @@
+/*
+ * test_apds9960_config.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Host test of the APDS9960 configuration jobs against a fake register
+ *              file. The fake I2C layer applies a queued read or batch at once and
+ *              raises Evt_GestureConfig on the next turn, batches are cut after
+ *              I2C_REG_TABLE_MAX_BURSTS bursts as the engine does. Covers enable,
+ *              disable, a wrong device ID, a failed batch and a job started twice.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "src/SparkFun_APDS9960.h"
+#include "src/gesture_trace.h"
+#include "src/i2c.h"
+#include "src/scheduler.h"
+
+/* ENABLE and GCONF4 bits checked after a job */
+#define ENABLE_PON    (0x01)
+#define ENABLE_GEN    (0x40)
+#define GCONF4_GMODE  (0x01)
+#define GCONF4_GIEN   (0x02)
+
+const i2c_device_profile_t i2c_profile_apds9960;
+void gesture_trace_start(void) {}
+void gesture_trace_data(const uint8_t *fifo, uint8_t len) {}
+void gesture_trace_end(int motion) {}
+
+/* Fake device and I2C layer */
+static uint8_t dev_regs[256];
+static bool event_pending;                  ///< Evt_GestureConfig raised since the last turn
+static bool transfer_pending;               ///< A read or batch waits for its event
+static bool queue_full;                     ///< Nothing can be queued
+static int fail_batch;                      ///< Batch answered with a NACK, -1 for none
+static int batches;
+static int writes;
+
+static void dev_reset(uint8_t id)
+{
+  memset(dev_regs, 0, sizeof(dev_regs));
+  dev_regs[APDS9960_ID] = id;
+  event_pending = false;
+  transfer_pending = false;
+  queue_full = false;
+  fail_batch = -1;
+  batches = 0;
+  writes = 0;
+}
+
+void schedulerSetEvent(uint32_t event)
+{
+  CHECK_EQ(event, Evt_GestureConfig);
+  CHECK(!event_pending);
+  event_pending = true;
+}
+
+bool read_block_data_async(uint8_t reg, uint8_t *data, uint8_t len, uint32_t event,
+                           volatile I2C_TransferReturn_TypeDef *status)
+{
+  CHECK(!transfer_pending);
+  if( queue_full ) {
+      return false;
+  }
+  memcpy(data, &dev_regs[reg], len);
+  *status = i2cTransferDone;
+  transfer_pending = true;
+  return true;
+}
+
+size_t i2cWriteRegTableAsync(const i2c_device_profile_t *device,
+                             const i2c_reg_value_t *table, size_t count,
+                             uint32_t event, volatile I2C_TransferReturn_TypeDef *status)
+{
+  size_t i;
+  int bursts = 0;
+
+  CHECK(!transfer_pending);
+  CHECK(count > 0);
+  CHECK_EQ(event, Evt_GestureConfig);
+  if( queue_full ) {
+      return 0;
+  }
+
+  for( i = 0; i < count; i++ ) {
+      if( (i == 0) || (table[i].reg != table[i - 1].reg + 1) ) {
+          if( bursts == I2C_REG_TABLE_MAX_BURSTS ) {
+              break;
+          }
+          bursts++;
+      }
+      dev_regs[table[i].reg] = table[i].value;
+      writes++;
+  }
+
+  *status = (batches == fail_batch) ? i2cTransferNack : i2cTransferDone;
+  batches++;
+  transfer_pending = true;
+  return i;
+}
+
+/** Finishes the transfer on the bus, true if Evt_GestureConfig is raised */
+static bool pump(void)
+{
+  if( transfer_pending ) {
+      transfer_pending = false;
+      event_pending = true;
+  }
+  if( event_pending ) {
+      event_pending = false;
+      return true;
+  }
+  return false;
+}
+
+/** Steps a started job to its end */
+static int run(void)
+{
+  int turns = 0;
+  int r = GESTURE_CONFIG_PENDING;
+
+  while( (r == GESTURE_CONFIG_PENDING) && (turns++ < 100) ) {
+      CHECK(pump());
+      r = gestureConfigStep();
+  }
+  CHECK(!transfer_pending);
+  return r;
+}
+
+static void test_enable(void)
+{
+  dev_reset(APDS9960_ID_1);
+  CHECK(enableGestureSensorAsync(true));
+  CHECK_EQ(run(), GESTURE_CONFIG_ON);
+
+  CHECK_EQ(dev_regs[APDS9960_ENABLE] & (ENABLE_PON | ENABLE_GEN), ENABLE_PON | ENABLE_GEN);
+  CHECK_EQ(dev_regs[APDS9960_GCONF4] & (GCONF4_GMODE | GCONF4_GIEN), GCONF4_GMODE | GCONF4_GIEN);
+  CHECK_EQ(dev_regs[APDS9960_GPENTH], DEFAULT_GPENTH);
+  CHECK_EQ(dev_regs[APDS9960_WTIME], 0xFF);
+  // the init and enable writes do not fit one batch
+  CHECK(batches > 1);
+}
+
+static void test_disable(void)
+{
+  dev_reset(APDS9960_ID_2);
+  CHECK(enableGestureSensorAsync(false));
+  CHECK_EQ(run(), GESTURE_CONFIG_ON);
+  CHECK_EQ(dev_regs[APDS9960_GCONF4] & GCONF4_GIEN, 0);
+
+  batches = 0;
+  CHECK(disableGestureSensorAsync());
+  CHECK_EQ(run(), GESTURE_CONFIG_OFF);
+  CHECK_EQ(dev_regs[APDS9960_ENABLE] & (ENABLE_PON | ENABLE_GEN), ENABLE_PON);
+  CHECK_EQ(dev_regs[APDS9960_GCONF4] & GCONF4_GMODE, 0);
+  // the writes come from the shadow copy, nothing else is read
+  CHECK_EQ(batches, 1);
+}
+
+static void test_wrong_id(void)
+{
+  dev_reset(0x00);
+  CHECK(enableGestureSensorAsync(true));
+  CHECK_EQ(run(), ERROR);
+  CHECK_EQ(writes, 0);
+}
+
+static void test_failed_batch(void)
+{
+  dev_reset(APDS9960_ID_1);
+  fail_batch = 1;
+  CHECK(enableGestureSensorAsync(true));
+  CHECK_EQ(run(), ERROR);
+  CHECK_EQ(batches, 2);
+
+  // the shadow copy is read again, the next job gets the engine on
+  fail_batch = -1;
+  CHECK(enableGestureSensorAsync(true));
+  CHECK_EQ(run(), GESTURE_CONFIG_ON);
+  CHECK_EQ(dev_regs[APDS9960_ENABLE] & ENABLE_GEN, ENABLE_GEN);
+}
+
+static void test_busy(void)
+{
+  dev_reset(APDS9960_ID_1);
+
+  // a full queue fails the start and leaves no job behind
+  queue_full = true;
+  CHECK(!enableGestureSensorAsync(true));
+  queue_full = false;
+
+  CHECK(enableGestureSensorAsync(true));
+  CHECK(!enableGestureSensorAsync(true));
+  CHECK(!disableGestureSensorAsync());
+  CHECK_EQ(run(), GESTURE_CONFIG_ON);
+  CHECK(disableGestureSensorAsync());
+  CHECK_EQ(run(), GESTURE_CONFIG_OFF);
+}
+
+int main(void)
+{
+  test_enable();
+  test_disable();
+  test_wrong_id();
+  test_failed_batch();
+  test_busy();
+
+  TEST_DONE();
+}
@@ -0,0 +1,395 @@
+/*
+ * test_max32664_seq.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Host test of the MAX32664 command sequencer against a scripted fake
+ *              sensor hub. The fake I2C layer finishes one queued transfer per turn and
+ *              raises Evt_OximeterI2C, the fake soft timer raises Evt_OximeterSeqTimer, and
+ *              the hub answers every read with the status its script gives. Covers the
+ *              retry, failure and warm-to-cold fallback paths.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "src/pulse_oximeter.h"
+#include "src/scheduler.h"
+#include "src/timers.h"
+
+uint32_t fake_gpio_if;
+uint32_t fake_gpio_ien;
+uint8_t fake_gpio_in[6][16];
+
+/* Fake sensor hub */
+
+#define HUB_LOG_LEN 64
+#define HUB_SCRIPT_LEN 8
+
+/** Status a command is answered with, one entry per attempt, the last one repeats */
+typedef struct {
+  uint8_t family;
+  uint8_t index;
+  uint8_t statuses[HUB_SCRIPT_LEN];
+  uint8_t count;
+} hub_script_t;
+
+static struct {
+  bool configured;                  ///< Output mode set since the last reset
+  hub_script_t script[4];           ///< Scripted answers, unscripted commands answer 0x00
+  uint8_t script_count;
+  uint8_t attempts[256][4];         ///< Writes seen per family and index (index < 4)
+  uint8_t last_family;              ///< Command the next read answers
+  uint8_t last_index;
+  uint8_t log[HUB_LOG_LEN][4];      ///< family, index, first payload byte, payload length
+  uint8_t log_count;
+  uint32_t reads;
+} hub;
+
+/* Fake I2C layer: one transfer in flight, finished by pump() */
+typedef enum { XFER_NONE, XFER_WRITE, XFER_READ } xfer_kind_t;
+
+static xfer_kind_t xfer_kind;
+static uint32_t extra_pending;      ///< Other sensor hub transfers still queued
+static uint8_t hub_status;          ///< Status byte of the last response
+
+/* Fake soft timer */
+static bool timer_armed;
+static uint32_t timer_us;
+static uint64_t now_us;              ///< Sum of the delays waited for
+
+static void hub_reset(bool configured)
+{
+  memset(&hub, 0, sizeof(hub));
+  hub.configured = configured;
+  xfer_kind = XFER_NONE;
+  extra_pending = 0;
+  timer_armed = false;
+}
+
+static void hub_script(uint8_t family, uint8_t index, const uint8_t *statuses, uint8_t count)
+{
+  hub_script_t *s = &hub.script[hub.script_count++];
+
+  s->family = family;
+  s->index = index;
+  memcpy(s->statuses, statuses, count);
+  s->count = count;
+}
+
+/** The hub's answer to the command written last */
+static uint8_t hub_answer(void)
+{
+  uint8_t attempt = hub.attempts[hub.last_family][hub.last_index & 3] - 1;
+
+  for (uint8_t i = 0; i < hub.script_count; i++)
+    {
+      const hub_script_t *s = &hub.script[i];
+
+      if ((s->family == hub.last_family) && (s->index == hub.last_index))
+        {
+          return s->statuses[(attempt < s->count) ? attempt : (s->count - 1)];
+        }
+    }
+
+  // a reset hub does not know the AFE enable until its output mode is set
+  if ((hub.last_family == 0x44) && !hub.configured)
+    {
+      return 0x01;
+    }
+  return 0x00;
+}
+
+void I2C_write_pulse(const uint8_t *cmd, int arr_length)
+{
+  CHECK_EQ(xfer_kind, XFER_NONE);
+  CHECK(arr_length >= 2);
+
+  hub.last_family = cmd[0];
+  hub.last_index = cmd[1];
+  hub.attempts[cmd[0]][cmd[1] & 3]++;
+  if (hub.log_count < HUB_LOG_LEN)
+    {
+      hub.log[hub.log_count][0] = cmd[0];
+      hub.log[hub.log_count][1] = cmd[1];
+      hub.log[hub.log_count][2] = (arr_length > 2) ? cmd[2] : 0;
+      hub.log[hub.log_count][3] = (uint8_t)(arr_length - 2);
+      hub.log_count++;
+    }
+  if ((cmd[0] == 0x10) && (cmd[1] == 0x00))
+    {
+      hub.configured = true;
+    }
+  xfer_kind = XFER_WRITE;
+}
+
+void I2C_read_pulse(uint8_t len, uint32_t event, bool check_return)
+{
+  CHECK_EQ(xfer_kind, XFER_NONE);
+  CHECK_EQ(event, 0);
+  CHECK(len >= 1);
+  xfer_kind = XFER_READ;
+  hub.reads++;
+}
+
+uint32_t I2C_pulse_pending()
+{
+  return ((xfer_kind != XFER_NONE) ? 1 : 0) + extra_pending;
+}
+
+uint8_t I2C_pulse_status()
+{
+  return hub_status;
+}
+
+void timerStart(soft_timer_t *timer, uint32_t us_wait, bool periodic)
+{
+  CHECK(!periodic);
+  CHECK_EQ(timer->event, Evt_OximeterSeqTimer);
+  timer_armed = true;
+  timer_us = us_wait;
+}
+
+void timerStop(soft_timer_t *timer)
+{
+  timer_armed = false;
+}
+
+/**
+ * @brief Lets the next thing happen: the transfer on the bus finishes, else the timer
+ *        expires. Unrelated events are fed in between, the sequencer must ignore them.
+ * @return The event the oximeter state machine gets.
+ */
+static uint32_t pump(void)
+{
+  CHECK_EQ(max32664_seq_handle_event(LETIMER0_UF), MAX32664_SEQ_RUNNING);
+  CHECK_EQ(max32664_seq_handle_event(Evt_OximeterMfio), MAX32664_SEQ_RUNNING);
+  // the state machine timer of scheduler.c, a stale one must not end a command delay
+  CHECK_EQ(max32664_seq_handle_event(Evt_OximeterTimer), MAX32664_SEQ_RUNNING);
+
+  if (xfer_kind == XFER_READ)
+    {
+      hub_status = hub_answer();
+      xfer_kind = XFER_NONE;
+      return Evt_OximeterI2C;
+    }
+  if (xfer_kind == XFER_WRITE)
+    {
+      xfer_kind = XFER_NONE;
+      return Evt_OximeterI2C;
+    }
+  if (timer_armed)
+    {
+      timer_armed = false;
+      now_us += timer_us;
+      return Evt_OximeterSeqTimer;
+    }
+
+  CHECK(!"sequencer stalled, nothing on the bus and no timer");
+  return no_event;
+}
+
+static max32664_seq_result_t run(const max32664_seq_t *sequence)
+{
+  max32664_seq_result_t result = MAX32664_SEQ_RUNNING;
+
+  max32664_seq_start(sequence);
+  for (int turn = 0; (turn < 1000) && (result == MAX32664_SEQ_RUNNING); turn++)
+    {
+      result = max32664_seq_handle_event(pump());
+    }
+
+  CHECK(result != MAX32664_SEQ_RUNNING);
+  return result;
+}
+
+/** Checks that the writes logged from first_log on are the commands of the table */
+static void check_log_is_table(const max32664_seq_t *sequence, uint8_t first_log)
+{
+  for (uint8_t i = 0; i < sequence->count; i++)
+    {
+      const max32664_cmd_t *cmd = &sequence->cmds[i];
+
+      CHECK_EQ(hub.log[first_log + i][0], cmd->family);
+      CHECK_EQ(hub.log[first_log + i][1], cmd->index);
+      CHECK_EQ(hub.log[first_log + i][3], cmd->payload_len);
+      if (cmd->payload_len)
+        {
+          CHECK_EQ(hub.log[first_log + i][2], cmd->payload[0]);
+        }
+    }
+}
+
+static uint32_t table_reads(const max32664_seq_t *sequence)
+{
+  uint32_t reads = 0;
+
+  for (uint8_t i = 0; i < sequence->count; i++)
+    {
+      reads += (sequence->cmds[i].resp_len != 0);
+    }
+  return reads;
+}
+
+static void test_cold_runs_table(void)
+{
+  uint64_t start;
+  uint64_t delays = 0;
+
+  hub_reset(false);
+  start = now_us;
+  CHECK_EQ(run(&max32664_seq_cold), MAX32664_SEQ_DONE);
+
+  CHECK_EQ(hub.log_count, max32664_seq_cold.count);
+  check_log_is_table(&max32664_seq_cold, 0);
+  CHECK_EQ(hub.reads, table_reads(&max32664_seq_cold));
+  CHECK(hub.configured);
+
+  // every delay of the table was waited for, and nothing else
+  for (uint8_t i = 0; i < max32664_seq_cold.count; i++)
+    {
+      delays += max32664_seq_cold.cmds[i].delay_us;
+    }
+  CHECK_EQ(now_us - start, delays);
+}
+
+static void test_warm_on_configured_hub(void)
+{
+  hub_reset(true);
+  CHECK_EQ(run(&max32664_seq_warm), MAX32664_SEQ_DONE);
+  CHECK_EQ(hub.log_count, max32664_seq_warm.count);
+  check_log_is_table(&max32664_seq_warm, 0);
+}
+
+static void test_retry_then_pass(void)
+{
+  static const uint8_t try_again_once[] = { 0x05, 0x00 };
+  uint64_t start;
+
+  // status read answers "try again" once, the sample sequence retries it and carries on
+  hub_reset(true);
+  start = now_us;
+  hub_script(0x00, 0x00, try_again_once, sizeof(try_again_once));
+  CHECK_EQ(run(&max32664_seq_sample), MAX32664_SEQ_DONE);
+
+  CHECK_EQ(hub.attempts[0x00][0], 2);
+  CHECK_EQ(hub.attempts[0x12][0], 1);
+  CHECK_EQ(hub.attempts[0x12][1], 1);
+  CHECK_EQ(hub.log_count, max32664_seq_sample.count + 1);
+  // the retry writes the same command again, then the table goes on
+  CHECK_EQ(hub.log[0][0], 0x00);
+  CHECK_EQ(hub.log[1][0], 0x00);
+  CHECK_EQ(hub.log[2][0], 0x12);
+  // the retried write waited the full delay again before its read
+  CHECK_EQ(now_us - start, 2 * max32664_seq_sample.cmds[0].delay_us +
+                           max32664_seq_sample.cmds[1].delay_us +
+                           max32664_seq_sample.cmds[2].delay_us);
+}
+
+static void test_retries_exhausted(void)
+{
+  static const uint8_t always_bad[] = { 0x04 };
+  const max32664_cmd_t *mode_cmd = &max32664_seq_cold.cmds[0];
+
+  // device mode read keeps failing: 1 + retries writes, nothing after it
+  hub_reset(false);
+  hub_script(mode_cmd->family, mode_cmd->index, always_bad, sizeof(always_bad));
+  CHECK_EQ(run(&max32664_seq_cold), MAX32664_SEQ_FAILED);
+
+  CHECK_EQ(hub.attempts[mode_cmd->family][mode_cmd->index], 1 + mode_cmd->retries);
+  CHECK_EQ(hub.log_count, 1 + mode_cmd->retries);
+  CHECK(!hub.configured);
+  CHECK_EQ(hub.reads, 1 + mode_cmd->retries);
+
+  // the failed sequence leaves nothing on the bus and no timer running
+  CHECK_EQ(xfer_kind, XFER_NONE);
+  CHECK(!timer_armed);
+}
+
+static void test_status_any_is_not_checked(void)
+{
+  static const uint8_t unknown[] = { 0xFF };
+
+  // the AGC enable is MAX32664_STATUS_ANY in the cold table, a bad answer does not stop it
+  hub_reset(false);
+  hub_script(0x52, 0x00, unknown, sizeof(unknown));
+  CHECK_EQ(run(&max32664_seq_cold), MAX32664_SEQ_DONE);
+  CHECK_EQ(hub.attempts[0x52][0], 1);
+}
+
+static void test_warm_falls_back_to_cold(void)
+{
+  // the hub lost its configuration (power cycle), AFE enable is rejected
+  hub_reset(false);
+  CHECK_EQ(run(&max32664_seq_warm), MAX32664_SEQ_FAILED);
+
+  // no retries on the first warm command, the fallback is not delayed
+  CHECK_EQ(max32664_seq_warm.cmds[0].retries, 0);
+  CHECK_EQ(hub.log_count, 1);
+  CHECK_EQ(hub.attempts[0x44][3], 1);
+
+  // what state_seq_bringup does on a failed warm start: the cold sequence on the same hub
+  CHECK_EQ(run(&max32664_seq_cold), MAX32664_SEQ_DONE);
+  check_log_is_table(&max32664_seq_cold, 1);
+  CHECK(hub.configured);
+
+  // and the next session can start warm again
+  hub.log_count = 0;
+  CHECK_EQ(run(&max32664_seq_warm), MAX32664_SEQ_DONE);
+  check_log_is_table(&max32664_seq_warm, 0);
+}
+
+static void test_waits_for_all_hub_transfers(void)
+{
+  int turns = 0;
+
+  // another sensor hub transfer is still queued, the write is not done for the sequencer
+  hub_reset(true);
+  max32664_seq_start(&max32664_seq_shutdown);
+  extra_pending = 1;
+  CHECK_EQ(max32664_seq_handle_event(pump()), MAX32664_SEQ_RUNNING);
+  CHECK(!timer_armed);
+
+  // it is once the last one is done
+  extra_pending = 0;
+  CHECK_EQ(max32664_seq_handle_event(Evt_OximeterI2C), MAX32664_SEQ_RUNNING);
+  CHECK(timer_armed);
+
+  while (turns++ < 100)
+    {
+      max32664_seq_result_t r = max32664_seq_handle_event(pump());
+
+      if (r != MAX32664_SEQ_RUNNING)
+        {
+          CHECK_EQ(r, MAX32664_SEQ_DONE);
+          break;
+        }
+    }
+  CHECK_EQ(hub.log_count, max32664_seq_shutdown.count);
+}
+
+static void test_restart_mid_sequence(void)
+{
+  // a new sequence started while one is waiting on its delay drops the old one
+  hub_reset(true);
+  max32664_seq_start(&max32664_seq_sample);
+  CHECK_EQ(max32664_seq_handle_event(pump()), MAX32664_SEQ_RUNNING);
+  CHECK(timer_armed);
+
+  CHECK_EQ(run(&max32664_seq_shutdown), MAX32664_SEQ_DONE);
+  CHECK_EQ(hub.log_count, 1 + max32664_seq_shutdown.count);
+  check_log_is_table(&max32664_seq_shutdown, 1);
+}
+
+int main(void)
+{
+  test_cold_runs_table();
+  test_warm_on_configured_hub();
+  test_retry_then_pass();
+  test_retries_exhausted();
+  test_status_any_is_not_checked();
+  test_warm_falls_back_to_cold();
+  test_waits_for_all_hub_transfers();
+  test_restart_mid_sequence();
+
+  TEST_DONE();
+}
@@ -0,0 +1,251 @@
+/*
+ * test_scheduler_events.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Host test of the scheduler event bits. The real ISRs in src/irq.c raise
+ *              overlapping signals, a fake stack ORs them into one pending word the way
+ *              sl_bt_external_signal() does, and schedulerDispatchEvent() has to hand
+ *              every bit to the state machines exactly once.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "src/scheduler.h"
+#include "src/irq.h"
+#include "src/gpio.h"
+#include "src/ble.h"
+#include "src/pulse_oximeter.h"
+#include "em_letimer.h"
+#include "em_gpio.h"
+
+/* Vector table entries in src/irq.c, not declared in irq.h */
+void GPIO_EVEN_IRQHandler(void);
+void GPIO_ODD_IRQHandler(void);
+
+/* Peripheral and platform fakes */
+LETIMER_TypeDef fake_letimer0;
+uint32_t fake_gpio_if;
+uint32_t fake_gpio_ien;
+uint8_t fake_gpio_in[6][16];
+
+static uint32_t stack_pending;      ///< Signals ORed together until the stack delivers them
+static uint32_t stack_signal_calls; ///< sl_bt_external_signal() calls
+static uint64_t fake_now_us;
+static uint32_t timer_uf_calls;
+static uint32_t timer_comp1_calls;
+static ble_data_struct_t ble_data;
+
+sl_status_t sl_bt_external_signal(uint32_t signals)
+{
+  stack_pending |= signals;
+  stack_signal_calls++;
+  return SL_STATUS_OK;
+}
+
+uint64_t timerGetMicroseconds(void) { return fake_now_us; }
+uint32_t timerGetPolledWaitsOnEventPath(void) { return 0; }
+void timerHandleUF(void) { timer_uf_calls++; }
+void i2cHandleIRQ(void) {}
+void i2cHandleLdmaIRQ(void) {}
+ble_data_struct_t *getBleDataPtr(void) { return &ble_data; }
+
+/* COMP1 expires due soft timers, here it stands for one that raises LETIMER0_COMP1 */
+void timerHandleCOMP1(void)
+{
+  timer_comp1_calls++;
+  schedulerSetEventCOMP1();
+}
+
+/* What the state machines saw */
+static uint32_t seen[SCHEDULER_NUM_EVENTS];
+static uint32_t seen_other;
+static uint32_t seen_multi_bit;
+
+static void record_handler(sl_bt_msg_t *evt)
+{
+  uint32_t signals;
+
+  if (SL_BT_MSG_ID(evt->header) != sl_bt_evt_system_external_signal_id)
+    {
+      seen_other++;
+      return;
+    }
+
+  signals = evt->data.evt_system_external_signal.extsignals;
+  if (signals & (signals - 1))
+    {
+      seen_multi_bit++;
+    }
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      if (signals & (1U << bit))
+        {
+          seen[bit]++;
+        }
+    }
+}
+
+/** Delivers the pending signals as one event, as the stack does on its next turn */
+static uint32_t stack_deliver(void)
+{
+  sl_bt_msg_t evt;
+  uint32_t delivered = stack_pending;
+
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_bt_evt_system_external_signal_id;
+  evt.data.evt_system_external_signal.extsignals = stack_pending;
+  stack_pending = 0;
+
+  schedulerDispatchEvent(&evt, record_handler);
+
+  // the event is restored for anything looking at it after the dispatch
+  CHECK_EQ(evt.data.evt_system_external_signal.extsignals, delivered);
+
+  return delivered;
+}
+
+static uint32_t bit_index(uint32_t event)
+{
+  uint32_t bit = 0;
+
+  while ((event >> bit) != 1)
+    {
+      bit++;
+    }
+  return bit;
+}
+
+static void reset_seen(void)
+{
+  memset(seen, 0, sizeof(seen));
+  seen_other = 0;
+  seen_multi_bit = 0;
+}
+
+static void test_letimer_uf_and_comp1(void)
+{
+  reset_seen();
+
+  // both flags pending in one LETIMER0 interrupt
+  fake_letimer0.IEN = LETIMER_IEN_UF | LETIMER_IEN_COMP1;
+  fake_letimer0.IF  = LETIMER_IF_UF | LETIMER_IF_COMP1;
+  LETIMER0_IRQHandler();
+
+  CHECK_EQ(fake_letimer0.IF, 0);
+  CHECK_EQ(timer_uf_calls, 1);
+  CHECK_EQ(timer_comp1_calls, 1);
+
+  CHECK_EQ(stack_deliver(), LETIMER0_UF | LETIMER0_COMP1);
+  CHECK_EQ(seen[bit_index(LETIMER0_UF)], 1);
+  CHECK_EQ(seen[bit_index(LETIMER0_COMP1)], 1);
+  CHECK_EQ(seen_multi_bit, 0);
+
+  // only COMP1: UF must not be raised with it
+  reset_seen();
+  fake_letimer0.IF = LETIMER_IF_COMP1;
+  LETIMER0_IRQHandler();
+  CHECK_EQ(stack_deliver(), LETIMER0_COMP1);
+  CHECK_EQ(seen[bit_index(LETIMER0_UF)], 0);
+  CHECK_EQ(seen[bit_index(LETIMER0_COMP1)], 1);
+}
+
+static void test_gpio_overlap(void)
+{
+  reset_seen();
+
+  fake_gpio_ien = (1U << PB0_BUTTON_PIN) | (1U << PB1_BUTTON_PIN) |
+                  (1U << GESTURE_PIN) | (1U << MFIO_INT_NO);
+
+  // gesture, MFIO and PB0 all pending before either GPIO handler runs
+  fake_gpio_if = (1U << GESTURE_PIN) | (1U << MFIO_INT_NO) | (1U << PB0_BUTTON_PIN);
+  fake_gpio_in[BUTTON_PORT][PB0_BUTTON_PIN] = 0;
+
+  GPIO_EVEN_IRQHandler();
+  // the even handler must leave the odd pins for the odd one
+  CHECK_EQ(fake_gpio_if, (1U << GESTURE_PIN) | (1U << MFIO_INT_NO));
+  CHECK(ble_data.button_pressed);
+
+  GPIO_ODD_IRQHandler();
+  CHECK_EQ(fake_gpio_if, 0);
+
+  CHECK_EQ(stack_deliver(), Evt_Button_Pressed | Evt_GestureInt | Evt_OximeterMfio);
+  CHECK_EQ(seen[bit_index(Evt_Button_Pressed)], 1);
+  CHECK_EQ(seen[bit_index(Evt_GestureInt)], 1);
+  CHECK_EQ(seen[bit_index(Evt_OximeterMfio)], 1);
+  CHECK_EQ(seen_multi_bit, 0);
+}
+
+static void test_every_bit_at_once(void)
+{
+  uint32_t all = (1U << SCHEDULER_NUM_EVENTS) - 1;
+
+  reset_seen();
+  schedulerSetEvent(all);
+  CHECK_EQ(stack_deliver(), all);
+
+  for (uint32_t bit = 0; bit < SCHEDULER_NUM_EVENTS; bit++)
+    {
+      CHECK_EQ(seen[bit], 1);
+    }
+  CHECK_EQ(seen_multi_bit, 0);
+}
+
+static void test_stats(void)
+{
+  const scheduler_stats_t *stats = schedulerGetStats();
+  uint32_t i2c = bit_index(I2C_COMPLETE);
+  uint32_t raised, dispatched, coalesced, multi;
+
+  raised     = stats->raised[i2c];
+  dispatched = stats->dispatched[i2c];
+  coalesced  = stats->coalesced[i2c];
+  multi      = stats->multi_bit_signals;
+
+  // the same bit twice before delivery merges into one dispatch, the counters show it
+  reset_seen();
+  fake_now_us = 1000;
+  schedulerSetEventI2Ccomplete();
+  fake_now_us = 2000;
+  schedulerSetEventI2Ccomplete();
+  schedulerSetGestureEvent();
+  stack_deliver();
+
+  CHECK_EQ(seen[i2c], 1);
+  CHECK_EQ(stats->raised[i2c] - raised, 2);
+  CHECK_EQ(stats->dispatched[i2c] - dispatched, 1);
+  CHECK_EQ(stats->coalesced[i2c] - coalesced, 1);
+  CHECK_EQ(stats->multi_bit_signals - multi, 1);
+  CHECK_EQ(schedulerGetRaiseTime(I2C_COMPLETE), 2000);
+
+  // a lone bit is not counted as coalesced
+  coalesced = stats->coalesced[i2c];
+  schedulerSetEventI2Ccomplete();
+  stack_deliver();
+  CHECK_EQ(stats->coalesced[i2c], coalesced);
+}
+
+static void test_stack_events_pass_through(void)
+{
+  sl_bt_msg_t evt;
+
+  reset_seen();
+  memset(&evt, 0, sizeof(evt));
+  evt.header = sl_bt_evt_system_boot_id;
+
+  CHECK(!schedulerIsDispatching());
+  schedulerDispatchEvent(&evt, record_handler);
+  CHECK(!schedulerIsDispatching());
+  CHECK_EQ(seen_other, 1);
+}
+
+int main(void)
+{
+  test_letimer_uf_and_comp1();
+  test_gpio_overlap();
+  test_every_bit_at_once();
+  test_stats();
+  test_stack_events_pass_through();
+
+  TEST_DONE();
+}
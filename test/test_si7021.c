@@ -0,0 +1,198 @@
+/*
+ * test_si7021.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Host test of the Si7021 helpers. Every one of the 65536 temperature and
+ *              humidity codes is converted and compared with the datasheet formula in
+ *              double precision, the integer result has to be the rounded reference.
+ *              The power model is swept over sampling intervals and the policy it picks is
+ *              checked against the charge it reports for both policies.
+ *
+ *              build/test_si7021 --table prints the per hour on-time and charge of both
+ *              policies around the crossover, from the functions the firmware calls.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "test.h"
+#include "src/si7021.h"
+#include "src/timers.h"
+
+/** Allowed distance from the reference: rounding, plus double noise at exact halves */
+#define ROUNDING_TOLERANCE (0.5 + 1e-6)
+
+static void test_all_temperature_codes(void)
+{
+  double worst = 0.0;
+  int32_t prev = INT32_MIN;
+  uint32_t bad = 0;
+
+  for (uint32_t code = 0; code <= 0xFFFF; code++)
+    {
+      // datasheet: Temperature (C) = 175.72 * code / 65536 - 46.85
+      double ref = (175.72 * code / 65536.0 - 46.85) * 1000.0;
+      int32_t mc = si7021_code_to_millicelsius((uint16_t)code);
+      double err = fabs(mc - ref);
+
+      if (err > worst)
+        {
+          worst = err;
+        }
+      if ((err > ROUNDING_TOLERANCE) || (mc < prev))
+        {
+          if (bad++ < 5)
+            {
+              printf("  temperature code %lu: %ld mC, reference %.4f\n",
+                     (unsigned long)code, (long)mc, ref);
+            }
+        }
+      prev = mc;
+    }
+
+  CHECK_EQ(bad, 0);
+  CHECK(worst <= ROUNDING_TOLERANCE);
+  CHECK_EQ(si7021_code_to_millicelsius(0), -46850);
+  CHECK_EQ(si7021_code_to_millicelsius(0xFFFF), 128867);
+  // 25.00 C is code 26796.96, the codes either side round to 24.997 and 25.000
+  CHECK_EQ(si7021_code_to_millicelsius(26796), 24997);
+  CHECK_EQ(si7021_code_to_millicelsius(26797), 25000);
+}
+
+static void test_all_humidity_codes(void)
+{
+  double worst = 0.0;
+  int32_t prev = INT32_MIN;
+  uint32_t bad = 0;
+
+  for (uint32_t code = 0; code <= 0xFFFF; code++)
+    {
+      // datasheet: %RH = 125 * code / 65536 - 6, clamped to 0-100 %
+      double ref = (125.0 * code / 65536.0 - 6.0) * 1000.0;
+      int32_t mrh = si7021_code_to_millirh((uint16_t)code);
+      double err;
+
+      if (ref < 0.0)
+        {
+          ref = 0.0;
+        }
+      if (ref > 100000.0)
+        {
+          ref = 100000.0;
+        }
+      err = fabs(mrh - ref);
+
+      if (err > worst)
+        {
+          worst = err;
+        }
+      if ((err > ROUNDING_TOLERANCE) || (mrh < prev) || (mrh < 0) || (mrh > 100000))
+        {
+          if (bad++ < 5)
+            {
+              printf("  humidity code %lu: %ld m%%RH, reference %.4f\n",
+                     (unsigned long)code, (long)mrh, ref);
+            }
+        }
+      prev = mrh;
+    }
+
+  CHECK_EQ(bad, 0);
+  CHECK(worst <= ROUNDING_TOLERANCE);
+  CHECK_EQ(si7021_code_to_millirh(0), 0);
+  CHECK_EQ(si7021_code_to_millirh(0xFFFF), 100000);
+  // 50 %RH is code 29360.13, code 29360 is 49.99976 %RH
+  CHECK_EQ(si7021_code_to_millirh(29360), 50000);
+}
+
+/** Sampling intervals of the sweep and the table, in milliseconds */
+static const uint32_t intervals_ms[] = {
+    100, 500, 1000, 3000, 10000, 30000, 60000, 300000, 600000, 1800000,
+    3600000, 4000000, 4600000, 4666000, 4667000, 4700000, 6000000, 36000000,
+};
+
+/** The crossover in closed form, straight from the datasheet currents */
+static double model_crossover_s(void)
+{
+  double powerup_uc = SI7021_IDD_POWERUP_UA * (SI7021_POWERUP_US / 1e6);
+  double standby_ua = SI7021_IDD_STANDBY_NA / 1000.0;
+
+  return powerup_uc / standby_ua;
+}
+
+static void test_power_model(void)
+{
+  uint32_t cross_s = si7021_crossover_interval_s();
+  uint32_t conv_us = si7021_rh_conversion_max_us(SI7021_RES_RH12_T14);
+
+  // 3500 uA for 80 ms against 60 nA standby: 4666.7 s
+  CHECK_EQ(cross_s, (uint32_t)model_crossover_s());
+  CHECK_EQ(cross_s, 4666);
+  CHECK_EQ(conv_us, 12000 + 10800);
+
+  // the policy flips on the crossover and nowhere else
+  CHECK_EQ(si7021_power_policy_for(cross_s * 1000 - 1), SI7021_KEEP_WARM);
+  CHECK_EQ(si7021_power_policy_for(cross_s * 1000), SI7021_POWER_CYCLE);
+  CHECK_EQ(si7021_power_policy_for(LETIMER_PERIOD_MS), SI7021_KEEP_WARM);
+
+  for (size_t i = 0; i < sizeof(intervals_ms) / sizeof(intervals_ms[0]); i++)
+    {
+      uint32_t ms = intervals_ms[i];
+      uint64_t cycle_ms = 3600000ULL * (SI7021_POWERUP_US + conv_us) / 1000 / ms;
+      uint32_t warm_uc = si7021_charge_uc_per_hour(SI7021_KEEP_WARM, ms, SI7021_RES_RH12_T14);
+      uint32_t cycle_uc = si7021_charge_uc_per_hour(SI7021_POWER_CYCLE, ms, SI7021_RES_RH12_T14);
+      uint32_t cycle_on = si7021_on_time_ms_per_hour(SI7021_POWER_CYCLE, ms, SI7021_RES_RH12_T14);
+      si7021_power_policy_t picked = si7021_power_policy_for(ms);
+
+      // kept warm the sensor is on all hour, power cycled only for power-up plus conversion
+      CHECK_EQ(si7021_on_time_ms_per_hour(SI7021_KEEP_WARM, ms, SI7021_RES_RH12_T14), 3600000);
+      CHECK_EQ(cycle_on, (cycle_ms > 3600000) ? 3600000 : cycle_ms);
+      CHECK(cycle_uc > 0);
+
+      // the picked policy never costs more than the other one
+      if (picked == SI7021_KEEP_WARM)
+        {
+          CHECK(warm_uc <= cycle_uc);
+        }
+      else
+        {
+          CHECK(cycle_uc <= warm_uc);
+        }
+    }
+}
+
+/** The crossover table, one line per interval */
+static void print_power_table(void)
+{
+  printf("Si7021 power model, 12-bit RH, per hour (crossover %lu s, closed form %.1f s)\n",
+         (unsigned long)si7021_crossover_interval_s(), model_crossover_s());
+  printf("%10s %12s %12s %12s %12s  %s\n",
+         "interval s", "warm on ms", "warm uC", "cycle on ms", "cycle uC", "picked");
+
+  for (size_t i = 0; i < sizeof(intervals_ms) / sizeof(intervals_ms[0]); i++)
+    {
+      uint32_t ms = intervals_ms[i];
+
+      printf("%10.1f %12lu %12lu %12lu %12lu  %s\n", ms / 1000.0,
+             (unsigned long)si7021_on_time_ms_per_hour(SI7021_KEEP_WARM, ms, SI7021_RES_RH12_T14),
+             (unsigned long)si7021_charge_uc_per_hour(SI7021_KEEP_WARM, ms, SI7021_RES_RH12_T14),
+             (unsigned long)si7021_on_time_ms_per_hour(SI7021_POWER_CYCLE, ms, SI7021_RES_RH12_T14),
+             (unsigned long)si7021_charge_uc_per_hour(SI7021_POWER_CYCLE, ms, SI7021_RES_RH12_T14),
+             (si7021_power_policy_for(ms) == SI7021_KEEP_WARM) ? "keep warm" : "power cycle");
+    }
+}
+
+int main(int argc, char **argv)
+{
+  if ((argc > 1) && (strcmp(argv[1], "--table") == 0))
+    {
+      print_power_table();
+      return 0;
+    }
+
+  test_all_temperature_codes();
+  test_all_humidity_codes();
+  test_power_model();
+
+  TEST_DONE();
+}
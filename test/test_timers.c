@@ -0,0 +1,336 @@
+/*
+ * test_timers.c
+ *
+ *  Created on: 17-Oct-2026
+ * Description: Host test of the LETIMER0 soft timer tick math. LETIMER0 is simulated one
+ *              tick at a time (count down from VALUE_TO_COMP0, UF on reload, COMP1 on match)
+ *              and every expiry is checked against the exact tick it is due on, for waits
+ *              from one tick (61 us) to several minutes and across period rollovers.
+ *              timers.c is included so its static conversion helpers can be checked too.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "../src/timers.c"
+
+LETIMER_TypeDef fake_letimer0;
+
+static uint64_t elapsed;                         ///< Ticks simulated since init
+static uint64_t raised_at[32];                   ///< Tick each event bit was last raised on
+static uint32_t raised_count[32];                ///< Times each event bit was raised
+
+void schedulerSetEvent(uint32_t event)
+{
+  for (uint32_t bit = 0; bit < 32; bit++)
+    {
+      if (event & (1U << bit))
+        {
+          raised_at[bit] = elapsed;
+          raised_count[bit]++;
+        }
+    }
+}
+
+bool schedulerIsDispatching(void)
+{
+  return false;
+}
+
+/** The LETIMER0_IRQHandler() order: clear, UF first, then COMP1 */
+static void service_irq(void)
+{
+  uint32_t flags = LETIMER_IntGetEnabled(LETIMER0);
+
+  if (flags == 0)
+    {
+      return;
+    }
+  LETIMER_IntClear(LETIMER0, flags);
+  if (flags & LETIMER_IF_UF)
+    {
+      timerHandleUF();
+    }
+  if (flags & LETIMER_IF_COMP1)
+    {
+      timerHandleCOMP1();
+    }
+}
+
+/** One LETIMER0 tick: the hardware part, without running the ISR */
+static void tick_hw(void)
+{
+  if (fake_letimer0.CNT == 0)
+    {
+      fake_letimer0.CNT = VALUE_TO_COMP0;
+      fake_letimer0.IF |= LETIMER_IF_UF;
+    }
+  else
+    {
+      fake_letimer0.CNT--;
+    }
+  if (fake_letimer0.CNT == fake_letimer0.COMP1)
+    {
+      fake_letimer0.IF |= LETIMER_IF_COMP1;
+    }
+  elapsed++;
+}
+
+static void advance(uint64_t ticks)
+{
+  while (ticks--)
+    {
+      tick_hw();
+      service_irq();
+    }
+}
+
+static void sim_reset(void)
+{
+  timer_queue     = NULL;
+  timer_rollovers = 0;
+  elapsed         = 0;
+  memset(&fake_letimer0, 0, sizeof(fake_letimer0));
+  memset(raised_at, 0, sizeof(raised_at));
+  memset(raised_count, 0, sizeof(raised_count));
+  init_LETIMER0();
+  fake_letimer0.CNT = VALUE_TO_COMP0;
+  fake_letimer0.COMP1 = 0xFFFFFFFF;
+}
+
+/** Exact tick count of a wait, rounded up: a timer never expires early */
+static uint64_t ticks_for(uint64_t us)
+{
+  uint64_t t = (us * ACTUAL_FREQ + US_PER_SECOND - 1) / US_PER_SECOND;
+
+  return (t == 0) ? 1 : t;
+}
+
+static void test_us_to_ticks(void)
+{
+  static const uint32_t cases[] = {
+      0, 1, 61, 62, 122, 1000, 10800, 80000, 999999, 1000000,
+      2999939, 3000000, 3000061, 6000000, 60000000, 600000000, 0xFFFFFFFF,
+  };
+  uint32_t frac;
+  uint32_t ticks;
+
+  CHECK_EQ(ACTUAL_FREQ, 16384);
+  CHECK_EQ(LETIMER_PERIOD_TICKS, 49153);
+
+  // one tick is 61.035 us: 61 us is a fraction, 62 us just over one tick
+  CHECK_EQ(timerUsToTicks(61, &frac), 0);
+  CHECK_EQ(frac, 999424);
+  CHECK_EQ(timerUsToTicks(62, &frac), 1);
+  CHECK_EQ(frac, 15808);
+  CHECK_EQ(timerUsToTicks(1000000, &frac), 16384);
+  CHECK_EQ(frac, 0);
+  CHECK_EQ(timerUsToTicks(60000000, &frac), 983040);
+  CHECK_EQ(timerUsToTicks(600000000, &frac), 9830400);
+
+  // whole ticks and millionths always add back up to the exact product, up to the largest wait
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+      ticks = timerUsToTicks(cases[i], &frac);
+      CHECK(frac < US_PER_SECOND);
+      CHECK_EQ((uint64_t)ticks * US_PER_SECOND + frac, (uint64_t)cases[i] * ACTUAL_FREQ);
+    }
+  for (uint64_t us = 0; us <= 0xFFFFFFFFULL; us += 104729)
+    {
+      ticks = timerUsToTicks((uint32_t)us, &frac);
+      if ((uint64_t)ticks * US_PER_SECOND + frac != us * ACTUAL_FREQ)
+        {
+          CHECK_EQ((uint64_t)ticks * US_PER_SECOND + frac, us * ACTUAL_FREQ);
+          break;
+        }
+    }
+}
+
+static void test_add_ticks_carry(void)
+{
+  uint32_t ro = 7;
+  uint32_t off = LETIMER_PERIOD_TICKS - 1;
+
+  // one tick from the last one of a period lands on the first of the next
+  timerAddTicks(&ro, &off, 1);
+  CHECK_EQ(ro, 8);
+  CHECK_EQ(off, 0);
+
+  ro = 0;
+  off = 100;
+  timerAddTicks(&ro, &off, 5 * LETIMER_PERIOD_TICKS + LETIMER_PERIOD_TICKS - 100);
+  CHECK_EQ(ro, 6);
+  CHECK_EQ(off, 0);
+
+  CHECK(timerIsBefore(1, LETIMER_PERIOD_TICKS - 1, 2, 0));
+  CHECK(!timerIsBefore(2, 0, 2, 0));
+}
+
+/** Starts a one-shot wait after `phase` ticks and checks the tick it expires on */
+static void check_one_shot(uint32_t us, uint64_t phase)
+{
+  soft_timer_t t;
+  uint32_t bit = 1;
+  uint64_t start;
+  uint64_t due;
+
+  sim_reset();
+  advance(phase);
+
+  timerInit(&t, 1U << bit, NULL, NULL);
+  start = elapsed;
+  due = start + ticks_for(us);
+  timerStart(&t, us, false);
+  CHECK(timerIsRunning(&t));
+
+  advance(due - start - 1);
+  if (raised_count[bit] != 0)
+    {
+      printf("  %lu us from tick %llu expired early on tick %llu, due %llu\n",
+             (unsigned long)us, (unsigned long long)start,
+             (unsigned long long)raised_at[bit], (unsigned long long)due);
+    }
+  CHECK_EQ(raised_count[bit], 0);
+
+  advance(1);
+  if ((raised_count[bit] != 1) || (raised_at[bit] != due))
+    {
+      printf("  %lu us from tick %llu: raised %lu times, last on tick %llu, due %llu\n",
+             (unsigned long)us, (unsigned long long)start, (unsigned long)raised_count[bit],
+             (unsigned long long)raised_at[bit], (unsigned long long)due);
+    }
+  CHECK_EQ(raised_count[bit], 1);
+  CHECK_EQ(raised_at[bit], due);
+  CHECK(!timerIsRunning(&t));
+}
+
+static void test_one_shot_waits(void)
+{
+  static const uint32_t waits[] = {
+      61, 62, 1000, 10800, 80000, 1000000, 2999939, 3000000, 3000061, 6000000,
+      60000000, 300000000,
+  };
+  static const uint64_t phases[] = {
+      0, 1, 24576, LETIMER_PERIOD_TICKS - 2, LETIMER_PERIOD_TICKS - 1, LETIMER_PERIOD_TICKS,
+      3 * LETIMER_PERIOD_TICKS + 17,
+  };
+
+  for (size_t w = 0; w < sizeof(waits) / sizeof(waits[0]); w++)
+    {
+      for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++)
+        {
+          check_one_shot(waits[w], phases[p]);
+        }
+    }
+}
+
+/** A UF that is pending in LETIMER0 but not yet counted by the ISR must be accounted for */
+static void test_start_with_uf_pending(void)
+{
+  soft_timer_t t;
+  uint64_t due;
+
+  sim_reset();
+  LETIMER_IntEnable(LETIMER0, LETIMER_IEN_UF);
+  advance(LETIMER_PERIOD_TICKS - 1);
+
+  // reload happens, but the ISR has not run yet
+  tick_hw();
+  CHECK(fake_letimer0.IF & LETIMER_IF_UF);
+  CHECK_EQ(timerGetTicks(), elapsed);
+
+  timerInit(&t, 1U << 1, NULL, NULL);
+  due = elapsed + ticks_for(1000000);
+  timerStart(&t, 1000000, false);
+  service_irq();
+
+  advance(due - elapsed);
+  CHECK_EQ(raised_count[1], 1);
+  CHECK_EQ(raised_at[1], due);
+}
+
+static void test_periodic(void)
+{
+  static const uint32_t periods[] = { 10000, 1000000, 3000000, 4000000 };
+  soft_timer_t t;
+  uint32_t bit = 6;
+  uint64_t start;
+
+  for (size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); p++)
+    {
+      sim_reset();
+      advance(1234);
+      timerInit(&t, 1U << bit, NULL, NULL);
+      start = elapsed;
+      timerStart(&t, periods[p], true);
+
+      // the k-th expiry stays on floor(k * period), the fraction is carried, never lost
+      for (uint64_t k = 1; k <= 50; k++)
+        {
+          uint64_t due = start + (k * periods[p] * ACTUAL_FREQ) / US_PER_SECOND;
+
+          advance(due - elapsed);
+          if ((raised_count[bit] != k) || (raised_at[bit] != due))
+            {
+              printf("  period %lu us, expiry %llu: count %lu on tick %llu, due %llu\n",
+                     (unsigned long)periods[p], (unsigned long long)k,
+                     (unsigned long)raised_count[bit], (unsigned long long)raised_at[bit],
+                     (unsigned long long)due);
+              CHECK_EQ(raised_at[bit], due);
+              break;
+            }
+        }
+      timerStop(&t);
+      CHECK(!timerIsRunning(&t));
+    }
+}
+
+static void test_microseconds_across_rollovers(void)
+{
+  uint64_t before;
+  uint32_t start32;
+
+  sim_reset();
+  LETIMER_IntEnable(LETIMER0, LETIMER_IEN_UF);
+
+  // exact on both sides of a period boundary
+  advance(LETIMER_PERIOD_TICKS - 1);
+  CHECK_EQ(timerGetMicroseconds(), (elapsed * US_PER_SECOND) / ACTUAL_FREQ);
+  advance(1);
+  CHECK_EQ(timer_rollovers, 1);
+  CHECK_EQ(timerGetMicroseconds(), 3000061);
+
+  // an hour of periods, checked every few seconds
+  while (elapsed < 3600ULL * ACTUAL_FREQ)
+    {
+      before = timerGetMicroseconds();
+      advance(40961);
+      CHECK_EQ(timerGetMicroseconds(), (elapsed * US_PER_SECOND) / ACTUAL_FREQ);
+      CHECK(timerGetMicroseconds() > before);
+    }
+  CHECK_EQ(timer_rollovers, elapsed / LETIMER_PERIOD_TICKS);
+
+  // 32-bit differences of the timestamp survive the wrap of the low word every 71.6 minutes
+  while (elapsed < 4300ULL * ACTUAL_FREQ)
+    {
+      advance(163840);
+    }
+  start32 = (uint32_t)timerGetMicroseconds();
+  advance(12345);
+  CHECK_EQ((uint32_t)((uint32_t)timerGetMicroseconds() - start32),
+           (uint32_t)(((elapsed * US_PER_SECOND) / ACTUAL_FREQ) -
+                      (((elapsed - 12345) * US_PER_SECOND) / ACTUAL_FREQ)));
+  CHECK(timerGetMicroseconds() > 0xFFFFFFFFULL);
+}
+
+int main(void)
+{
+  test_us_to_ticks();
+  test_add_ticks_carry();
+  test_one_shot_waits();
+  test_start_with_uf_pending();
+  test_periodic();
+  test_microseconds_across_rollovers();
+
+  TEST_DONE();
+}